@@ -0,0 +1,126 @@
+#include "SpeechAudioCaptureWorker.h"
+#include "SpeechAudioRingBuffer.h"
+#include "SpeechAudioSource.h"
+#include "SpeechRecognitionWorker.h"
+#include "SpeechRecognitionStats.h"
+
+FSpeechAudioCaptureWorker::FSpeechAudioCaptureWorker(FSpeechAudioRingBuffer& InRingBuffer)
+	: RingBuffer(InRingBuffer)
+	, bSourceFinished(false)
+	, bSourceFailed(false)
+	, PollInterval(0.005f)
+{
+}
+
+FSpeechAudioCaptureWorker::~FSpeechAudioCaptureWorker()
+{
+	Shutdown();
+}
+
+bool FSpeechAudioCaptureWorker::Start(const TSharedPtr<ISpeechAudioSource>& InSource, int32 InSampleRate)
+{
+	Shutdown();
+
+	if (!InSource.IsValid() || !InSource->Open(InSampleRate)) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to open audio source %s"), InSource.IsValid() ? *InSource->GetDescription() : TEXT("(none)"));
+		return false;
+	}
+
+	Source = InSource;
+	SampleRate = InSampleRate;
+	bSourceFinished.store(false);
+	bSourceFailed.store(false);
+
+	// push sources write from their own callback, so there is nothing to poll
+	if (Source->IsPushSource()) {
+		Source->BindOutput(&RingBuffer);
+		return true;
+	}
+
+	StopTaskCounter.Reset();
+	const int32 threadIdx = ISpeechRecognition::Get().GetInstanceCounter();
+	const FString threadName = FString("FSpeechAudioCaptureWorker:") + FString::FromInt(threadIdx);
+	Thread = FRunnableThread::Create(this, *threadName, 0U, TPri_Highest);
+	return Thread != nullptr;
+}
+
+void FSpeechAudioCaptureWorker::Shutdown()
+{
+	if (Thread != nullptr) {
+		Stop();
+		Thread->WaitForCompletion();
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	if (Source.IsValid()) {
+		Source->Close();
+		Source->BindOutput(nullptr);
+		Source.Reset();
+	}
+}
+
+void FSpeechAudioCaptureWorker::Stop()
+{
+	StopTaskCounter.Increment();
+}
+
+uint32 FSpeechAudioCaptureWorker::Run()
+{
+	const bool bRealTime = Source->IsRealTime();
+	const double playbackSpeed = Source->GetPlaybackSpeed();
+	const double startTime = FPlatformTime::Seconds();
+	uint64 samplesDelivered = 0;
+
+	while (StopTaskCounter.GetValue() == 0) {
+
+		// devices are drained as fast as they fill. Anything else is only read as fast as the decoder keeps up,
+		// optionally paced to a multiple of real time
+		int32 toRead = UE_ARRAY_COUNT(CaptureBuffer);
+		if (!bRealTime) {
+			toRead = FMath::Min(toRead, RingBuffer.Slack());
+			if (playbackSpeed > 0.0) {
+				const double allowedSamples = (FPlatformTime::Seconds() - startTime) * playbackSpeed * SampleRate;
+				toRead = FMath::Min(toRead, (int32)FMath::Max(allowedSamples - (double)samplesDelivered, 0.0));
+			}
+			if (toRead == 0) {
+				FPlatformProcess::Sleep(0.001f);
+				continue;
+			}
+		}
+
+		int32 k;
+		{
+			SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_AudioRead);
+			k = Source->Read(CaptureBuffer, toRead);
+		}
+		if (k < 0) {
+			// a device is reopened by the decode thread. Reopening anything else would replay it from the start, so it ends the stream
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to read audio from %s"), *Source->GetDescription());
+			if (bRealTime) {
+				bSourceFailed.store(true, std::memory_order_release);
+			}
+			else {
+				bSourceFinished.store(true, std::memory_order_release);
+			}
+			RingBuffer.WakeReader();
+			return 1;
+		}
+
+		if (k == 0) {
+			if (Source->IsFinished()) {
+				bSourceFinished.store(true, std::memory_order_release);
+				RingBuffer.WakeReader();
+				return 0;
+			}
+			// the source has nothing new for us yet
+			FPlatformProcess::Sleep(PollInterval.load(std::memory_order_relaxed));
+			continue;
+		}
+
+		RingBuffer.Write(CaptureBuffer, k);
+		samplesDelivered += k;
+	}
+
+	return 0;
+}
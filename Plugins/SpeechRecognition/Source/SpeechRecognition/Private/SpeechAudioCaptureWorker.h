@@ -0,0 +1,55 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeCounter.h"
+#include <atomic>
+
+class FSpeechAudioRingBuffer;
+class ISpeechAudioSource;
+
+/**
+ * Pumps samples from an audio source into a ring buffer, on a dedicated thread.
+ * This keeps a recording device drained while the decode thread is busy with a search switch or a long utterance end.
+ */
+class FSpeechAudioCaptureWorker : public FRunnable
+{
+public:
+	explicit FSpeechAudioCaptureWorker(FSpeechAudioRingBuffer& InRingBuffer);
+	virtual ~FSpeechAudioCaptureWorker() override;
+
+	/** Opens the source, and starts the capture thread */
+	bool Start(const TSharedPtr<ISpeechAudioSource>& InSource, int32 SampleRate);
+
+	/** Stops the capture thread, and closes the source */
+	void Shutdown();
+
+	/** False once the source has been closed, or a device stopped delivering, and capture needs starting again */
+	bool IsRunning() const { return Source.IsValid() && !bSourceFailed.load(std::memory_order_acquire); }
+
+	/** True once a finite source has been fully copied into the ring buffer, or could not be read any further */
+	bool IsSourceFinished() const { return bSourceFinished.load(std::memory_order_acquire); }
+
+	/** True when a real-time source failed a read. It stays set until the next successful Start */
+	bool HasSourceFailed() const { return bSourceFailed.load(std::memory_order_acquire); }
+
+	/** How long to sleep when a device has nothing new. Kept well under the decoder's target latency */
+	void SetPollInterval(float InSeconds) { PollInterval.store(FMath::Clamp(InSeconds, 0.001f, 0.01f), std::memory_order_relaxed); }
+
+	//FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	FSpeechAudioRingBuffer& RingBuffer;
+
+	TSharedPtr<ISpeechAudioSource> Source;
+	int32 SampleRate = 0;
+	int16 CaptureBuffer[1024];
+	std::atomic<bool> bSourceFinished;
+	std::atomic<bool> bSourceFailed;
+	std::atomic<float> PollInterval;
+
+	FRunnableThread* Thread = nullptr;
+	FThreadSafeCounter StopTaskCounter;
+};
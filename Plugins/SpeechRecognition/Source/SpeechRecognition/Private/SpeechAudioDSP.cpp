@@ -0,0 +1,463 @@
+#include "SpeechAudioDSP.h"
+#include "Algo/Reverse.h"
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+	#define SPEECH_DSP_NEON 1
+	#define SPEECH_DSP_SSE 0
+	#include <arm_neon.h>
+#elif PLATFORM_ENABLE_VECTORINTRINSICS
+	#define SPEECH_DSP_NEON 0
+	#define SPEECH_DSP_SSE 1
+	#include <emmintrin.h>
+#else
+	#define SPEECH_DSP_NEON 0
+	#define SPEECH_DSP_SSE 0
+#endif
+
+/**************************
+// Kernels
+**************************/
+void SpeechAudioDSP::ConvertFloatToInt16(const float* In, int16* Out, int32 Num)
+{
+	int32 i = 0;
+#if SPEECH_DSP_SSE
+	const __m128 scale = _mm_set1_ps(32767.0f);
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	const __m128 hi = _mm_set1_ps(1.0f);
+	for (; i + 8 <= Num; i += 8) {
+		const __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(In + i), lo), hi), scale);
+		const __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(In + i + 4), lo), hi), scale);
+		// round to nearest, then pack with signed saturation
+		_mm_storeu_si128((__m128i*)(Out + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+	}
+#elif SPEECH_DSP_NEON
+	const float32x4_t lo = vdupq_n_f32(-1.0f);
+	const float32x4_t hi = vdupq_n_f32(1.0f);
+	for (; i + 8 <= Num; i += 8) {
+		const float32x4_t a = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(In + i), lo), hi), 32767.0f);
+		const float32x4_t b = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(In + i + 4), lo), hi), 32767.0f);
+		vst1q_s16(Out + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b))));
+	}
+#endif
+	for (; i < Num; i++) {
+		Out[i] = (int16)FMath::RoundToInt(FMath::Clamp(In[i], -1.0f, 1.0f) * 32767.0f);
+	}
+}
+
+void SpeechAudioDSP::DownmixToMono(const float* InInterleaved, int32 NumFrames, int32 NumChannels, float* OutMono)
+{
+	if (NumChannels == 1) {
+		FMemory::Memcpy(OutMono, InInterleaved, NumFrames * sizeof(float));
+		return;
+	}
+
+	int32 i = 0;
+	if (NumChannels == 2) {
+#if SPEECH_DSP_SSE
+		const __m128 half = _mm_set1_ps(0.5f);
+		for (; i + 4 <= NumFrames; i += 4) {
+			const __m128 a = _mm_loadu_ps(InInterleaved + i * 2);
+			const __m128 b = _mm_loadu_ps(InInterleaved + i * 2 + 4);
+			const __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			_mm_storeu_ps(OutMono + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+		}
+#elif SPEECH_DSP_NEON
+		for (; i + 4 <= NumFrames; i += 4) {
+			const float32x4x2_t frames = vld2q_f32(InInterleaved + i * 2);
+			vst1q_f32(OutMono + i, vmulq_n_f32(vaddq_f32(frames.val[0], frames.val[1]), 0.5f));
+		}
+#endif
+		for (; i < NumFrames; i++) {
+			OutMono[i] = (InInterleaved[i * 2] + InInterleaved[i * 2 + 1]) * 0.5f;
+		}
+		return;
+	}
+
+	const float scale = 1.0f / (float)NumChannels;
+	for (; i < NumFrames; i++) {
+		float sum = 0.0f;
+		for (int32 c = 0; c < NumChannels; c++) {
+			sum += InInterleaved[i * NumChannels + c];
+		}
+		OutMono[i] = sum * scale;
+	}
+}
+
+float SpeechAudioDSP::DotProduct(const float* A, const float* B, int32 Num)
+{
+	int32 i = 0;
+	float sum = 0.0f;
+#if SPEECH_DSP_SSE
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	for (; i + 8 <= Num; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(A + i), _mm_loadu_ps(B + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(A + i + 4), _mm_loadu_ps(B + i + 4)));
+	}
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	sum = _mm_cvtss_f32(acc0);
+#elif SPEECH_DSP_NEON
+	float32x4_t acc0 = vdupq_n_f32(0.0f);
+	float32x4_t acc1 = vdupq_n_f32(0.0f);
+	for (; i + 8 <= Num; i += 8) {
+		acc0 = vmlaq_f32(acc0, vld1q_f32(A + i), vld1q_f32(B + i));
+		acc1 = vmlaq_f32(acc1, vld1q_f32(A + i + 4), vld1q_f32(B + i + 4));
+	}
+	sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#endif
+	for (; i < Num; i++) {
+		sum += A[i] * B[i];
+	}
+	return sum;
+}
+
+void SpeechAudioDSP::MeasureLevel(const int16* In, int32 Num, int32& OutPeak, uint64& OutSumSquares)
+{
+	int32 i = 0;
+	int32 peak = 0;
+	uint64 sumSquares = 0;
+#if SPEECH_DSP_SSE
+	const __m128i zero = _mm_setzero_si128();
+	__m128i peaks = zero;
+	__m128i sums = zero;
+	for (; i + 8 <= Num; i += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i*)(In + i));
+		// saturating negate, so |-32768| clamps to 32767 instead of wrapping
+		peaks = _mm_max_epi16(peaks, _mm_max_epi16(x, _mm_subs_epi16(zero, x)));
+		// pairs of squares fit in an unsigned 32-bit lane, widen them before accumulating
+		const __m128i squares = _mm_madd_epi16(x, x);
+		sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(squares, zero));
+		sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(squares, zero));
+	}
+	peaks = _mm_max_epi16(peaks, _mm_srli_si128(peaks, 8));
+	peaks = _mm_max_epi16(peaks, _mm_srli_si128(peaks, 4));
+	peaks = _mm_max_epi16(peaks, _mm_srli_si128(peaks, 2));
+	peak = (int16)_mm_cvtsi128_si32(peaks);
+	uint64 lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, sums);
+	sumSquares = lanes[0] + lanes[1];
+#elif SPEECH_DSP_NEON
+	int16x8_t peaks = vdupq_n_s16(0);
+	int64x2_t sums = vdupq_n_s64(0);
+	for (; i + 8 <= Num; i += 8) {
+		const int16x8_t x = vld1q_s16(In + i);
+		peaks = vmaxq_s16(peaks, vqabsq_s16(x));
+		sums = vpadalq_s32(sums, vmull_s16(vget_low_s16(x), vget_low_s16(x)));
+		sums = vpadalq_s32(sums, vmull_s16(vget_high_s16(x), vget_high_s16(x)));
+	}
+	peak = vmaxvq_s16(peaks);
+	sumSquares = (uint64)vaddvq_s64(sums);
+#endif
+	for (; i < Num; i++) {
+		const int32 x = In[i];
+		peak = FMath::Max(peak, FMath::Min(FMath::Abs(x), 32767));
+		sumSquares += (uint64)(x * x);
+	}
+	OutPeak = peak;
+	OutSumSquares = sumSquares;
+}
+
+void SpeechAudioDSP::PreEmphasize(const int16* In, int32 Num, int16 Prior, float Alpha, float* Out)
+{
+	if (Num <= 0) {
+		return;
+	}
+	Out[0] = (float)In[0] - Alpha * (float)Prior;
+
+	int32 i = 1;
+#if SPEECH_DSP_SSE
+	const __m128 alpha = _mm_set1_ps(Alpha);
+	for (; i + 8 <= Num; i += 8) {
+		const __m128i cur = _mm_loadu_si128((const __m128i*)(In + i));
+		const __m128i prev = _mm_loadu_si128((const __m128i*)(In + i - 1));
+		// sign extend to 32 bits by unpacking into the high half, and shifting back down
+		const __m128 curLo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(cur, cur), 16));
+		const __m128 curHi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(cur, cur), 16));
+		const __m128 prevLo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(prev, prev), 16));
+		const __m128 prevHi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(prev, prev), 16));
+		_mm_storeu_ps(Out + i, _mm_sub_ps(curLo, _mm_mul_ps(alpha, prevLo)));
+		_mm_storeu_ps(Out + i + 4, _mm_sub_ps(curHi, _mm_mul_ps(alpha, prevHi)));
+	}
+#elif SPEECH_DSP_NEON
+	for (; i + 8 <= Num; i += 8) {
+		const int16x8_t cur = vld1q_s16(In + i);
+		const int16x8_t prev = vld1q_s16(In + i - 1);
+		vst1q_f32(Out + i, vmlsq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(cur))), vcvtq_f32_s32(vmovl_s16(vget_low_s16(prev))), Alpha));
+		vst1q_f32(Out + i + 4, vmlsq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(cur))), vcvtq_f32_s32(vmovl_s16(vget_high_s16(prev))), Alpha));
+	}
+#endif
+	for (; i < Num; i++) {
+		Out[i] = (float)In[i] - Alpha * (float)In[i - 1];
+	}
+}
+
+void SpeechAudioDSP::Multiply(float* A, const float* B, int32 Num)
+{
+	int32 i = 0;
+#if SPEECH_DSP_SSE
+	for (; i + 4 <= Num; i += 4) {
+		_mm_storeu_ps(A + i, _mm_mul_ps(_mm_loadu_ps(A + i), _mm_loadu_ps(B + i)));
+	}
+#elif SPEECH_DSP_NEON
+	for (; i + 4 <= Num; i += 4) {
+		vst1q_f32(A + i, vmulq_f32(vld1q_f32(A + i), vld1q_f32(B + i)));
+	}
+#endif
+	for (; i < Num; i++) {
+		A[i] *= B[i];
+	}
+}
+
+/**************************
+// Real FFT
+**************************/
+void FSpeechRealFft::Init(int32 InSize)
+{
+	check(FMath::IsPowerOfTwo(InSize) && InSize >= 4);
+	Size = InSize;
+	HalfSize = InSize / 2;
+
+	int32 numBits = 0;
+	while ((1 << numBits) < HalfSize) {
+		numBits++;
+	}
+	BitReverse.SetNumUninitialized(HalfSize);
+	for (int32 n = 0; n < HalfSize; n++) {
+		int32 reversed = 0;
+		for (int32 b = 0; b < numBits; b++) {
+			reversed |= ((n >> b) & 1) << (numBits - 1 - b);
+		}
+		BitReverse[n] = reversed;
+	}
+
+	// computed in double, so the tables are as exact as float allows
+	TwiddleRe.SetNumUninitialized(FMath::Max(HalfSize - 1, 1));
+	TwiddleIm.SetNumUninitialized(FMath::Max(HalfSize - 1, 1));
+	for (int32 h = 1; h < HalfSize; h *= 2) {
+		for (int32 k = 0; k < h; k++) {
+			TwiddleRe[h - 1 + k] = (float)FMath::Cos(UE_DOUBLE_PI * (double)k / (double)h);
+			TwiddleIm[h - 1 + k] = (float)-FMath::Sin(UE_DOUBLE_PI * (double)k / (double)h);
+		}
+	}
+
+	SplitRe.SetNumUninitialized(HalfSize + 1);
+	SplitIm.SetNumUninitialized(HalfSize + 1);
+	for (int32 k = 0; k <= HalfSize; k++) {
+		SplitRe[k] = (float)FMath::Cos(2.0 * UE_DOUBLE_PI * (double)k / (double)Size);
+		SplitIm[k] = (float)-FMath::Sin(2.0 * UE_DOUBLE_PI * (double)k / (double)Size);
+	}
+
+	Re.SetNumZeroed(HalfSize);
+	Im.SetNumZeroed(HalfSize);
+}
+
+void FSpeechRealFft::Transform()
+{
+	float* re = Re.GetData();
+	float* im = Im.GetData();
+	for (int32 h = 1; h < HalfSize; h *= 2) {
+		const float* wr = TwiddleRe.GetData() + h - 1;
+		const float* wi = TwiddleIm.GetData() + h - 1;
+		for (int32 start = 0; start < HalfSize; start += 2 * h) {
+			float* ar = re + start;
+			float* ai = im + start;
+			float* br = re + start + h;
+			float* bi = im + start + h;
+			int32 k = 0;
+#if SPEECH_DSP_SSE
+			for (; k + 4 <= h; k += 4) {
+				const __m128 xr = _mm_loadu_ps(br + k);
+				const __m128 xi = _mm_loadu_ps(bi + k);
+				const __m128 twr = _mm_loadu_ps(wr + k);
+				const __m128 twi = _mm_loadu_ps(wi + k);
+				const __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, twr), _mm_mul_ps(xi, twi));
+				const __m128 ti = _mm_add_ps(_mm_mul_ps(xr, twi), _mm_mul_ps(xi, twr));
+				const __m128 yr = _mm_loadu_ps(ar + k);
+				const __m128 yi = _mm_loadu_ps(ai + k);
+				_mm_storeu_ps(br + k, _mm_sub_ps(yr, tr));
+				_mm_storeu_ps(bi + k, _mm_sub_ps(yi, ti));
+				_mm_storeu_ps(ar + k, _mm_add_ps(yr, tr));
+				_mm_storeu_ps(ai + k, _mm_add_ps(yi, ti));
+			}
+#elif SPEECH_DSP_NEON
+			for (; k + 4 <= h; k += 4) {
+				const float32x4_t xr = vld1q_f32(br + k);
+				const float32x4_t xi = vld1q_f32(bi + k);
+				const float32x4_t twr = vld1q_f32(wr + k);
+				const float32x4_t twi = vld1q_f32(wi + k);
+				const float32x4_t tr = vmlsq_f32(vmulq_f32(xr, twr), xi, twi);
+				const float32x4_t ti = vmlaq_f32(vmulq_f32(xr, twi), xi, twr);
+				const float32x4_t yr = vld1q_f32(ar + k);
+				const float32x4_t yi = vld1q_f32(ai + k);
+				vst1q_f32(br + k, vsubq_f32(yr, tr));
+				vst1q_f32(bi + k, vsubq_f32(yi, ti));
+				vst1q_f32(ar + k, vaddq_f32(yr, tr));
+				vst1q_f32(ai + k, vaddq_f32(yi, ti));
+			}
+#endif
+			// the first two stages are narrower than a vector
+			for (; k < h; k++) {
+				const float tr = br[k] * wr[k] - bi[k] * wi[k];
+				const float ti = br[k] * wi[k] + bi[k] * wr[k];
+				br[k] = ar[k] - tr;
+				bi[k] = ai[k] - ti;
+				ar[k] += tr;
+				ai[k] += ti;
+			}
+		}
+	}
+}
+
+void FSpeechRealFft::PowerSpectrum(const float* In, float* OutPower)
+{
+	// even samples are the real part, odd ones the imaginary part
+	for (int32 n = 0; n < HalfSize; n++) {
+		Re[BitReverse[n]] = In[2 * n];
+		Im[BitReverse[n]] = In[2 * n + 1];
+	}
+	Transform();
+
+	// X[k] = E[k] + W^k O[k], with E and O the spectra of the even and odd samples:
+	// E[k] = (Z[k] + conj(Z[M - k])) / 2, O[k] = (Z[k] - conj(Z[M - k])) / 2i
+	const float* re = Re.GetData();
+	const float* im = Im.GetData();
+	const auto powerAt = [this, re, im](int32 k) {
+		const int32 j = (HalfSize - k) % HalfSize;
+		const int32 i = k % HalfSize;
+		const float er = (re[i] + re[j]) * 0.5f;
+		const float ei = (im[i] - im[j]) * 0.5f;
+		const float orr = (im[i] + im[j]) * 0.5f;
+		const float oi = (re[j] - re[i]) * 0.5f;
+		const float xr = er + SplitRe[k] * orr - SplitIm[k] * oi;
+		const float xi = ei + SplitRe[k] * oi + SplitIm[k] * orr;
+		return xr * xr + xi * xi;
+	};
+
+	OutPower[0] = powerAt(0);
+	int32 k = 1;
+#if SPEECH_DSP_SSE
+	const __m128 half = _mm_set1_ps(0.5f);
+	for (; k + 4 <= HalfSize; k += 4) {
+		// Z[M - k] for the four k, reversed so lanes line up
+		const __m128 zr = _mm_loadu_ps(re + k);
+		const __m128 zi = _mm_loadu_ps(im + k);
+		const __m128 crFwd = _mm_loadu_ps(re + HalfSize - k - 3);
+		const __m128 ciFwd = _mm_loadu_ps(im + HalfSize - k - 3);
+		const __m128 cr = _mm_shuffle_ps(crFwd, crFwd, _MM_SHUFFLE(0, 1, 2, 3));
+		const __m128 ci = _mm_shuffle_ps(ciFwd, ciFwd, _MM_SHUFFLE(0, 1, 2, 3));
+		const __m128 er = _mm_mul_ps(_mm_add_ps(zr, cr), half);
+		const __m128 ei = _mm_mul_ps(_mm_sub_ps(zi, ci), half);
+		const __m128 orr = _mm_mul_ps(_mm_add_ps(zi, ci), half);
+		const __m128 oi = _mm_mul_ps(_mm_sub_ps(cr, zr), half);
+		const __m128 wr = _mm_loadu_ps(SplitRe.GetData() + k);
+		const __m128 wi = _mm_loadu_ps(SplitIm.GetData() + k);
+		const __m128 xr = _mm_add_ps(er, _mm_sub_ps(_mm_mul_ps(wr, orr), _mm_mul_ps(wi, oi)));
+		const __m128 xi = _mm_add_ps(ei, _mm_add_ps(_mm_mul_ps(wr, oi), _mm_mul_ps(wi, orr)));
+		_mm_storeu_ps(OutPower + k, _mm_add_ps(_mm_mul_ps(xr, xr), _mm_mul_ps(xi, xi)));
+	}
+#elif SPEECH_DSP_NEON
+	for (; k + 4 <= HalfSize; k += 4) {
+		const float32x4_t zr = vld1q_f32(re + k);
+		const float32x4_t zi = vld1q_f32(im + k);
+		const float32x4_t cr64 = vrev64q_f32(vld1q_f32(re + HalfSize - k - 3));
+		const float32x4_t ci64 = vrev64q_f32(vld1q_f32(im + HalfSize - k - 3));
+		const float32x4_t cr = vcombine_f32(vget_high_f32(cr64), vget_low_f32(cr64));
+		const float32x4_t ci = vcombine_f32(vget_high_f32(ci64), vget_low_f32(ci64));
+		const float32x4_t er = vmulq_n_f32(vaddq_f32(zr, cr), 0.5f);
+		const float32x4_t ei = vmulq_n_f32(vsubq_f32(zi, ci), 0.5f);
+		const float32x4_t orr = vmulq_n_f32(vaddq_f32(zi, ci), 0.5f);
+		const float32x4_t oi = vmulq_n_f32(vsubq_f32(cr, zr), 0.5f);
+		const float32x4_t wr = vld1q_f32(SplitRe.GetData() + k);
+		const float32x4_t wi = vld1q_f32(SplitIm.GetData() + k);
+		const float32x4_t xr = vaddq_f32(er, vmlsq_f32(vmulq_f32(wr, orr), wi, oi));
+		const float32x4_t xi = vaddq_f32(ei, vmlaq_f32(vmulq_f32(wr, oi), wi, orr));
+		vst1q_f32(OutPower + k, vmlaq_f32(vmulq_f32(xr, xr), xi, xi));
+	}
+#endif
+	for (; k <= HalfSize; k++) {
+		OutPower[k] = powerAt(k);
+	}
+}
+
+/**************************
+// Resampler
+**************************/
+void FSpeechResampler::Init(int32 InInputRate, int32 InOutputRate)
+{
+	InputRate = InInputRate;
+	OutputRate = InOutputRate;
+	Step = (double)InputRate / (double)OutputRate;
+	Phase = 0.0;
+
+	Taps.Reset();
+	if (InputRate > OutputRate) {
+		// Blackman windowed sinc, cutting off just below the output Nyquist frequency
+		const int32 numTaps = 32;
+		const double cutoff = 0.45 * (double)OutputRate / (double)InputRate;
+		const double centre = (numTaps - 1) * 0.5;
+		double sum = 0.0;
+		Taps.SetNumUninitialized(numTaps);
+		for (int32 n = 0; n < numTaps; n++) {
+			const double x = n - centre;
+			const double sinc = x == 0.0 ? 2.0 * cutoff : FMath::Sin(2.0 * PI * cutoff * x) / (PI * x);
+			const double window = 0.42 - 0.5 * FMath::Cos(2.0 * PI * n / (numTaps - 1)) + 0.08 * FMath::Cos(4.0 * PI * n / (numTaps - 1));
+			Taps[n] = (float)(sinc * window);
+			sum += Taps[n];
+		}
+		for (float& tap : Taps) {
+			tap = (float)(tap / sum);
+		}
+		Algo::Reverse(Taps);
+	}
+	else {
+		Taps.Add(1.0f);
+	}
+
+	// one sample more than the filter needs, so the output can interpolate back into the previous block
+	HistoryNum = Taps.Num();
+	Work.Reset();
+	Work.SetNumZeroed(HistoryNum + 4096);
+}
+
+int32 FSpeechResampler::GetMaxOutput(int32 NumInput) const
+{
+	return (int32)FMath::CeilToDouble(NumInput / Step) + 2;
+}
+
+float FSpeechResampler::FilterAt(int32 Index) const
+{
+	// Index is relative to the first new sample, and may reach one sample back into the history
+	return SpeechAudioDSP::DotProduct(Taps.GetData(), Work.GetData() + (HistoryNum - Taps.Num() + 1) + Index, Taps.Num());
+}
+
+int32 FSpeechResampler::Process(const float* In, int32 NumInput, float* Out, int32 MaxOutput)
+{
+	if (NumInput <= 0) {
+		return 0;
+	}
+
+	if (Work.Num() < HistoryNum + NumInput) {
+		Work.SetNumUninitialized(HistoryNum + NumInput);
+	}
+	FMemory::Memcpy(Work.GetData() + HistoryNum, In, NumInput * sizeof(float));
+
+	int32 produced = 0;
+	while (produced < MaxOutput) {
+		const int32 index = (int32)FMath::FloorToDouble(Phase);
+		const float frac = (float)(Phase - index);
+		if (index + 1 >= NumInput) {
+			break;
+		}
+		const float a = FilterAt(index);
+		Out[produced++] = frac > 0.0f ? a + (FilterAt(index + 1) - a) * frac : a;
+		Phase += Step;
+	}
+
+	// keep the tail of this block as history for the next one
+	Phase -= NumInput;
+	FMemory::Memmove(Work.GetData(), Work.GetData() + NumInput, HistoryNum * sizeof(float));
+	return produced;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Small signal processing kernels used on the audio path.
+ * Each kernel has an SSE2 or NEON path where the platform provides one, and a scalar fallback.
+ * None of them allocate.
+ */
+namespace SpeechAudioDSP
+{
+	/** Converts [-1, 1] float samples to saturated, rounded int16 */
+	void ConvertFloatToInt16(const float* In, int16* Out, int32 Num);
+
+	/** Averages interleaved frames down to a single channel */
+	void DownmixToMono(const float* InInterleaved, int32 NumFrames, int32 NumChannels, float* OutMono);
+
+	/** Sum of A[i] * B[i] */
+	float DotProduct(const float* A, const float* B, int32 Num);
+
+	/** Largest absolute sample value, and the sum of squared samples, in a single pass */
+	void MeasureLevel(const int16* In, int32 Num, int32& OutPeak, uint64& OutSumSquares);
+
+	/** Out[i] = In[i] - Alpha * In[i - 1], as float. Prior stands in for In[-1] */
+	void PreEmphasize(const int16* In, int32 Num, int16 Prior, float Alpha, float* Out);
+
+	/** A[i] *= B[i] */
+	void Multiply(float* A, const float* B, int32 Num);
+}
+
+/**
+ * Power spectrum of a real signal, through a radix-2 FFT of half its size.
+ * The even and odd samples are packed as one complex signal, transformed in split real and imaginary arrays,
+ * and the two halves are separated again while the power is taken. Tables are built by Init, Process does not allocate.
+ */
+class FSpeechRealFft
+{
+public:
+	/** Size is a power of two, at least 4 */
+	void Init(int32 InSize);
+
+	int32 GetSize() const { return Size; }
+
+	/** Writes |X[k]|^2 for k = 0 .. Size / 2 of the Size samples in In */
+	void PowerSpectrum(const float* In, float* OutPower);
+
+private:
+	/** In-place complex FFT of Re and Im, already in bit reversed order */
+	void Transform();
+
+	int32 Size = 0;
+	int32 HalfSize = 0;
+
+	TArray<int32> BitReverse;
+
+	// twiddles of each butterfly stage, the stage with span h starting at h - 1
+	TArray<float> TwiddleRe;
+	TArray<float> TwiddleIm;
+
+	// e^(-2 pi i k / Size), for separating the packed halves
+	TArray<float> SplitRe;
+	TArray<float> SplitIm;
+
+	TArray<float> Re;
+	TArray<float> Im;
+};
+
+/**
+ * Streaming sample rate converter for mono float audio.
+ * Downsampling runs a windowed-sinc low-pass first, evaluated only at the input positions the output needs,
+ * then interpolates linearly between them. History and phase carry over between calls.
+ */
+class FSpeechResampler
+{
+public:
+	void Init(int32 InInputRate, int32 InOutputRate);
+
+	int32 GetInputRate() const { return InputRate; }
+	int32 GetOutputRate() const { return OutputRate; }
+
+	/** Upper bound on the samples Process can produce from NumInput samples */
+	int32 GetMaxOutput(int32 NumInput) const;
+
+	/** Consumes all of In, and writes up to MaxOutput samples to Out. Returns the number written */
+	int32 Process(const float* In, int32 NumInput, float* Out, int32 MaxOutput);
+
+private:
+	/** Filtered value at integer position Index of the working buffer */
+	float FilterAt(int32 Index) const;
+
+	int32 InputRate = 0;
+	int32 OutputRate = 0;
+	double Step = 1.0;
+	double Phase = 0.0;
+
+	// low-pass taps, in reverse order so filtering is a plain dot product over the history
+	TArray<float> Taps;
+
+	// the last Taps.Num() - 1 input samples, followed by the block being processed
+	TArray<float> Work;
+	int32 HistoryNum = 0;
+};
@@ -0,0 +1,164 @@
+#include "SpeechAudioRingBuffer.h"
+#include "HAL/event.h"
+
+FSpeechAudioRingBuffer::FSpeechAudioRingBuffer()
+	: WriteCursor(0)
+	, ReadCursor(0)
+	, OverrunCount(0)
+	, UnderrunCount(0)
+	, DroppedSamples(0)
+	, ReaderEvent(nullptr)
+	, ReaderThreshold(1)
+{
+}
+
+FSpeechAudioRingBuffer::FSpeechAudioRingBuffer(int32 InMinCapacity)
+	: FSpeechAudioRingBuffer()
+{
+	Reset(InMinCapacity);
+}
+
+void FSpeechAudioRingBuffer::Reset(int32 InMinCapacity)
+{
+	// power of two capacity, so cursors wrap with a mask instead of a modulo
+	Capacity = (int32)FMath::RoundUpToPowerOfTwo((uint32)FMath::Max(InMinCapacity, 2));
+	Mask = (uint32)Capacity - 1;
+	Samples.SetNumZeroed(Capacity);
+
+	WriteCursor.store(0, std::memory_order_relaxed);
+	ReadCursor.store(0, std::memory_order_relaxed);
+	OverrunCount.store(0, std::memory_order_relaxed);
+	UnderrunCount.store(0, std::memory_order_relaxed);
+	DroppedSamples.store(0, std::memory_order_relaxed);
+}
+
+int32 FSpeechAudioRingBuffer::Write(const int16* InSamples, int32 NumSamples)
+{
+	if (NumSamples <= 0 || Capacity == 0) {
+		return 0;
+	}
+
+	const uint32 write = WriteCursor.load(std::memory_order_relaxed);
+	const uint32 read = ReadCursor.load(std::memory_order_acquire);
+	const int32 slack = Capacity - (int32)(write - read);
+	const int32 toWrite = FMath::Min(NumSamples, slack);
+
+	if (toWrite < NumSamples) {
+		OverrunCount.fetch_add(1, std::memory_order_relaxed);
+		DroppedSamples.fetch_add(NumSamples - toWrite, std::memory_order_relaxed);
+	}
+
+	if (toWrite > 0) {
+		const int32 start = (int32)(write & Mask);
+		const int32 firstPart = FMath::Min(toWrite, Capacity - start);
+		FMemory::Memcpy(Samples.GetData() + start, InSamples, firstPart * sizeof(int16));
+		FMemory::Memcpy(Samples.GetData(), InSamples + firstPart, (toWrite - firstPart) * sizeof(int16));
+		WriteCursor.store(write + toWrite, std::memory_order_release);
+		NotifyReader(write + toWrite);
+	}
+
+	return toWrite;
+}
+
+int32 FSpeechAudioRingBuffer::BeginWrite(int32 NumSamples, int16*& OutFirst, int32& OutFirstNum, int16*& OutSecond, int32& OutSecondNum)
+{
+	OutFirst = OutSecond = nullptr;
+	OutFirstNum = OutSecondNum = 0;
+	if (NumSamples <= 0 || Capacity == 0) {
+		return 0;
+	}
+
+	const uint32 write = WriteCursor.load(std::memory_order_relaxed);
+	const uint32 read = ReadCursor.load(std::memory_order_acquire);
+	const int32 slack = Capacity - (int32)(write - read);
+	const int32 toWrite = FMath::Min(NumSamples, slack);
+
+	if (toWrite < NumSamples) {
+		OverrunCount.fetch_add(1, std::memory_order_relaxed);
+		DroppedSamples.fetch_add(NumSamples - toWrite, std::memory_order_relaxed);
+	}
+
+	const int32 start = (int32)(write & Mask);
+	OutFirst = Samples.GetData() + start;
+	OutFirstNum = FMath::Min(toWrite, Capacity - start);
+	OutSecond = Samples.GetData();
+	OutSecondNum = toWrite - OutFirstNum;
+	return toWrite;
+}
+
+void FSpeechAudioRingBuffer::EndWrite(int32 NumSamples)
+{
+	if (NumSamples > 0) {
+		const uint32 write = WriteCursor.load(std::memory_order_relaxed) + NumSamples;
+		WriteCursor.store(write, std::memory_order_release);
+		NotifyReader(write);
+	}
+}
+
+void FSpeechAudioRingBuffer::SetReaderEvent(FEvent* InEvent, int32 InThreshold)
+{
+	ReaderThreshold.store(FMath::Max(InThreshold, 1), std::memory_order_relaxed);
+	ReaderEvent.store(InEvent, std::memory_order_release);
+}
+
+void FSpeechAudioRingBuffer::WakeReader()
+{
+	if (FEvent* event = ReaderEvent.load(std::memory_order_acquire)) {
+		event->Trigger();
+	}
+}
+
+void FSpeechAudioRingBuffer::NotifyReader(uint32 InWrite)
+{
+	FEvent* event = ReaderEvent.load(std::memory_order_acquire);
+	if (event != nullptr && (int32)(InWrite - ReadCursor.load(std::memory_order_acquire)) >= ReaderThreshold.load(std::memory_order_relaxed)) {
+		event->Trigger();
+	}
+}
+
+int32 FSpeechAudioRingBuffer::Read(int16* OutSamples, int32 NumSamples)
+{
+	if (NumSamples <= 0 || Capacity == 0) {
+		return 0;
+	}
+
+	const uint32 read = ReadCursor.load(std::memory_order_relaxed);
+	const uint32 write = WriteCursor.load(std::memory_order_acquire);
+	const int32 available = (int32)(write - read);
+
+	if (available == 0) {
+		UnderrunCount.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	const int32 toRead = FMath::Min(NumSamples, available);
+	const int32 start = (int32)(read & Mask);
+	const int32 firstPart = FMath::Min(toRead, Capacity - start);
+	FMemory::Memcpy(OutSamples, Samples.GetData() + start, firstPart * sizeof(int16));
+	FMemory::Memcpy(OutSamples + firstPart, Samples.GetData(), (toRead - firstPart) * sizeof(int16));
+	ReadCursor.store(read + toRead, std::memory_order_release);
+
+	return toRead;
+}
+
+void FSpeechAudioRingBuffer::Flush()
+{
+	ReadCursor.store(WriteCursor.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+int32 FSpeechAudioRingBuffer::Num() const
+{
+	const uint32 read = ReadCursor.load(std::memory_order_acquire);
+	const uint32 write = WriteCursor.load(std::memory_order_acquire);
+	return FMath::Clamp((int32)(write - read), 0, Capacity);
+}
+
+int32 FSpeechAudioRingBuffer::Slack() const
+{
+	return Capacity - Num();
+}
+
+float FSpeechAudioRingBuffer::GetFillLevel() const
+{
+	return Capacity > 0 ? (float)Num() / (float)Capacity : 0.0f;
+}
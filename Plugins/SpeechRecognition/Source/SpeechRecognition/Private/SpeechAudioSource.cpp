@@ -0,0 +1,205 @@
+#include "SpeechAudioSource.h"
+#include "SpeechRecognitionWorker.h"
+#include "HAL/PlatformFileManager.h"
+#include <sphinxbase/bio.h>
+#include <sphinxbase/ckd_alloc.h>
+
+/**************************
+// Device
+**************************/
+FSpeechDeviceAudioSource::FSpeechDeviceAudioSource(const FString& InDeviceName)
+	: DeviceName(InDeviceName)
+{
+}
+
+FSpeechDeviceAudioSource::~FSpeechDeviceAudioSource()
+{
+	Close();
+}
+
+bool FSpeechDeviceAudioSource::Open(int32 SampleRate)
+{
+	Close();
+
+	// attempt to open the recording device
+	const std::string deviceName(TCHAR_TO_ANSI(*DeviceName));
+	if ((Device = ad_open_dev(deviceName.empty() ? nullptr : deviceName.c_str(), SampleRate)) == NULL) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to open audio device"));
+		return false;
+	}
+
+	if (ad_start_rec(Device) < 0) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to start recording"));
+		ad_close(Device);
+		Device = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+void FSpeechDeviceAudioSource::Close()
+{
+	if (Device != nullptr) {
+		ad_stop_rec(Device);
+		ad_close(Device);
+		Device = nullptr;
+	}
+}
+
+int32 FSpeechDeviceAudioSource::Read(int16* OutSamples, int32 MaxSamples)
+{
+	if (Device == nullptr) {
+		return -1;
+	}
+	return ad_read(Device, OutSamples, MaxSamples);
+}
+
+FString FSpeechDeviceAudioSource::GetDescription() const
+{
+	return DeviceName.IsEmpty() ? FString(TEXT("default recording device")) : DeviceName;
+}
+
+/**************************
+// Memory
+**************************/
+FSpeechMemoryAudioSource::FSpeechMemoryAudioSource(int32 InSampleRate, float InPlaybackSpeed)
+	: SampleRateHz(InSampleRate)
+	, PlaybackSpeed(FMath::Max(InPlaybackSpeed, 0.0f))
+{
+}
+
+FSpeechMemoryAudioSource::FSpeechMemoryAudioSource(TArray<int16>&& InSamples, int32 InSampleRate, float InPlaybackSpeed)
+	: FSpeechMemoryAudioSource(InSampleRate, InPlaybackSpeed)
+{
+	Samples = MoveTemp(InSamples);
+}
+
+FSpeechMemoryAudioSource::FSpeechMemoryAudioSource(const int16* InSamples, int32 NumSamples, int32 InSampleRate, float InPlaybackSpeed)
+	: FSpeechMemoryAudioSource(InSampleRate, InPlaybackSpeed)
+{
+	Samples.Append(InSamples, NumSamples);
+}
+
+bool FSpeechMemoryAudioSource::Open(int32 SampleRate)
+{
+	if (SampleRateHz != SampleRate) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("%s is %d Hz, but the decoder expects %d Hz"), *GetDescription(), SampleRateHz, SampleRate);
+		return false;
+	}
+	Position = 0;
+	return true;
+}
+
+int32 FSpeechMemoryAudioSource::Read(int16* OutSamples, int32 MaxSamples)
+{
+	const int32 toCopy = FMath::Min(MaxSamples, Samples.Num() - Position);
+	if (toCopy <= 0) {
+		return 0;
+	}
+	FMemory::Memcpy(OutSamples, Samples.GetData() + Position, toCopy * sizeof(int16));
+	Position += toCopy;
+	return toCopy;
+}
+
+FString FSpeechMemoryAudioSource::GetDescription() const
+{
+	return FString::Printf(TEXT("memory buffer (%d samples)"), Samples.Num());
+}
+
+/**************************
+// File
+**************************/
+FSpeechFileAudioSource::FSpeechFileAudioSource(const FString& InFilePath, float InPlaybackSpeed)
+	: FSpeechMemoryAudioSource(0, InPlaybackSpeed)
+	, FilePath(FPaths::ConvertRelativePathToFull(InFilePath))
+{
+}
+
+bool FSpeechFileAudioSource::ValidateWavHeader(int32 SampleRate, int32& OutHeaderSize) const
+{
+	TUniquePtr<IFileHandle> file(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*FilePath));
+	uint8 header[12];
+	if (!file.IsValid() || !file->Read(header, sizeof(header))
+		|| FMemory::Memcmp(header, "RIFF", 4) != 0 || FMemory::Memcmp(header + 8, "WAVE", 4) != 0) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("%s is not a RIFF/WAVE file"), *FilePath);
+		return false;
+	}
+
+	// walk the chunks, until we find the sample data
+	bool formatOk = false;
+	uint8 chunkHeader[8];
+	while (file->Read(chunkHeader, sizeof(chunkHeader))) {
+		const uint32 chunkSize = chunkHeader[4] | (chunkHeader[5] << 8) | (chunkHeader[6] << 16) | ((uint32)chunkHeader[7] << 24);
+
+		if (FMemory::Memcmp(chunkHeader, "fmt ", 4) == 0) {
+			uint8 format[16];
+			if (chunkSize < sizeof(format) || !file->Read(format, sizeof(format))) {
+				break;
+			}
+			const uint16 formatTag = format[0] | (format[1] << 8);
+			const uint16 channels = format[2] | (format[3] << 8);
+			const uint32 rate = format[4] | (format[5] << 8) | (format[6] << 16) | ((uint32)format[7] << 24);
+			const uint16 bits = format[14] | (format[15] << 8);
+			if (formatTag != 1 || channels != 1 || bits != 16 || (int32)rate != SampleRate) {
+				UE_LOG(SpeechRecognitionPlugin, Log, TEXT("%s must be 16-bit mono PCM at %d Hz (format %d, %d channels, %d bits, %d Hz)"),
+					*FilePath, SampleRate, formatTag, channels, bits, rate);
+				return false;
+			}
+			formatOk = true;
+			file->Seek(file->Tell() + (chunkSize - sizeof(format)) + (chunkSize & 1));
+			continue;
+		}
+
+		if (FMemory::Memcmp(chunkHeader, "data", 4) == 0) {
+			OutHeaderSize = (int32)file->Tell();
+			return formatOk;
+		}
+
+		// skip chunks we do not care about, which are padded to an even size
+		file->Seek(file->Tell() + chunkSize + (chunkSize & 1));
+	}
+
+	UE_LOG(SpeechRecognitionPlugin, Log, TEXT("%s has no usable sample data"), *FilePath);
+	return false;
+}
+
+bool FSpeechFileAudioSource::Open(int32 SampleRate)
+{
+	Close();
+
+	// headerless PCM is assumed to already be at the decoder's sample rate
+	int32 headerSize = 0;
+	const FString extension = FPaths::GetExtension(FilePath, true);
+	if (extension.Equals(TEXT(".wav"), ESearchCase::IgnoreCase) && !ValidateWavHeader(SampleRate, headerSize)) {
+		return false;
+	}
+
+	const std::string directory(TCHAR_TO_UTF8(*FPaths::GetPath(FilePath)));
+	const std::string fileName(TCHAR_TO_UTF8(*FPaths::GetCleanFilename(FilePath)));
+	const std::string extensionStr(TCHAR_TO_UTF8(*extension));
+	size_t numSamples = 0;
+	int16* data = bio_read_wavfile(directory.c_str(), fileName.c_str(), extensionStr.c_str(), headerSize, 0, &numSamples);
+	if (data == nullptr) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to read %s"), *FilePath);
+		return false;
+	}
+
+	Samples.SetNumUninitialized((int32)numSamples);
+	FMemory::Memcpy(Samples.GetData(), data, numSamples * sizeof(int16));
+	ckd_free(data);
+
+	SampleRateHz = SampleRate;
+	return FSpeechMemoryAudioSource::Open(SampleRate);
+}
+
+void FSpeechFileAudioSource::Close()
+{
+	Samples.Empty();
+	Position = 0;
+}
+
+FString FSpeechFileAudioSource::GetDescription() const
+{
+	return FilePath;
+}
@@ -0,0 +1,476 @@
+#include "SpeechBatchTranscriber.h"
+#include "SpeechRecognitionWorker.h"
+#include "SpeechAudioSource.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/Paths.h"
+
+//Folder of a language's model, under Content/model
+static const TCHAR* GetLanguageFolder(ESpeechRecognitionLanguage Language)
+{
+	switch (Language) {
+	case ESpeechRecognitionLanguage::VE_Chinese:
+		return TEXT("zn");
+	case ESpeechRecognitionLanguage::VE_French:
+		return TEXT("fr");
+	case ESpeechRecognitionLanguage::VE_Spanish:
+		return TEXT("es");
+	case ESpeechRecognitionLanguage::VE_Russian:
+		return TEXT("ru");
+	default:
+		return TEXT("en");
+	}
+}
+
+//Content/model/<lang>, which holds the acoustic model folder, the dictionary, language models and grammars
+static FString GetModelDir(ESpeechRecognitionLanguage Language)
+{
+	return FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir()) / TEXT("model") / GetLanguageFolder(Language);
+}
+
+//Rough size of one decoder, from the files it loads: the acoustic model as it is on disk, the dictionary three times
+//over for its parsed entries and hash tables, and a language model twice over for its trigram tables
+static int64 EstimateDecoderBytes(const FSpeechBatchSettings& Settings)
+{
+	IFileManager& fileManager = IFileManager::Get();
+	const FString language = GetLanguageFolder(Settings.Language);
+	const FString modelDir = GetModelDir(Settings.Language);
+
+	int64 bytes = 0;
+	TArray<FString> modelFiles;
+	fileManager.FindFilesRecursive(modelFiles, *(modelDir / language), TEXT("*"), true, false);
+	for (const FString& file : modelFiles) {
+		bytes += FMath::Max(fileManager.FileSize(*file), (int64)0);
+	}
+	bytes += 3 * FMath::Max(fileManager.FileSize(*(modelDir / language + TEXT(".dict"))), (int64)0);
+	if (Settings.Search.StartsWith(TEXT("lm:"))) {
+		bytes += 2 * FMath::Max(fileManager.FileSize(*(modelDir / TEXT("language_models") / Settings.Search.Mid(3) + TEXT(".lm"))), (int64)0);
+	}
+	return bytes;
+}
+
+/**************************
+// Decode thread
+**************************/
+
+/** One decoder of the pool, and the thread it runs on */
+class FSpeechBatchDecodeThread : public FRunnable
+{
+public:
+	FSpeechBatchDecodeThread(FSpeechBatchTranscriber& InOwner, int32 InIndex)
+		: Owner(InOwner)
+		, Index(InIndex)
+	{
+	}
+
+	virtual ~FSpeechBatchDecodeThread() override
+	{
+		Wait();
+	}
+
+	bool Start()
+	{
+		const FString threadName = FString::Printf(TEXT("FSpeechBatchDecodeThread:%d"), Index);
+		Thread = FRunnableThread::Create(this, *threadName, 0U, TPri_Normal);
+		return Thread != nullptr;
+	}
+
+	void Wait()
+	{
+		if (Thread != nullptr) {
+			Thread->WaitForCompletion();
+			delete Thread;
+			Thread = nullptr;
+		}
+	}
+
+	//FRunnable interface
+	virtual uint32 Run() override;
+
+private:
+	//Creates this thread's decoder, with the batch's search selected
+	bool CreateDecoder();
+	void FreeDecoder();
+	void Transcribe(int32 ItemIndex, FSpeechBatchResult& OutResult);
+	//Adds the words of the utterance that just ended
+	void CollectUtterance(FSpeechBatchResult& OutResult);
+
+	FSpeechBatchTranscriber& Owner;
+	int32 Index;
+	FRunnableThread* Thread = nullptr;
+
+	cmd_ln_t* Config = nullptr;
+	ps_decoder_t* Decoder = nullptr;
+	int32 SampleRate = 16000;
+	float FrameRate = 100.0f;
+	int16 Buffer[4096];
+};
+
+bool FSpeechBatchDecodeThread::CreateDecoder()
+{
+	const FSpeechBatchSettings& settings = Owner.Settings;
+	const FString language = GetLanguageFolder(settings.Language);
+	const FString modelDir = GetModelDir(settings.Language);
+	const std::string modelPath(TCHAR_TO_UTF8(*(modelDir / language)));
+	const std::string dictionaryPath(TCHAR_TO_UTF8(*(modelDir / language + TEXT(".dict"))));
+
+	Config = cmd_ln_init(NULL, ps_args(), 1,
+		"-hmm", modelPath.c_str(),
+		"-dict", dictionaryPath.c_str(),
+		NULL);
+	if (Config == NULL) {
+		return false;
+	}
+
+	// the extra switches, parsed as if from a command line
+	if (settings.Params.Num() > 0) {
+		std::vector<std::string> args;
+		for (const TPair<FString, FString>& param : settings.Params) {
+			args.push_back(TCHAR_TO_UTF8(*param.Key));
+			args.push_back(TCHAR_TO_UTF8(*param.Value));
+		}
+		std::vector<char*> argv;
+		for (std::string& arg : args) {
+			argv.push_back(&arg[0]);
+		}
+		cmd_ln_t* parsed = cmd_ln_parse_r(Config, ps_args(), (int32)argv.size(), argv.data(), 1);
+		if (parsed == NULL) {
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Batch decoder %d: invalid decoder params"), Index);
+			return false;
+		}
+		Config = parsed;
+	}
+
+	Decoder = ps_init(Config);
+	if (Decoder == NULL) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Batch decoder %d: failed to create the decoder"), Index);
+		return false;
+	}
+	SampleRate = (int32)cmd_ln_float32_r(Config, "-samprate");
+	FrameRate = (float)cmd_ln_int32_r(Config, "-frate");
+
+	// no search named uses whatever the params set up (-lm, -jsgf, -kws...)
+	if (settings.Search.IsEmpty()) {
+		return true;
+	}
+	const std::string search(TCHAR_TO_UTF8(*settings.Search));
+	int result = -1;
+	if (search.rfind("lm:", 0) == 0) {
+		const FString path = modelDir / TEXT("language_models") / settings.Search.Mid(3) + TEXT(".lm");
+		result = ps_set_lm_file(Decoder, search.c_str(), TCHAR_TO_UTF8(*path));
+	}
+	else if (search.rfind("grammar:", 0) == 0) {
+		const FString path = modelDir / TEXT("grammars") / settings.Search.Mid(8) + TEXT(".gram");
+		result = ps_set_jsgf_file(Decoder, search.c_str(), TCHAR_TO_UTF8(*path));
+	}
+	if (result < 0 || ps_set_search(Decoder, search.c_str()) < 0) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Batch decoder %d: failed to register search %s"), Index, *settings.Search);
+		return false;
+	}
+	return true;
+}
+
+void FSpeechBatchDecodeThread::FreeDecoder()
+{
+	if (Decoder != NULL) {
+		ps_free(Decoder);
+		Decoder = NULL;
+	}
+	if (Config != NULL) {
+		cmd_ln_free_r(Config);
+		Config = NULL;
+	}
+}
+
+uint32 FSpeechBatchDecodeThread::Run()
+{
+	// without a decoder, the recordings are still taken, so each gets its failed result
+	if (!CreateDecoder()) {
+		FreeDecoder();
+	}
+
+	int32 item;
+	while ((item = Owner.TakeItem(Index)) != INDEX_NONE) {
+		FSpeechBatchResult result;
+		Transcribe(item, result);
+		Owner.ReportResult(result);
+	}
+
+	FreeDecoder();
+	Owner.DecoderFinished();
+	return 0;
+}
+
+void FSpeechBatchDecodeThread::Transcribe(int32 ItemIndex, FSpeechBatchResult& OutResult)
+{
+	const FSpeechBatchTranscriber::FItem& item = Owner.Items[ItemIndex];
+	OutResult.Index = ItemIndex;
+	OutResult.Source = item.Source->GetDescription();
+	OutResult.Decoder = Index;
+	if (Owner.bCancelled || Decoder == NULL || !item.Source->Open(SampleRate)) {
+		return;
+	}
+
+	// a new stream per recording, so word times count from its start
+	const double startTime = FPlatformTime::Seconds();
+	if (ps_start_stream(Decoder) < 0 || ps_start_utt(Decoder) < 0) {
+		item.Source->Close();
+		return;
+	}
+
+	// the decoder's VAD splits the recording into utterances, which keeps each search small
+	int64 numSamples = 0;
+	bool inUtterance = false;
+	int32 numRead;
+	while (!Owner.bCancelled && (numRead = item.Source->Read(Buffer, UE_ARRAY_COUNT(Buffer))) > 0) {
+		ps_process_raw(Decoder, Buffer, numRead, 0, 0);
+		numSamples += numRead;
+
+		if (ps_get_in_speech(Decoder)) {
+			inUtterance = true;
+		}
+		else if (inUtterance) {
+			ps_end_utt(Decoder);
+			CollectUtterance(OutResult);
+			ps_start_utt(Decoder);
+			inUtterance = false;
+		}
+	}
+	ps_end_utt(Decoder);
+	if (inUtterance) {
+		CollectUtterance(OutResult);
+	}
+	item.Source->Close();
+
+	OutResult.AudioSeconds = (double)numSamples / SampleRate;
+	OutResult.DecodeSeconds = FPlatformTime::Seconds() - startTime;
+	OutResult.bSuccess = !Owner.bCancelled;
+}
+
+void FSpeechBatchDecodeThread::CollectUtterance(FSpeechBatchResult& OutResult)
+{
+	FSpeechBatchUtterance utterance;
+	for (ps_seg_t* iter = ps_seg_iter(Decoder); iter != NULL; iter = ps_seg_next(iter)) {
+		const char* word = ps_seg_word(iter);
+
+		// silence, sentence markers and noise words are not something that was said
+		if (word[0] == '<' || word[0] == '[' || word[0] == '+') {
+			continue;
+		}
+
+		// the variant suffix becomes the variant number
+		int32 length = (int32)strlen(word);
+		int32 variant = 1;
+		if (length > 3 && word[length - 1] == ')') {
+			int32 open = length - 2;
+			while (open > 0 && word[open] >= '0' && word[open] <= '9') {
+				open--;
+			}
+			if (word[open] == '(' && open < length - 2) {
+				variant = atoi(word + open + 1);
+				length = open;
+			}
+		}
+
+		// frames count from the start of the stream
+		int32 sf, ef;
+		ps_seg_frames(iter, &sf, &ef);
+		FRecognisedWord& record = utterance.Words.AddDefaulted_GetRef();
+		const FUTF8ToTCHAR converted(word, length);
+		record.Word = FString(converted.Length(), converted.Get());
+		record.Variant = variant;
+		record.StartTime = (float)sf / FrameRate;
+		record.EndTime = (float)(ef + 1) / FrameRate;
+
+		if (!utterance.Text.IsEmpty()) {
+			utterance.Text += TEXT(" ");
+		}
+		utterance.Text.Append(converted.Get(), converted.Length());
+	}
+
+	if (utterance.Words.Num() > 0) {
+		utterance.StartTime = utterance.Words[0].StartTime;
+		utterance.EndTime = utterance.Words.Last().EndTime;
+		OutResult.Utterances.Add(MoveTemp(utterance));
+	}
+}
+
+/**************************
+// Transcriber
+**************************/
+FSpeechBatchTranscriber::FSpeechBatchTranscriber(const FSpeechBatchSettings& InSettings)
+	: Settings(InSettings)
+{
+}
+
+FSpeechBatchTranscriber::~FSpeechBatchTranscriber()
+{
+	Cancel();
+	Wait();
+}
+
+int32 FSpeechBatchTranscriber::AddFile(const FString& FilePath)
+{
+	const int64 fileSize = IFileManager::Get().FileSize(*FilePath);
+	return AddSource(MakeShared<FSpeechFileAudioSource>(FilePath), FMath::Max<int64>(fileSize, 0) / (int64)sizeof(int16));
+}
+
+int32 FSpeechBatchTranscriber::AddSamples(TArray<int16>&& Samples, int32 SampleRate)
+{
+	const int64 numSamples = Samples.Num();
+	return AddSource(MakeShared<FSpeechMemoryAudioSource>(MoveTemp(Samples), SampleRate), numSamples);
+}
+
+int32 FSpeechBatchTranscriber::AddSource(const TSharedRef<ISpeechAudioSource>& Source, int64 NumSamples)
+{
+	if (bStarted) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The batch has started, %s was not added"), *Source->GetDescription());
+		return INDEX_NONE;
+	}
+	return Items.Add({ Source, NumSamples });
+}
+
+bool FSpeechBatchTranscriber::Start(TFunction<void(const FSpeechBatchResult&)> InOnResult, TFunction<void()> InOnFinished)
+{
+	if (bStarted) {
+		return false;
+	}
+	bStarted = true;
+	OnResult = MoveTemp(InOnResult);
+	OnFinished = MoveTemp(InOnFinished);
+	StartTime = FPlatformTime::Seconds();
+
+	if (Items.Num() == 0) {
+		if (OnFinished) {
+			OnFinished();
+		}
+		return true;
+	}
+
+	// one decoder per core, as many as fit in three quarters of the free memory, and never more than there are recordings.
+	// Each has its own copy of the model, so on a many-core box memory runs out before cores do
+	int32 numDecoders = Settings.NumDecoders;
+	if (numDecoders <= 0) {
+		numDecoders = FPlatformMisc::NumberOfCores();
+		const int64 decoderBytes = EstimateDecoderBytes(Settings);
+		const int64 budgetBytes = (int64)(FPlatformMemory::GetStats().AvailablePhysical * 3 / 4);
+		if (decoderBytes > 0 && budgetBytes / decoderBytes < numDecoders) {
+			numDecoders = (int32)FMath::Max(budgetBytes / decoderBytes, (int64)1);
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Running %d decoders instead of one per core: each needs about %.0f MB, and %.0f MB are free"),
+				numDecoders, decoderBytes / (1024.0 * 1024.0), FPlatformMemory::GetStats().AvailablePhysical / (1024.0 * 1024.0));
+		}
+	}
+	numDecoders = FMath::Min(numDecoders, Items.Num());
+
+	// dealt out largest first, so the long recordings start early and the short ones fill in around them
+	TArray<int32> order;
+	order.SetNumUninitialized(Items.Num());
+	for (int32 i = 0; i < order.Num(); i++) {
+		order[i] = i;
+	}
+	order.StableSort([this](int32 a, int32 b) { return Items[a].NumSamples > Items[b].NumSamples; });
+	for (int32 i = 0; i < numDecoders; i++) {
+		Queues.Add(MakeUnique<FWorkQueue>());
+	}
+	for (int32 i = 0; i < order.Num(); i++) {
+		FWorkQueue& queue = *Queues[i % numDecoders];
+		queue.Items.Add(order[i]);
+		queue.NumSamples += Items[order[i]].NumSamples;
+	}
+
+	// a decoder that fails to start leaves its queue to be stolen by the others
+	NumRunning = numDecoders;
+	for (int32 i = 0; i < numDecoders; i++) {
+		TUniquePtr<FSpeechBatchDecodeThread>& thread = Threads.Add_GetRef(MakeUnique<FSpeechBatchDecodeThread>(*this, i));
+		if (!thread->Start()) {
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to start batch decoder %d"), i);
+			DecoderFinished();
+		}
+	}
+	UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Transcribing %d recordings on %d decoders"), Items.Num(), numDecoders);
+	return true;
+}
+
+void FSpeechBatchTranscriber::Cancel()
+{
+	bCancelled = true;
+}
+
+void FSpeechBatchTranscriber::Wait()
+{
+	for (TUniquePtr<FSpeechBatchDecodeThread>& thread : Threads) {
+		thread->Wait();
+	}
+}
+
+int32 FSpeechBatchTranscriber::PopFront(FWorkQueue& Queue)
+{
+	FScopeLock lock(&Queue.Lock);
+	if (Queue.Items.Num() == 0) {
+		return INDEX_NONE;
+	}
+	const int32 item = Queue.Items[0];
+	Queue.Items.RemoveAt(0, 1, EAllowShrinking::No);
+	Queue.NumSamples -= Items[item].NumSamples;
+	return item;
+}
+
+int32 FSpeechBatchTranscriber::TakeItem(int32 Decoder)
+{
+	int32 item = PopFront(*Queues[Decoder]);
+	while (item == INDEX_NONE) {
+		// steal from whichever decoder has the most audio left
+		FWorkQueue* victim = nullptr;
+		int64 mostSamples = -1;
+		for (const TUniquePtr<FWorkQueue>& queue : Queues) {
+			FScopeLock lock(&queue->Lock);
+			if (queue->Items.Num() > 0 && queue->NumSamples > mostSamples) {
+				victim = queue.Get();
+				mostSamples = queue->NumSamples;
+			}
+		}
+		if (victim == nullptr) {
+			return INDEX_NONE;
+		}
+		item = PopFront(*victim);
+	}
+	return item;
+}
+
+void FSpeechBatchTranscriber::ReportResult(const FSpeechBatchResult& Result)
+{
+	FScopeLock lock(&ResultLock);
+	TotalAudioSeconds += Result.AudioSeconds;
+	NumCompleted++;
+	if (!Result.bSuccess) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to transcribe %s"), *Result.Source);
+	}
+	if (OnResult) {
+		OnResult(Result);
+	}
+}
+
+void FSpeechBatchTranscriber::DecoderFinished()
+{
+	if (--NumRunning > 0) {
+		return;
+	}
+
+	// decoders that never started leave recordings behind, which still get their result
+	int32 item;
+	while ((item = TakeItem(0)) != INDEX_NONE) {
+		FSpeechBatchResult result;
+		result.Index = item;
+		result.Source = Items[item].Source->GetDescription();
+		ReportResult(result);
+	}
+
+	FScopeLock lock(&ResultLock);
+	const double wallSeconds = FPlatformTime::Seconds() - StartTime;
+	UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Transcribed %d recordings, %.1f s of audio in %.1f s on %d decoders (%.1fx real time)"),
+		NumCompleted.load(), TotalAudioSeconds, wallSeconds, Queues.Num(), wallSeconds > 0.0 ? TotalAudioSeconds / wallSeconds : 0.0);
+	if (OnFinished) {
+		OnFinished();
+	}
+}
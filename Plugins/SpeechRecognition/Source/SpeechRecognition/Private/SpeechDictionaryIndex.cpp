@@ -0,0 +1,291 @@
+#include "SpeechDictionaryIndex.h"
+#include "SpeechRecognitionWorker.h"
+#include "Algo/StableSort.h"
+#include "HAL/FileManager.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+FSpeechDictionaryIndex::~FSpeechDictionaryIndex()
+{
+	Close();
+}
+
+bool FSpeechDictionaryIndex::Open(const FString& InDictionaryPath)
+{
+	Close();
+
+	IFileManager& fileManager = IFileManager::Get();
+	const int64 dictionarySize = fileManager.FileSize(*InDictionaryPath);
+	if (dictionarySize < 0) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Dictionary %s not found"), *InDictionaryPath);
+		return false;
+	}
+	const int64 dictionaryTimestamp = fileManager.GetTimeStamp(*InDictionaryPath).GetTicks();
+
+	// use the existing index if it was built from this version of the dictionary
+	const FString indexPath = GetIndexPath(InDictionaryPath);
+	if (!Map(indexPath, dictionarySize, dictionaryTimestamp)) {
+		const double startTime = FPlatformTime::Seconds();
+		if (!Build(InDictionaryPath, indexPath, dictionarySize, dictionaryTimestamp) || !Map(indexPath, dictionarySize, dictionaryTimestamp)) {
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to build the dictionary index for %s"), *InDictionaryPath);
+			return false;
+		}
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Built the dictionary index for %s in %.1f ms"), *InDictionaryPath, (FPlatformTime::Seconds() - startTime) * 1000.0);
+	}
+
+	DictionaryPath = InDictionaryPath;
+	return true;
+}
+
+void FSpeechDictionaryIndex::Close()
+{
+	if (Mapping != nullptr) {
+		mmio_file_unmap(Mapping);
+	}
+	Mapping = nullptr;
+	Header = nullptr;
+	Words = nullptr;
+	Entries = nullptr;
+	Strings = nullptr;
+	DictionaryPath.Empty();
+}
+
+bool FSpeechDictionaryIndex::IsUpToDate() const
+{
+	if (!IsOpen()) {
+		return false;
+	}
+	IFileManager& fileManager = IFileManager::Get();
+	return fileManager.FileSize(*DictionaryPath) == Header->DictionarySize
+		&& fileManager.GetTimeStamp(*DictionaryPath).GetTicks() == Header->DictionaryTimestamp;
+}
+
+int32 FSpeechDictionaryIndex::FindWord(const char* Word, int32 Length) const
+{
+	if (!IsOpen()) {
+		return INDEX_NONE;
+	}
+
+	// words are sorted bytewise, so this matches strcmp ordering
+	int32 lo = 0;
+	int32 hi = (int32)Header->NumWords - 1;
+	while (lo <= hi) {
+		const int32 mid = lo + (hi - lo) / 2;
+		const char* name = Strings + Words[mid].Name;
+		int32 cmp = strncmp(name, Word, Length);
+		if (cmp == 0 && name[Length] != '\0') {
+			cmp = 1;
+		}
+		if (cmp == 0) {
+			return mid;
+		}
+		if (cmp < 0) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid - 1;
+		}
+	}
+	return INDEX_NONE;
+}
+
+const char* FSpeechDictionaryIndex::GetWord(int32 WordIndex) const
+{
+	return Strings + Words[WordIndex].Name;
+}
+
+int32 FSpeechDictionaryIndex::GetNumVariants(int32 WordIndex) const
+{
+	return (int32)Words[WordIndex].NumEntries;
+}
+
+const char* FSpeechDictionaryIndex::GetVariant(int32 WordIndex, int32 VariantIndex) const
+{
+	return Strings + Entries[Words[WordIndex].FirstEntry + VariantIndex].Variant;
+}
+
+const char* FSpeechDictionaryIndex::GetPhones(int32 WordIndex, int32 VariantIndex) const
+{
+	return Strings + Entries[Words[WordIndex].FirstEntry + VariantIndex].Phones;
+}
+
+bool FSpeechDictionaryIndex::HasVariant(int32 WordIndex, const char* Variant) const
+{
+	const int32 numVariants = GetNumVariants(WordIndex);
+	for (int32 i = 0; i < numVariants; i++) {
+		if (strcmp(GetVariant(WordIndex, i), Variant) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FSpeechDictionaryIndex::Contains(const char* Word) const
+{
+	const int32 length = (int32)strlen(Word);
+	const char* bracket = length > 0 && Word[length - 1] == ')' ? strchr(Word, '(') : nullptr;
+	const int32 wordIndex = FindWord(Word, bracket != nullptr ? (int32)(bracket - Word) : length);
+	return wordIndex != INDEX_NONE && (bracket == nullptr || HasVariant(wordIndex, Word));
+}
+
+FString FSpeechDictionaryIndex::GetIndexPath(const FString& InDictionaryPath)
+{
+	const FString fullPath = FPaths::ConvertRelativePathToFull(InDictionaryPath);
+	return FPaths::ProjectSavedDir() / TEXT("SpeechRecognition") / TEXT("DictionaryIndex")
+		/ FString::Printf(TEXT("%s_%08x.sdix"), *FPaths::GetBaseFilename(InDictionaryPath), FCrc::StrCrc32(*fullPath));
+}
+
+bool FSpeechDictionaryIndex::Build(const FString& InDictionaryPath, const FString& IndexPath, int64 DictionarySize, int64 DictionaryTimestamp)
+{
+	TArray<uint8> text;
+	if (!FFileHelper::LoadFileToArray(text, *InDictionaryPath)) {
+		return false;
+	}
+
+	// each line is "word phones", where word may carry a (n) variant suffix
+	struct FLine
+	{
+		const char* Base;
+		int32 BaseLen;
+		const char* Variant;
+		int32 VariantLen;
+		const char* Phones;
+		int32 PhonesLen;
+	};
+	TArray<FLine> lines;
+	lines.Reserve(text.Num() / 16);
+
+	const char* cursor = (const char*)text.GetData();
+	const char* end = cursor + text.Num();
+	while (cursor < end) {
+		const char* lineEnd = (const char*)FMemory::Memchr(cursor, '\n', end - cursor);
+		if (lineEnd == nullptr) {
+			lineEnd = end;
+		}
+		const char* next = lineEnd + 1;
+		while (lineEnd > cursor && (lineEnd[-1] == '\r' || lineEnd[-1] == ' ' || lineEnd[-1] == '\t')) {
+			lineEnd--;
+		}
+
+		const char* wordEnd = cursor;
+		while (wordEnd < lineEnd && *wordEnd != ' ' && *wordEnd != '\t') {
+			wordEnd++;
+		}
+		const char* phones = wordEnd;
+		while (phones < lineEnd && (*phones == ' ' || *phones == '\t')) {
+			phones++;
+		}
+
+		if (wordEnd > cursor) {
+			FLine line;
+			line.Variant = cursor;
+			line.VariantLen = (int32)(wordEnd - cursor);
+			line.Base = cursor;
+			line.BaseLen = line.VariantLen;
+			if (wordEnd[-1] == ')') {
+				const char* bracket = (const char*)FMemory::Memchr(cursor, '(', wordEnd - cursor);
+				if (bracket != nullptr && bracket > cursor) {
+					line.BaseLen = (int32)(bracket - cursor);
+				}
+			}
+			line.Phones = phones;
+			line.PhonesLen = (int32)(lineEnd - phones);
+			lines.Add(line);
+		}
+		cursor = next;
+	}
+
+	// group variants under their base word, keeping the dictionary's order within a word
+	Algo::StableSort(lines, [](const FLine& a, const FLine& b)
+	{
+		const int32 cmp = FMemory::Memcmp(a.Base, b.Base, FMath::Min(a.BaseLen, b.BaseLen));
+		return cmp != 0 ? cmp < 0 : a.BaseLen < b.BaseLen;
+	});
+
+	TArray<FWordRecord> words;
+	TArray<FEntryRecord> entries;
+	TArray<char> strings;
+	entries.Reserve(lines.Num());
+	strings.Reserve(text.Num() + lines.Num() * 2);
+
+	auto addString = [&strings](const char* str, int32 len)
+	{
+		const uint32 offset = (uint32)strings.Num();
+		strings.Append(str, len);
+		strings.Add('\0');
+		return offset;
+	};
+
+	for (int32 i = 0; i < lines.Num(); i++) {
+		const FLine& line = lines[i];
+		const bool bNewWord = i == 0 || lines[i - 1].BaseLen != line.BaseLen || FMemory::Memcmp(lines[i - 1].Base, line.Base, line.BaseLen) != 0;
+		if (bNewWord) {
+			FWordRecord& word = words.AddDefaulted_GetRef();
+			word.Name = addString(line.Base, line.BaseLen);
+			word.FirstEntry = (uint32)entries.Num();
+			word.NumEntries = 0;
+		}
+
+		FEntryRecord& entry = entries.AddDefaulted_GetRef();
+		entry.Variant = line.VariantLen == line.BaseLen ? words.Last().Name : addString(line.Variant, line.VariantLen);
+		entry.Phones = addString(line.Phones, line.PhonesLen);
+		words.Last().NumEntries++;
+	}
+
+	FHeader header;
+	header.Magic = IndexMagic;
+	header.Version = IndexVersion;
+	header.DictionarySize = DictionarySize;
+	header.DictionaryTimestamp = DictionaryTimestamp;
+	header.NumWords = (uint32)words.Num();
+	header.NumEntries = (uint32)entries.Num();
+	header.StringBytes = (uint32)strings.Num();
+	header.Reserved = 0;
+
+	TArray<uint8> data;
+	data.Reserve(sizeof(FHeader) + words.Num() * sizeof(FWordRecord) + entries.Num() * sizeof(FEntryRecord) + strings.Num());
+	data.Append((const uint8*)&header, sizeof(FHeader));
+	data.Append((const uint8*)words.GetData(), words.Num() * sizeof(FWordRecord));
+	data.Append((const uint8*)entries.GetData(), entries.Num() * sizeof(FEntryRecord));
+	data.Append((const uint8*)strings.GetData(), strings.Num());
+
+	// write through a temporary file, so another instance never maps half an index
+	IFileManager& fileManager = IFileManager::Get();
+	const FString tempPath = IndexPath + TEXT(".tmp");
+	if (!FFileHelper::SaveArrayToFile(data, *tempPath)) {
+		return false;
+	}
+	return fileManager.Move(*IndexPath, *tempPath, true, true);
+}
+
+bool FSpeechDictionaryIndex::Map(const FString& IndexPath, int64 DictionarySize, int64 DictionaryTimestamp)
+{
+	const int64 fileSize = IFileManager::Get().FileSize(*IndexPath);
+	if (fileSize < (int64)sizeof(FHeader)) {
+		return false;
+	}
+
+	mmio_file_t* mapping = mmio_file_read(FTCHARToUTF8(*IndexPath).Get());
+	if (mapping == nullptr) {
+		return false;
+	}
+
+	const uint8* base = (const uint8*)mmio_file_ptr(mapping);
+	const FHeader* header = (const FHeader*)base;
+	const int64 expectedSize = (int64)sizeof(FHeader) + (int64)header->NumWords * sizeof(FWordRecord)
+		+ (int64)header->NumEntries * sizeof(FEntryRecord) + header->StringBytes;
+	if (header->Magic != IndexMagic || header->Version != IndexVersion
+		|| header->DictionarySize != DictionarySize || header->DictionaryTimestamp != DictionaryTimestamp
+		|| expectedSize != fileSize) {
+		mmio_file_unmap(mapping);
+		return false;
+	}
+
+	Mapping = mapping;
+	Header = header;
+	Words = (const FWordRecord*)(base + sizeof(FHeader));
+	Entries = (const FEntryRecord*)(Words + header->NumWords);
+	Strings = (const char*)(Entries + header->NumEntries);
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <sphinxbase/mmio.h>
+
+#include "CoreMinimal.h"
+
+/**
+ * Read-only, memory-mapped index over a pocketsphinx pronunciation dictionary.
+ *
+ * The index is built from the .dict once, and stored next to the other generated files under Saved/SpeechRecognition.
+ * It holds the base words sorted by name, each with its pronunciation variants (word, word(2), ...) and their phones,
+ * as offsets into a single string block. Opening it is an mmio_file_read; lookups are a binary search, and hand out
+ * pointers straight into the mapping. The .dict's size and timestamp are stored in the header, and the index is rebuilt
+ * when they no longer match.
+ */
+class FSpeechDictionaryIndex
+{
+public:
+	FSpeechDictionaryIndex() {}
+	~FSpeechDictionaryIndex();
+
+	FSpeechDictionaryIndex(const FSpeechDictionaryIndex&) = delete;
+	FSpeechDictionaryIndex& operator=(const FSpeechDictionaryIndex&) = delete;
+
+	/** Maps the index for DictionaryPath, building it first if it is missing or out of date */
+	bool Open(const FString& DictionaryPath);
+	void Close();
+
+	bool IsOpen() const { return Mapping != nullptr; }
+
+	/** True while the .dict still has the size and timestamp the mapped index was built from */
+	bool IsUpToDate() const;
+	const FString& GetDictionaryPath() const { return DictionaryPath; }
+
+	/** Number of base words */
+	int32 Num() const { return IsOpen() ? (int32)Header->NumWords : 0; }
+
+	/** Number of pronunciations, across every base word */
+	int32 NumEntries() const { return IsOpen() ? (int32)Header->NumEntries : 0; }
+
+	/** Size of the .dict the index was built from, in bytes */
+	int64 GetDictionarySize() const { return IsOpen() ? Header->DictionarySize : 0; }
+
+	/** Index of a base word, without any (n) suffix, or INDEX_NONE */
+	int32 FindWord(const char* Word, int32 Length) const;
+	int32 FindWord(const char* Word) const { return FindWord(Word, (int32)strlen(Word)); }
+
+	const char* GetWord(int32 WordIndex) const;
+
+	/** Number of pronunciations of a base word */
+	int32 GetNumVariants(int32 WordIndex) const;
+
+	/** A pronunciation as the dictionary names it, e.g. read or read(2) */
+	const char* GetVariant(int32 WordIndex, int32 VariantIndex) const;
+
+	/** Phones of a pronunciation, space separated */
+	const char* GetPhones(int32 WordIndex, int32 VariantIndex) const;
+
+	/** True when Variant is one of the word's pronunciations, e.g. read(2) */
+	bool HasVariant(int32 WordIndex, const char* Variant) const;
+
+	/** True when Word is a base word, or a pronunciation variant, in the dictionary */
+	bool Contains(const char* Word) const;
+
+private:
+	struct FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		int64 DictionarySize;
+		int64 DictionaryTimestamp;
+		uint32 NumWords;
+		uint32 NumEntries;
+		uint32 StringBytes;
+		uint32 Reserved;
+	};
+
+	struct FWordRecord
+	{
+		uint32 Name;
+		uint32 FirstEntry;
+		uint32 NumEntries;
+	};
+
+	struct FEntryRecord
+	{
+		uint32 Variant;
+		uint32 Phones;
+	};
+
+	static constexpr uint32 IndexMagic = 0x58494453; // SDIX
+	static constexpr uint32 IndexVersion = 1;
+
+	/** Where the index for a dictionary lives */
+	static FString GetIndexPath(const FString& InDictionaryPath);
+
+	/** Parses the .dict, and writes the index to IndexPath */
+	static bool Build(const FString& InDictionaryPath, const FString& IndexPath, int64 DictionarySize, int64 DictionaryTimestamp);
+
+	/** Maps IndexPath, and checks it was built from a dictionary of the given size and timestamp */
+	bool Map(const FString& IndexPath, int64 DictionarySize, int64 DictionaryTimestamp);
+
+	FString DictionaryPath;
+	mmio_file_t* Mapping = nullptr;
+	const FHeader* Header = nullptr;
+	const FWordRecord* Words = nullptr;
+	const FEntryRecord* Entries = nullptr;
+	const char* Strings = nullptr;
+};
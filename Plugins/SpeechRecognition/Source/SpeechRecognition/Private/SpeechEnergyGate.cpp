@@ -0,0 +1,152 @@
+#include "SpeechEnergyGate.h"
+#include "SpeechLevelMeter.h"
+
+FSpeechEnergyGate::FSpeechEnergyGate()
+	: bOpen(true)
+	, NoiseFloor(FSpeechLevelMeter::MinDecibels)
+	, SkippedSamples(0)
+{
+	for (float& minimum : WindowMinimum) {
+		minimum = 0.0f;
+	}
+}
+
+void FSpeechEnergyGate::Configure(const FSpeechEnergyGateSettings& InSettings, int32 InSampleRate, float MinHangoverSeconds)
+{
+	Settings = InSettings;
+	SampleRate = FMath::Max(InSampleRate, 1);
+	HangoverSamples = FMath::CeilToInt(FMath::Max(Settings.HangoverSeconds, MinHangoverSeconds) * InSampleRate);
+
+	// allocated once here, so the gate does not touch the heap while audio flows
+	const int32 preRollCapacity = FMath::Max(FMath::CeilToInt(Settings.PreRollSeconds * InSampleRate), 0);
+	PreRoll.SetNumZeroed(preRollCapacity);
+	PreRollLinear.SetNumZeroed(preRollCapacity);
+	Reset();
+}
+
+void FSpeechEnergyGate::Reset()
+{
+	PreRollHead = 0;
+	PreRollNum = 0;
+	bPreRollPending = false;
+	SilentSamples = 0;
+	bHasFloor = false;
+	NoiseFloor.store(FSpeechLevelMeter::MinDecibels, std::memory_order_relaxed);
+	// full scale, so the first chunk of a sub-window is its minimum
+	for (float& minimum : WindowMinimum) {
+		minimum = 0.0f;
+	}
+	WindowIndex = 0;
+	WindowSamples = 0;
+
+	// start closed, so the first chunks seed the noise floor
+	bOpen.store(!Settings.bEnabled, std::memory_order_relaxed);
+}
+
+bool FSpeechEnergyGate::Process(const int16* Samples, int32 NumSamples, float Decibels, bool bDecoderInSpeech)
+{
+	if (!Settings.bEnabled) {
+		return true;
+	}
+
+	float floor = NoiseFloor.load(std::memory_order_relaxed);
+	if (!bHasFloor) {
+		floor = Decibels;
+		bHasFloor = true;
+	}
+
+	const float minimum = TrackMinimum(Decibels, NumSamples);
+	const bool bLoud = Decibels >= FMath::Max(floor + Settings.OpenMarginDb, Settings.MinOpenDecibels);
+	const bool bQuiet = Decibels < floor + Settings.CloseMarginDb;
+
+	if (!bOpen.load(std::memory_order_relaxed)) {
+		if (bLoud || bDecoderInSpeech) {
+			bOpen.store(true, std::memory_order_relaxed);
+			bPreRollPending = PreRollNum > 0;
+			SilentSamples = 0;
+		}
+		else {
+			// closed, the chunk is background. Fall quickly, rise slowly
+			floor += (Decibels - floor) * (Decibels < floor ? 0.5f : 0.05f);
+			NoiseFloor.store(floor, std::memory_order_relaxed);
+			StorePreRoll(Samples, NumSamples);
+			SkippedSamples.fetch_add(NumSamples, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	else {
+		// never falls here: speech only raises the minimum, and the floor falls quickly enough once the gate closes
+		if (minimum > floor) {
+			floor += (minimum - floor) * FMath::Min((float)NumSamples / (OpenRiseSeconds * SampleRate), 1.0f);
+			NoiseFloor.store(floor, std::memory_order_relaxed);
+		}
+		SilentSamples = (bQuiet && !bDecoderInSpeech) ? SilentSamples + NumSamples : 0;
+		if (SilentSamples >= HangoverSamples) {
+			// this chunk is still decoded, so the decoder sees the silence that ends the utterance
+			bOpen.store(false, std::memory_order_relaxed);
+			PreRollNum = 0;
+			PreRollHead = 0;
+		}
+	}
+
+	return true;
+}
+
+float FSpeechEnergyGate::TrackMinimum(float Decibels, int32 NumSamples)
+{
+	WindowMinimum[WindowIndex] = FMath::Min(WindowMinimum[WindowIndex], Decibels);
+	WindowSamples += NumSamples;
+	float minimum = WindowMinimum[0];
+	for (int32 i = 1; i < NumMinimumWindows; i++) {
+		minimum = FMath::Min(minimum, WindowMinimum[i]);
+	}
+
+	// the oldest sub-window drops out as a new one starts
+	if (WindowSamples >= MinimumWindowSeconds * SampleRate) {
+		WindowSamples = 0;
+		WindowIndex = (WindowIndex + 1) % NumMinimumWindows;
+		WindowMinimum[WindowIndex] = 0.0f;
+	}
+	return minimum;
+}
+
+const int16* FSpeechEnergyGate::ConsumePreRoll(int32& OutNumSamples)
+{
+	OutNumSamples = 0;
+	if (!bPreRollPending) {
+		return nullptr;
+	}
+	bPreRollPending = false;
+
+	// unwrap the ring, oldest first
+	const int32 capacity = PreRoll.Num();
+	const int32 start = (PreRollHead - PreRollNum + capacity) % capacity;
+	const int32 firstPart = FMath::Min(PreRollNum, capacity - start);
+	FMemory::Memcpy(PreRollLinear.GetData(), PreRoll.GetData() + start, firstPart * sizeof(int16));
+	FMemory::Memcpy(PreRollLinear.GetData() + firstPart, PreRoll.GetData(), (PreRollNum - firstPart) * sizeof(int16));
+
+	OutNumSamples = PreRollNum;
+	PreRollNum = 0;
+	PreRollHead = 0;
+	return PreRollLinear.GetData();
+}
+
+void FSpeechEnergyGate::StorePreRoll(const int16* Samples, int32 NumSamples)
+{
+	const int32 capacity = PreRoll.Num();
+	if (capacity == 0) {
+		return;
+	}
+
+	// only the tail of a chunk longer than the pre-roll matters
+	if (NumSamples > capacity) {
+		Samples += NumSamples - capacity;
+		NumSamples = capacity;
+	}
+
+	const int32 firstPart = FMath::Min(NumSamples, capacity - PreRollHead);
+	FMemory::Memcpy(PreRoll.GetData() + PreRollHead, Samples, firstPart * sizeof(int16));
+	FMemory::Memcpy(PreRoll.GetData(), Samples + firstPart, (NumSamples - firstPart) * sizeof(int16));
+	PreRollHead = (PreRollHead + NumSamples) % capacity;
+	PreRollNum = FMath::Min(PreRollNum + NumSamples, capacity);
+}
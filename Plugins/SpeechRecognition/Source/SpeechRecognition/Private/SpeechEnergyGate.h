@@ -0,0 +1,80 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpeechRecognition.h"
+#include <atomic>
+
+/**
+ * Cheap pre-VAD in front of the decoder.
+ *
+ * Chunks are only forwarded to acoustic scoring once their energy rises clearly above an adaptive noise floor.
+ * While the gate is closed the most recent audio is kept as pre-roll, and handed to the decoder first when the gate
+ * opens, so the start of a word is not clipped. The gate stays open while the decoder's own VAD reports speech, and
+ * for a hangover after the energy drops, so it never closes in the middle of an utterance.
+ *
+ * The floor follows quiet chunks while the gate is closed. While it is open, it rises slowly towards the quietest chunk
+ * of the last few seconds (minimum statistics), so background noise that starts while someone talks, e.g. a fan
+ * switching on, does not hold the gate open for good. Pauses between words keep that minimum near the noise.
+ *
+ * Only used from the decode thread, apart from the counters.
+ */
+class FSpeechEnergyGate
+{
+public:
+	FSpeechEnergyGate();
+
+	/** Applies settings, and sizes the pre-roll. MinHangoverSeconds is the decoder's own -vad_postspeech, which the hangover never undercuts */
+	void Configure(const FSpeechEnergyGateSettings& InSettings, int32 InSampleRate, float MinHangoverSeconds);
+
+	/** Forgets the noise floor and pre-roll, and closes the gate */
+	void Reset();
+
+	/**
+	 * Decides whether a chunk should be decoded. Decibels is the chunk's RMS level in dBFS.
+	 * bDecoderInSpeech holds the gate open regardless of energy.
+	 */
+	bool Process(const int16* Samples, int32 NumSamples, float Decibels, bool bDecoderInSpeech);
+
+	/** After Process opens the gate, returns the audio that came before the chunk, oldest first. Empty otherwise */
+	const int16* ConsumePreRoll(int32& OutNumSamples);
+
+	bool IsEnabled() const { return Settings.bEnabled; }
+	bool IsOpen() const { return bOpen.load(std::memory_order_relaxed); }
+	float GetNoiseFloor() const { return NoiseFloor.load(std::memory_order_relaxed); }
+
+	/** Samples that were not decoded, because the gate was closed */
+	uint64 GetSkippedSamples() const { return SkippedSamples.load(std::memory_order_relaxed); }
+
+private:
+	/** Appends to the pre-roll ring */
+	void StorePreRoll(const int16* Samples, int32 NumSamples);
+
+	/** Adds a chunk to the minimum statistics. Returns the quietest chunk of the window */
+	float TrackMinimum(float Decibels, int32 NumSamples);
+
+	FSpeechEnergyGateSettings Settings;
+	int32 SampleRate = 16000;
+	int32 HangoverSamples = 0;
+	int32 SilentSamples = 0;
+	bool bHasFloor = false;
+
+	// quietest chunk of each of the last few sub-windows, as a ring. The newest one is still filling
+	static constexpr int32 NumMinimumWindows = 4;
+	static constexpr float MinimumWindowSeconds = 1.0f;
+	// time constant of the floor's rise while the gate is open
+	static constexpr float OpenRiseSeconds = 2.0f;
+	float WindowMinimum[NumMinimumWindows];
+	int32 WindowIndex = 0;
+	int32 WindowSamples = 0;
+
+	// pre-roll ring, and the contiguous copy handed to the decoder
+	TArray<int16> PreRoll;
+	TArray<int16> PreRollLinear;
+	int32 PreRollHead = 0;
+	int32 PreRollNum = 0;
+	bool bPreRollPending = false;
+
+	std::atomic<bool> bOpen;
+	std::atomic<float> NoiseFloor;
+	std::atomic<uint64> SkippedSamples;
+};
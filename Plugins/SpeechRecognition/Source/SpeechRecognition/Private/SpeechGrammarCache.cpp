@@ -0,0 +1,104 @@
+#include "SpeechGrammarCache.h"
+#include "SpeechRecognitionWorker.h"
+#include <sphinxbase/jsgf.h>
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+
+FSpeechGrammarCache::FSpeechGrammarCache()
+	: CacheDir(FPaths::ProjectSavedDir() / TEXT("SpeechRecognition") / TEXT("GrammarCache"))
+{
+}
+
+fsg_model_t* FSpeechGrammarCache::Load(const FString& GrammarPath, const FString& DictionaryPath, logmath_t* LogMath, float32 LanguageWeight, const char* TopRule)
+{
+	TArray<uint8> grammarBytes;
+	if (!FFileHelper::LoadFileToArray(grammarBytes, *GrammarPath)) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to read grammar %s"), *GrammarPath);
+		return nullptr;
+	}
+
+	// everything that changes the compiled grammar goes into the key
+	const FString& dictionaryHash = GetDictionaryHash(DictionaryPath);
+	const FString settings = FString::Printf(TEXT("%s|%g|%s"), *dictionaryHash, LanguageWeight, TopRule != nullptr ? UTF8_TO_TCHAR(TopRule) : TEXT(""));
+	const FTCHARToUTF8 settingsUtf8(*settings);
+
+	FMD5 md5;
+	md5.Update(grammarBytes.GetData(), grammarBytes.Num());
+	md5.Update((const uint8*)settingsUtf8.Get(), settingsUtf8.Length());
+	uint8 digest[16];
+	md5.Final(digest);
+
+	const FString grammarName = FPaths::GetBaseFilename(GrammarPath);
+	const FString cachePath = CacheDir / FString::Printf(TEXT("%s_%s.fsg"), *grammarName, *BytesToHex(digest, UE_ARRAY_COUNT(digest)));
+	const FTCHARToUTF8 cachePathUtf8(*cachePath);
+
+	IFileManager& fileManager = IFileManager::Get();
+	if (fileManager.FileExists(*cachePath)) {
+		fsg_model_t* fsg = fsg_model_readfile(cachePathUtf8.Get(), LogMath, LanguageWeight);
+		if (fsg != nullptr) {
+			HitCount++;
+			return fsg;
+		}
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Discarding unreadable compiled grammar %s"), *cachePath);
+		fileManager.Delete(*cachePath, false, true, true);
+	}
+
+	MissCount++;
+	fsg_model_t* fsg = Compile(GrammarPath, LogMath, LanguageWeight, TopRule);
+	if (fsg == nullptr) {
+		return nullptr;
+	}
+
+	// drop older compilations of the same grammar, then write through a temporary file so a reader never sees half of one
+	TArray<FString> staleFiles;
+	fileManager.FindFiles(staleFiles, *(CacheDir / (grammarName + TEXT("_*.fsg"))), true, false);
+	for (const FString& staleFile : staleFiles) {
+		fileManager.Delete(*(CacheDir / staleFile), false, true, true);
+	}
+
+	fileManager.MakeDirectory(*CacheDir, true);
+	const FString tempPath = cachePath + TEXT(".tmp");
+	fsg_model_writefile(fsg, FTCHARToUTF8(*tempPath).Get());
+	if (!fileManager.Move(*cachePath, *tempPath, true, true)) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to cache compiled grammar %s"), *cachePath);
+		fileManager.Delete(*tempPath, false, true, true);
+	}
+
+	return fsg;
+}
+
+fsg_model_t* FSpeechGrammarCache::Compile(const FString& GrammarPath, logmath_t* LogMath, float32 LanguageWeight, const char* TopRule)
+{
+	jsgf_t* jsgf = jsgf_parse_file(FTCHARToUTF8(*GrammarPath).Get(), nullptr);
+	if (jsgf == nullptr) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to parse grammar %s"), *GrammarPath);
+		return nullptr;
+	}
+
+	jsgf_rule_t* rule = TopRule != nullptr ? jsgf_get_rule(jsgf, TopRule) : jsgf_get_public_rule(jsgf);
+	if (rule == nullptr) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Grammar %s has no %s rule"), *GrammarPath, TopRule != nullptr ? UTF8_TO_TCHAR(TopRule) : TEXT("public"));
+		jsgf_grammar_free(jsgf);
+		return nullptr;
+	}
+
+	fsg_model_t* fsg = jsgf_build_fsg(jsgf, rule, LogMath, LanguageWeight);
+	jsgf_grammar_free(jsgf);
+	return fsg;
+}
+
+const FString& FSpeechGrammarCache::GetDictionaryHash(const FString& DictionaryPath)
+{
+	IFileManager& fileManager = IFileManager::Get();
+	const FDateTime timestamp = fileManager.GetTimeStamp(*DictionaryPath);
+	const int64 size = fileManager.FileSize(*DictionaryPath);
+	if (DictionaryPath != DictionaryPathHashed || timestamp != DictionaryTimestamp || size != DictionarySize) {
+		DictionaryPathHashed = DictionaryPath;
+		DictionaryTimestamp = timestamp;
+		DictionarySize = size;
+		DictionaryHash = LexToString(FMD5Hash::HashFile(*DictionaryPath));
+	}
+	return DictionaryHash;
+}
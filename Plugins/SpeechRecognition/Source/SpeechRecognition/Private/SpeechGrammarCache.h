@@ -0,0 +1,48 @@
+#pragma once
+
+#include <sphinxbase/fsg_model.h>
+#include <sphinxbase/logmath.h>
+
+#include "CoreMinimal.h"
+
+/**
+ * Compiles JSGF grammars to finite state grammars once, and keeps the result on disk.
+ *
+ * Compiled grammars are stored with fsg_model_writefile under Saved/SpeechRecognition/GrammarCache, named after the grammar
+ * and a hash of its contents, the dictionary, and the settings that affect compilation. Later loads read the FSG back with
+ * fsg_model_readfile, skipping the JSGF parse and compile. Editing a grammar or the dictionary changes the hash, so stale
+ * entries are never used; they are deleted when their replacement is written.
+ *
+ * Used from the decode thread only.
+ */
+class FSpeechGrammarCache
+{
+public:
+	FSpeechGrammarCache();
+
+	/**
+	 * Returns the compiled grammar for GrammarPath, compiling and caching it on a miss.
+	 * The caller owns the returned model, and releases it with fsg_model_free. Returns nullptr if the grammar does not compile.
+	 */
+	fsg_model_t* Load(const FString& GrammarPath, const FString& DictionaryPath, logmath_t* LogMath, float32 LanguageWeight, const char* TopRule);
+
+	uint32 GetHitCount() const { return HitCount; }
+	uint32 GetMissCount() const { return MissCount; }
+
+private:
+	/** Parses and compiles a grammar, as ps_set_jsgf_file would */
+	static fsg_model_t* Compile(const FString& GrammarPath, logmath_t* LogMath, float32 LanguageWeight, const char* TopRule);
+
+	/** Hash of the dictionary's contents. Only rehashed when the file's size or timestamp changes */
+	const FString& GetDictionaryHash(const FString& DictionaryPath);
+
+	FString CacheDir;
+
+	FString DictionaryPathHashed;
+	FDateTime DictionaryTimestamp;
+	int64 DictionarySize = -1;
+	FString DictionaryHash;
+
+	uint32 HitCount = 0;
+	uint32 MissCount = 0;
+};
@@ -0,0 +1,86 @@
+#include "SpeechLevelMeter.h"
+#include "SpeechAudioDSP.h"
+
+FSpeechLevelMeter::FSpeechLevelMeter()
+	: Sequence(0)
+	, Peak(0)
+	, RMS(0.0f)
+	, Decibels(MinDecibels)
+	, HistoryCount(0)
+{
+	for (std::atomic<float>& level : History) {
+		level.store(0.0f, std::memory_order_relaxed);
+	}
+}
+
+void FSpeechLevelMeter::Process(const int16* Samples, int32 NumSamples)
+{
+	if (NumSamples <= 0) {
+		return;
+	}
+
+	int32 peak;
+	uint64 sumSquares;
+	SpeechAudioDSP::MeasureLevel(Samples, NumSamples, peak, sumSquares);
+
+	const float rms = FMath::Sqrt((float)((double)sumSquares / NumSamples)) / 32768.0f;
+	const float decibels = rms > 0.0f ? FMath::Max(20.0f * FMath::LogX(10.0f, rms), MinDecibels) : MinDecibels;
+
+	// an odd sequence marks a write in progress
+	const uint32 sequence = Sequence.load(std::memory_order_relaxed);
+	Sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Peak.store(peak, std::memory_order_relaxed);
+	RMS.store(rms, std::memory_order_relaxed);
+	Decibels.store(decibels, std::memory_order_relaxed);
+	const uint32 count = HistoryCount.load(std::memory_order_relaxed);
+	History[count % HistorySize].store(rms, std::memory_order_relaxed);
+	HistoryCount.store(count + 1, std::memory_order_relaxed);
+
+	Sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void FSpeechLevelMeter::Reset()
+{
+	const uint32 sequence = Sequence.load(std::memory_order_relaxed);
+	Sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Peak.store(0, std::memory_order_relaxed);
+	RMS.store(0.0f, std::memory_order_relaxed);
+	Decibels.store(MinDecibels, std::memory_order_relaxed);
+	HistoryCount.store(0, std::memory_order_relaxed);
+
+	Sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void FSpeechLevelMeter::GetLevel(int32& OutPeak, float& OutRMS, float& OutDecibels) const
+{
+	uint32 before, after;
+	do {
+		before = Sequence.load(std::memory_order_acquire);
+		OutPeak = Peak.load(std::memory_order_relaxed);
+		OutRMS = RMS.load(std::memory_order_relaxed);
+		OutDecibels = Decibels.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = Sequence.load(std::memory_order_relaxed);
+	} while ((before & 1) != 0 || before != after);
+}
+
+int32 FSpeechLevelMeter::GetHistory(float* OutLevels, int32 MaxLevels) const
+{
+	uint32 before, after;
+	int32 num;
+	do {
+		before = Sequence.load(std::memory_order_acquire);
+		const uint32 count = HistoryCount.load(std::memory_order_relaxed);
+		num = FMath::Min3((int32)FMath::Min(count, (uint32)HistorySize), MaxLevels, HistorySize);
+		for (int32 i = 0; i < num; i++) {
+			OutLevels[i] = History[(count - num + i) % HistorySize].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = Sequence.load(std::memory_order_relaxed);
+	} while ((before & 1) != 0 || before != after);
+	return num;
+}
@@ -0,0 +1,629 @@
+#include "SpeechMfccFrontEnd.h"
+#include "SpeechRecognitionWorker.h"
+#include "SpeechAudioSource.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/Paths.h"
+#include <string>
+#include <type_traits>
+#include <vector>
+
+static_assert(std::is_same<mfcc_t, float>::value, "The native front end writes float cepstra, so sphinxbase must not be built with FIXED_POINT");
+
+// smoothing of the band powers, and how fast the noise estimate follows them down and up (fe_noise.c's lambdas)
+static constexpr float VadPowerSmoothing = 0.7f;
+static constexpr float VadNoiseFall = 0.5f;
+static constexpr float VadNoiseRise = 0.995f;
+
+// noise removal: temporal masking decay and depth, the largest gain (its inverse is the smallest),
+// and the bands either side the gains are averaged over
+static constexpr float MaskingDecay = 0.85f;
+static constexpr float MaskingDepth = 0.2f;
+static constexpr float MaxGain = 20.0f;
+static constexpr int32 GainSmoothing = 4;
+
+// sphinxbase adds this before taking the log, so silent bands stay finite
+static constexpr float LogFloor = 1e-4f;
+
+static float MelScale(float Hz)
+{
+	return (float)(2595.0 * FMath::LogX(10.0, 1.0 + Hz / 700.0));
+}
+
+static float InverseMelScale(float Mel)
+{
+	return (float)(700.0 * (FMath::Pow(10.0, Mel / 2595.0) - 1.0));
+}
+
+bool FSpeechMfccFrontEnd::ReadSettings(cmd_ln_t* Config, FSettings& OutSettings)
+{
+	if (cmd_ln_boolean_r(Config, "-logspec") || cmd_ln_boolean_r(Config, "-smoothspec")) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The native front end only computes cepstra, not log spectra"));
+		return false;
+	}
+	if (cmd_ln_boolean_r(Config, "-doublebw")) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The native front end does not implement -doublebw"));
+		return false;
+	}
+	const char* warpParams = cmd_ln_str_r(Config, "-warp_params");
+	if (warpParams != NULL && *warpParams != '\0') {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The native front end does not implement frequency warping"));
+		return false;
+	}
+	if (cmd_ln_boolean_r(Config, "-dither")) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The native front end does not implement -dither"));
+		return false;
+	}
+	const char* transform = cmd_ln_str_r(Config, "-transform");
+	if (transform == NULL || strcmp(transform, "legacy") == 0) {
+		OutSettings.Transform = ETransform::Legacy;
+	}
+	else if (strcmp(transform, "dct") == 0) {
+		OutSettings.Transform = ETransform::Dct;
+	}
+	else if (strcmp(transform, "htk") == 0) {
+		OutSettings.Transform = ETransform::Htk;
+	}
+	else {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Unknown -transform %s"), UTF8_TO_TCHAR(transform));
+		return false;
+	}
+
+	OutSettings.SampleRate = cmd_ln_float32_r(Config, "-samprate");
+	OutSettings.FrameRate = cmd_ln_int32_r(Config, "-frate");
+	OutSettings.WindowLength = cmd_ln_float32_r(Config, "-wlen");
+	OutSettings.FftSize = cmd_ln_int32_r(Config, "-nfft");
+	OutSettings.NumFilters = cmd_ln_int32_r(Config, "-nfilt");
+	OutSettings.LowerFreq = cmd_ln_float32_r(Config, "-lowerf");
+	OutSettings.UpperFreq = cmd_ln_float32_r(Config, "-upperf");
+	OutSettings.NumCepstra = cmd_ln_int32_r(Config, "-ncep");
+	OutSettings.Lifter = cmd_ln_int32_r(Config, "-lifter");
+	OutSettings.PreEmphasis = cmd_ln_float32_r(Config, "-alpha");
+	OutSettings.bRemoveDC = cmd_ln_boolean_r(Config, "-remove_dc") != 0;
+	OutSettings.bUnitArea = cmd_ln_boolean_r(Config, "-unit_area") != 0;
+	OutSettings.bRoundFilters = cmd_ln_boolean_r(Config, "-round_filters") != 0;
+	OutSettings.bRemoveNoise = cmd_ln_boolean_r(Config, "-remove_noise") != 0;
+	OutSettings.bRemoveSilence = cmd_ln_boolean_r(Config, "-remove_silence") != 0;
+	OutSettings.VadThreshold = cmd_ln_float32_r(Config, "-vad_threshold");
+	OutSettings.VadPreSpeech = cmd_ln_int32_r(Config, "-vad_prespeech");
+	OutSettings.VadPostSpeech = cmd_ln_int32_r(Config, "-vad_postspeech");
+	return true;
+}
+
+bool FSpeechMfccFrontEnd::Init(const FSettings& InSettings)
+{
+	Settings = InSettings;
+	FrameShift = Settings.FrameRate > 0 ? (int32)(Settings.SampleRate / Settings.FrameRate + 0.5f) : 0;
+	FrameSize = (int32)(Settings.WindowLength * Settings.SampleRate + 0.5f);
+	if (FrameShift <= 0 || FrameSize < FrameShift || !FMath::IsPowerOfTwo(Settings.FftSize) || Settings.FftSize < FrameSize
+		|| Settings.NumFilters <= 0 || Settings.NumCepstra <= 0 || Settings.NumCepstra > Settings.NumFilters
+		|| Settings.LowerFreq >= Settings.UpperFreq || Settings.UpperFreq > Settings.SampleRate * 0.5f) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The front end settings are inconsistent: %d sample frames every %d samples, %d point FFT, %d filters from %.1f to %.1f Hz"),
+			FrameSize, FrameShift, Settings.FftSize, Settings.NumFilters, Settings.LowerFreq, Settings.UpperFreq);
+		return false;
+	}
+
+	// Hamming window, mirrored from its first half as sphinxbase does
+	Window.SetNumUninitialized(FrameSize);
+	for (int32 i = 0; i < FrameSize; i++) {
+		Window[i] = 1.0f;
+	}
+	for (int32 i = 0; i < FrameSize / 2; i++) {
+		const float w = (float)(0.54 - 0.46 * FMath::Cos(2.0 * UE_DOUBLE_PI * i / ((double)FrameSize - 1.0)));
+		Window[i] = w;
+		Window[FrameSize - 1 - i] = w;
+	}
+
+	FrameBuffer.SetNumZeroed(Settings.FftSize);
+	Power.SetNumZeroed(Settings.FftSize / 2 + 1);
+	Fft.Init(Settings.FftSize);
+
+	// triangular filters evenly spaced on the mel scale, with edges rounded to FFT bins.
+	// Placement follows fe_build_melfilters, in single precision as it is computed there
+	const int32 numFilters = Settings.NumFilters;
+	const float melMin = MelScale(Settings.LowerFreq);
+	const float melMax = MelScale(Settings.UpperFreq);
+	const float melWidth = (melMax - melMin) / (float)(numFilters + 1);
+	const float fftFreq = Settings.SampleRate / (float)Settings.FftSize;
+	const int32 numBins = Settings.FftSize / 2;
+
+	FilterStart.SetNumUninitialized(numFilters);
+	FilterWidth.SetNumUninitialized(numFilters);
+	FilterOffset.SetNumUninitialized(numFilters);
+	FilterWeights.Reset();
+	for (int32 f = 0; f < numFilters; f++) {
+		float freqs[3];
+		for (int32 e = 0; e < 3; e++) {
+			freqs[e] = InverseMelScale((float)(f + e) * melWidth + melMin);
+			if (Settings.bRoundFilters) {
+				freqs[e] = (float)(int32)(freqs[e] / fftFreq + 0.5f) * fftFreq;
+			}
+		}
+
+		int32 start = INDEX_NONE;
+		int32 width = 0;
+		for (int32 bin = 0; bin <= numBins; bin++) {
+			const float hz = (float)bin * fftFreq;
+			if (hz < freqs[0]) {
+				continue;
+			}
+			if (hz > freqs[2] || bin == numBins) {
+				width = start != INDEX_NONE ? bin - start : 0;
+				break;
+			}
+			if (start == INDEX_NONE) {
+				start = bin;
+			}
+		}
+		if (width <= 0 || freqs[1] <= freqs[0] || freqs[2] <= freqs[1]) {
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Mel filter %d covers no FFT bins, use fewer filters or a larger FFT"), f);
+			return false;
+		}
+
+		FilterStart[f] = start;
+		FilterWidth[f] = width;
+		FilterOffset[f] = FilterWeights.Num();
+		for (int32 bin = 0; bin < width; bin++) {
+			const float hz = (float)(start + bin) * fftFreq;
+			float loSlope = (hz - freqs[0]) / (freqs[1] - freqs[0]);
+			float hiSlope = (freqs[2] - hz) / (freqs[2] - freqs[1]);
+			if (Settings.bUnitArea) {
+				loSlope *= 2.0f / (freqs[2] - freqs[0]);
+				hiSlope *= 2.0f / (freqs[2] - freqs[0]);
+			}
+			FilterWeights.Add(FMath::Min(loSlope, hiSlope));
+		}
+	}
+	MelSpectrum.SetNumZeroed(numFilters);
+	LogSpectrum.SetNumZeroed(numFilters);
+
+	// the cosine transform of the log spectrum, its normalisation, and the lifter, as one matrix
+	const int32 numCepstra = Settings.NumCepstra;
+	Transform.SetNumUninitialized(numCepstra * numFilters);
+	for (int32 c = 0; c < numCepstra; c++) {
+		const double lifter = Settings.Lifter > 0 ? 1.0 + Settings.Lifter * 0.5 * FMath::Sin(c * UE_DOUBLE_PI / Settings.Lifter) : 1.0;
+		for (int32 j = 0; j < numFilters; j++) {
+			const double basis = FMath::Cos(UE_DOUBLE_PI / numFilters * c * (j + 0.5));
+			double weight;
+			switch (Settings.Transform) {
+			case ETransform::Legacy:
+				weight = basis * (j == 0 ? 0.5 : 1.0) / numFilters;
+				break;
+			case ETransform::Htk:
+				weight = basis * FMath::Sqrt(2.0 / numFilters);
+				break;
+			default:
+				weight = basis * FMath::Sqrt((c == 0 ? 1.0 : 2.0) / numFilters);
+				break;
+			}
+			Transform[c * numFilters + j] = (float)(weight * lifter);
+		}
+	}
+	Cepstrum.SetNumZeroed(numCepstra);
+
+	SmoothedPower.SetNumZeroed(numFilters);
+	NoisePower.SetNumZeroed(numFilters);
+	SignalPower.SetNumZeroed(numFilters);
+	SignalFloor.SetNumZeroed(numFilters);
+	SignalPeak.SetNumZeroed(numFilters);
+	Gain.SetNumZeroed(numFilters);
+	PreSpeech.SetNumZeroed(FMath::Max(Settings.VadPreSpeech, 1) * numCepstra);
+	Reset();
+	return true;
+}
+
+void FSpeechMfccFrontEnd::Reset()
+{
+	Pending.Reset();
+	Prior = 0;
+	Cepstra.Reset();
+	FramePointers.Reset();
+	NumOutput = 0;
+	bHasNoise = false;
+	FrameRatio = 0.0f;
+	bInSpeech = false;
+	SpeechRun = 0;
+	SilenceRun = 0;
+	PreSpeechHead = 0;
+	PreSpeechNum = 0;
+}
+
+void FSpeechMfccFrontEnd::ComputeFrame(const int16* Frame, int16 FramePrior, float* OutCepstrum)
+{
+	// pre-emphasis, then the window. Samples past the frame stay zero, padding it to the FFT size
+	float* frame = FrameBuffer.GetData();
+	SpeechAudioDSP::PreEmphasize(Frame, FrameSize, FramePrior, Settings.PreEmphasis, frame);
+	if (Settings.bRemoveDC) {
+		float mean = 0.0f;
+		for (int32 i = 0; i < FrameSize; i++) {
+			mean += frame[i];
+		}
+		mean /= (float)FrameSize;
+		for (int32 i = 0; i < FrameSize; i++) {
+			frame[i] -= mean;
+		}
+	}
+	SpeechAudioDSP::Multiply(frame, Window.GetData(), FrameSize);
+
+	Fft.PowerSpectrum(frame, Power.GetData());
+
+	const int32 numFilters = Settings.NumFilters;
+	for (int32 f = 0; f < numFilters; f++) {
+		MelSpectrum[f] = SpeechAudioDSP::DotProduct(Power.GetData() + FilterStart[f], FilterWeights.GetData() + FilterOffset[f], FilterWidth[f]);
+	}
+
+	// the noise is tracked on the mel spectrum before it is cleaned up, as sphinxbase does
+	if (Settings.bRemoveNoise || Settings.bRemoveSilence) {
+		FrameRatio = TrackNoise();
+	}
+	if (Settings.bRemoveNoise) {
+		RemoveNoise(FrameRatio >= Settings.VadThreshold);
+	}
+	for (int32 f = 0; f < numFilters; f++) {
+		LogSpectrum[f] = FMath::Loge(MelSpectrum[f] + LogFloor);
+	}
+
+	for (int32 c = 0; c < Settings.NumCepstra; c++) {
+		OutCepstrum[c] = SpeechAudioDSP::DotProduct(Transform.GetData() + c * numFilters, LogSpectrum.GetData(), numFilters);
+	}
+}
+
+float FSpeechMfccFrontEnd::TrackNoise()
+{
+	const int32 numFilters = Settings.NumFilters;
+	if (!bHasNoise) {
+		for (int32 f = 0; f < numFilters; f++) {
+			SmoothedPower[f] = MelSpectrum[f];
+			NoisePower[f] = MelSpectrum[f];
+			SignalFloor[f] = MelSpectrum[f] / MaxGain;
+			SignalPeak[f] = 0.0f;
+		}
+		bHasNoise = true;
+	}
+
+	// how far the loudest band stands clear of its noise level
+	float ratio = 0.0f;
+	for (int32 f = 0; f < numFilters; f++) {
+		const float power = VadPowerSmoothing * SmoothedPower[f] + (1.0f - VadPowerSmoothing) * MelSpectrum[f];
+		float& noise = NoisePower[f];
+		const float rate = power < noise ? VadNoiseFall : VadNoiseRise;
+		noise = rate * noise + (1.0f - rate) * power;
+		SmoothedPower[f] = power;
+		ratio = FMath::Max(ratio, FMath::Loge((power + LogFloor) / (noise + LogFloor)));
+	}
+	return ratio;
+}
+
+void FSpeechMfccFrontEnd::RemoveNoise(bool bSpeech)
+{
+	const int32 numFilters = Settings.NumFilters;
+	for (int32 f = 0; f < numFilters; f++) {
+		// the power above the noise, then its own lower envelope as a floor
+		float signal = FMath::Max(SmoothedPower[f] - NoisePower[f], 1.0f);
+		float& floor = SignalFloor[f];
+		const float rate = signal < floor ? VadNoiseFall : VadNoiseRise;
+		floor = rate * floor + (1.0f - rate) * signal;
+
+		// temporal masking: a band falling well below its recent peak is held at a fraction of it
+		const float input = signal;
+		float& peak = SignalPeak[f];
+		peak *= MaskingDecay;
+		if (signal < MaskingDecay * peak) {
+			signal = peak * MaskingDepth;
+		}
+		if (input > peak) {
+			peak = input;
+		}
+		SignalPower[f] = FMath::Max(signal, floor);
+	}
+
+	for (int32 f = 0; f < numFilters; f++) {
+		const float power = SmoothedPower[f];
+		Gain[f] = bSpeech ? FMath::Max(SignalPower[f] < MaxGain * power ? SignalPower[f] / power : MaxGain, 1.0f / MaxGain) : 1.0f / MaxGain;
+	}
+
+	// each band is scaled by the mean gain of its neighbours
+	for (int32 f = 0; f < numFilters; f++) {
+		const int32 first = FMath::Max(f - GainSmoothing, 0);
+		const int32 last = FMath::Min(f + GainSmoothing, numFilters - 1);
+		float sum = 0.0f;
+		for (int32 i = first; i <= last; i++) {
+			sum += Gain[i];
+		}
+		MelSpectrum[f] *= sum / (float)(last - first + 1);
+	}
+}
+
+bool FSpeechMfccFrontEnd::IsSpeechFrame() const
+{
+	return FrameRatio >= Settings.VadThreshold;
+}
+
+float* FSpeechMfccFrontEnd::AddOutputFrame()
+{
+	Cepstra.AddUninitialized(Settings.NumCepstra);
+	return Cepstra.GetData() + (NumOutput++) * Settings.NumCepstra;
+}
+
+void FSpeechMfccFrontEnd::EmitFrame(const float* InCepstrum, bool bSpeech)
+{
+	const int32 numCepstra = Settings.NumCepstra;
+	if (!Settings.bRemoveSilence) {
+		bInSpeech = true;
+		FMemory::Memcpy(AddOutputFrame(), InCepstrum, numCepstra * sizeof(float));
+		return;
+	}
+
+	if (bInSpeech) {
+		FMemory::Memcpy(AddOutputFrame(), InCepstrum, numCepstra * sizeof(float));
+		SilenceRun = bSpeech ? 0 : SilenceRun + 1;
+		if (SilenceRun >= Settings.VadPostSpeech) {
+			bInSpeech = false;
+			SpeechRun = 0;
+			PreSpeechNum = 0;
+		}
+		return;
+	}
+
+	// hold the frame, so the start of speech is decoded once enough of it confirms it
+	const int32 capacity = PreSpeech.Num() / numCepstra;
+	FMemory::Memcpy(PreSpeech.GetData() + PreSpeechHead * numCepstra, InCepstrum, numCepstra * sizeof(float));
+	PreSpeechHead = (PreSpeechHead + 1) % capacity;
+	PreSpeechNum = FMath::Min(PreSpeechNum + 1, capacity);
+
+	SpeechRun = bSpeech ? SpeechRun + 1 : 0;
+	if (SpeechRun >= capacity) {
+		for (int32 i = 0; i < PreSpeechNum; i++) {
+			const int32 slot = (PreSpeechHead - PreSpeechNum + i + capacity) % capacity;
+			FMemory::Memcpy(AddOutputFrame(), PreSpeech.GetData() + slot * numCepstra, numCepstra * sizeof(float));
+		}
+		PreSpeechNum = 0;
+		bInSpeech = true;
+		SilenceRun = 0;
+	}
+}
+
+int32 FSpeechMfccFrontEnd::ProcessFrames(const int16* Samples, int32 NumSamples, bool bVad)
+{
+	Cepstra.Reset();
+	NumOutput = 0;
+	if (FrameSize <= 0) {
+		FramePointers.Reset();
+		return 0;
+	}
+
+	Pending.Append(Samples, NumSamples);
+	int32 start = 0;
+	while (start + FrameSize <= Pending.Num()) {
+		ComputeFrame(Pending.GetData() + start, start > 0 ? Pending[start - 1] : Prior, Cepstrum.GetData());
+		if (bVad) {
+			EmitFrame(Cepstrum.GetData(), IsSpeechFrame());
+		}
+		else {
+			FMemory::Memcpy(AddOutputFrame(), Cepstrum.GetData(), Settings.NumCepstra * sizeof(float));
+		}
+		start += FrameShift;
+	}
+
+	// the frames overlap, so only the samples before the next frame are done with
+	if (start > 0) {
+		Prior = Pending[start - 1];
+		Pending.RemoveAt(0, start, EAllowShrinking::No);
+	}
+
+	FramePointers.SetNumUninitialized(NumOutput);
+	for (int32 i = 0; i < NumOutput; i++) {
+		FramePointers[i] = Cepstra.GetData() + i * Settings.NumCepstra;
+	}
+	return NumOutput;
+}
+
+int32 FSpeechMfccFrontEnd::Process(const int16* Samples, int32 NumSamples)
+{
+	return ProcessFrames(Samples, NumSamples, true);
+}
+
+int32 FSpeechMfccFrontEnd::ProcessAll(const int16* Samples, int32 NumSamples)
+{
+	return ProcessFrames(Samples, NumSamples, false);
+}
+
+/**************************
+// Console commands
+**************************/
+
+// the English model's front end as the decoder builds it, from the defaults and feat.params, with -name value pairs
+// from the command line applied over it, e.g. -transform dct. Only the VAD is off, so every frame is comparable.
+// Noise removal stays on as the game runs it.
+// The other args are left in OutArgs
+static cmd_ln_t* CreateFrontEndConfig(const TArray<FString>& Args, TArray<FString>& OutArgs)
+{
+	cmd_ln_t* config = cmd_ln_init(NULL, ps_args(), 1, "-remove_silence", "no", NULL);
+	const FString featParams = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir()) / TEXT("model/en/en/feat.params");
+	if (config != NULL && FPaths::FileExists(featParams)) {
+		config = cmd_ln_parse_file_r(config, ps_args(), TCHAR_TO_UTF8(*featParams), 0);
+	}
+
+	std::vector<std::string> switches;
+	for (int32 i = 0; i < Args.Num(); i++) {
+		if (Args[i].StartsWith(TEXT("-")) && !Args[i].IsNumeric() && i + 1 < Args.Num()) {
+			switches.push_back(TCHAR_TO_UTF8(*Args[i]));
+			switches.push_back(TCHAR_TO_UTF8(*Args[++i]));
+		}
+		else {
+			OutArgs.Add(Args[i]);
+		}
+	}
+	if (config != NULL && switches.size() > 0) {
+		std::vector<char*> argv;
+		for (std::string& arg : switches) {
+			argv.push_back(&arg[0]);
+		}
+		cmd_ln_t* parsed = cmd_ln_parse_r(config, ps_args(), (int32)argv.size(), argv.data(), 0);
+		if (parsed == NULL) {
+			cmd_ln_free_r(config);
+		}
+		config = parsed;
+	}
+	return config;
+}
+
+// a WAV or raw file from the command line, or a few seconds of synthetic voiced sound and noise
+static TArray<int16> LoadTestAudio(const TArray<FString>& Args, int32 SampleRate, float Seconds)
+{
+	TArray<int16> samples;
+	if (Args.Num() > 0 && !Args[0].IsNumeric()) {
+		FSpeechFileAudioSource source(Args[0]);
+		if (source.Open(SampleRate)) {
+			int16 buffer[4096];
+			int32 numRead;
+			while ((numRead = source.Read(buffer, UE_ARRAY_COUNT(buffer))) > 0) {
+				samples.Append(buffer, numRead);
+			}
+		}
+		return samples;
+	}
+
+	FRandomStream random(1234);
+	samples.SetNumUninitialized((int32)(Seconds * SampleRate));
+	for (int32 i = 0; i < samples.Num(); i++) {
+		const double t = (double)i / SampleRate;
+		// half a second of a gliding harmonic tone, then half a second of quiet noise
+		const bool bVoiced = FMath::Fmod(t, 1.0) < 0.5;
+		const double pitch = 120.0 + 60.0 * FMath::Sin(UE_DOUBLE_PI * t);
+		double value = random.FRandRange(-200.0f, 200.0f);
+		if (bVoiced) {
+			for (int32 h = 1; h <= 20; h++) {
+				value += 4000.0 / h * FMath::Sin(2.0 * UE_DOUBLE_PI * pitch * h * t);
+			}
+		}
+		samples[i] = (int16)FMath::Clamp(value, -32768.0, 32767.0);
+	}
+	return samples;
+}
+
+static void ValidateFrontEnd(const TArray<FString>& Args)
+{
+	TArray<FString> args;
+	cmd_ln_t* config = CreateFrontEndConfig(Args, args);
+	FSpeechMfccFrontEnd::FSettings settings;
+	FSpeechMfccFrontEnd frontEnd;
+	if (config == NULL || !FSpeechMfccFrontEnd::ReadSettings(config, settings) || !frontEnd.Init(settings)) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("ValidateFrontEnd: could not set up the native front end"));
+		if (config != NULL) {
+			cmd_ln_free_r(config);
+		}
+		return;
+	}
+	const float tolerance = args.Num() > 1 ? FCString::Atof(*args[1]) : 0.01f;
+
+	const TArray<int16> audio = LoadTestAudio(args, (int32)settings.SampleRate, 5.0f);
+	const int32 numNative = frontEnd.ProcessAll(audio.GetData(), audio.Num());
+
+	fe_t* fe = fe_init_auto_r(config);
+	TArray<mfcc_t> reference;
+	TArray<mfcc_t*> referenceFrames;
+	int32 numReference = audio.Num() / frontEnd.GetFrameShift() + 1;
+	reference.SetNumZeroed(numReference * settings.NumCepstra);
+	referenceFrames.SetNumUninitialized(numReference);
+	for (int32 i = 0; i < numReference; i++) {
+		referenceFrames[i] = reference.GetData() + i * settings.NumCepstra;
+	}
+	const int16* samples = audio.GetData();
+	size_t numSamples = audio.Num();
+	fe_start_utt(fe);
+	fe_process_frames(fe, &samples, &numSamples, referenceFrames.GetData(), &numReference, NULL);
+	fe_free(fe);
+
+	// compare what both produced, coefficient by coefficient
+	const int32 numFrames = FMath::Min(numNative, numReference);
+	mfcc_t** native = frontEnd.GetFrames();
+	double maxError = 0.0;
+	double sumError = 0.0;
+	int32 worstFrame = 0;
+	int32 worstCoefficient = 0;
+	for (int32 f = 0; f < numFrames; f++) {
+		for (int32 c = 0; c < settings.NumCepstra; c++) {
+			const double error = FMath::Abs((double)native[f][c] - (double)referenceFrames[f][c]);
+			sumError += error;
+			if (error > maxError) {
+				maxError = error;
+				worstFrame = f;
+				worstCoefficient = c;
+			}
+		}
+	}
+	const double meanError = numFrames > 0 ? sumError / ((double)numFrames * settings.NumCepstra) : 0.0;
+	const bool bPassed = numFrames > 0 && numNative == numReference && maxError <= tolerance;
+	UE_LOG(SpeechRecognitionPlugin, Log, TEXT("ValidateFrontEnd %s: %d native and %d sphinxbase frames, max error %.6f (frame %d, c%d), mean error %.6f, tolerance %.6f"),
+		bPassed ? TEXT("passed") : TEXT("FAILED"), numNative, numReference, maxError, worstFrame, worstCoefficient, meanError, tolerance);
+
+	cmd_ln_free_r(config);
+}
+
+static void BenchmarkFrontEnd(const TArray<FString>& Args)
+{
+	TArray<FString> args;
+	cmd_ln_t* config = CreateFrontEndConfig(Args, args);
+	FSpeechMfccFrontEnd::FSettings settings;
+	FSpeechMfccFrontEnd frontEnd;
+	if (config == NULL || !FSpeechMfccFrontEnd::ReadSettings(config, settings) || !frontEnd.Init(settings)) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("BenchmarkFrontEnd: could not set up the native front end"));
+		if (config != NULL) {
+			cmd_ln_free_r(config);
+		}
+		return;
+	}
+	const float seconds = args.Num() > 0 && args[0].IsNumeric() ? FMath::Max(FCString::Atof(*args[0]), 1.0f) : 30.0f;
+	const TArray<int16> audio = LoadTestAudio(args, (int32)settings.SampleRate, seconds);
+	const double audioSeconds = (double)audio.Num() / settings.SampleRate;
+
+	// best of a few runs, on this thread only
+	const int32 numRuns = 5;
+	double nativeSeconds = DBL_MAX;
+	int32 numFrames = 0;
+	for (int32 run = 0; run < numRuns; run++) {
+		frontEnd.Reset();
+		const double start = FPlatformTime::Seconds();
+		numFrames = frontEnd.ProcessAll(audio.GetData(), audio.Num());
+		nativeSeconds = FMath::Min(nativeSeconds, FPlatformTime::Seconds() - start);
+	}
+
+	fe_t* fe = fe_init_auto_r(config);
+	TArray<mfcc_t> reference;
+	TArray<mfcc_t*> referenceFrames;
+	const int32 capacity = audio.Num() / frontEnd.GetFrameShift() + 1;
+	reference.SetNumZeroed(capacity * settings.NumCepstra);
+	referenceFrames.SetNumUninitialized(capacity);
+	for (int32 i = 0; i < capacity; i++) {
+		referenceFrames[i] = reference.GetData() + i * settings.NumCepstra;
+	}
+	double sphinxSeconds = DBL_MAX;
+	for (int32 run = 0; run < numRuns; run++) {
+		const int16* samples = audio.GetData();
+		size_t numSamples = audio.Num();
+		int32 numReference = capacity;
+		fe_start_utt(fe);
+		const double start = FPlatformTime::Seconds();
+		fe_process_frames(fe, &samples, &numSamples, referenceFrames.GetData(), &numReference, NULL);
+		sphinxSeconds = FMath::Min(sphinxSeconds, FPlatformTime::Seconds() - start);
+	}
+	fe_free(fe);
+
+	const double nativeRate = nativeSeconds > 0.0 ? numFrames / nativeSeconds : 0.0;
+	const double sphinxRate = sphinxSeconds > 0.0 ? numFrames / sphinxSeconds : 0.0;
+	UE_LOG(SpeechRecognitionPlugin, Log, TEXT("BenchmarkFrontEnd: %d frames (%.1f s of audio). Native %.0f frames/s per core, %.0fx real time. sphinxbase %.0f frames/s per core, %.0fx real time. Speedup %.2fx"),
+		numFrames, audioSeconds, nativeRate, audioSeconds / FMath::Max(nativeSeconds, 1e-9), sphinxRate, audioSeconds / FMath::Max(sphinxSeconds, 1e-9), sphinxRate > 0.0 ? nativeRate / sphinxRate : 0.0);
+
+	cmd_ln_free_r(config);
+}
+
+static FAutoConsoleCommand ValidateFrontEndCommand(
+	TEXT("SpeechRecognition.ValidateFrontEnd"),
+	TEXT("Compares the native MFCC front end with sphinxbase's fe_process_frames, on the decoder's config. Args: [wav or raw file] [tolerance, default 0.01] [-name value...]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&ValidateFrontEnd));
+
+static FAutoConsoleCommand BenchmarkFrontEndCommand(
+	TEXT("SpeechRecognition.BenchmarkFrontEnd"),
+	TEXT("Times the native MFCC front end against sphinxbase's on one core. Args: [seconds of synthetic audio, or a wav or raw file] [-name value...]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkFrontEnd));
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/fe.h>
+
+#include "CoreMinimal.h"
+#include "SpeechAudioDSP.h"
+
+/**
+ * MFCC front end computed in the plugin, whose cepstra go straight to ps_process_cep.
+ *
+ * Follows sphinxbase's fe_process_frames for the settings the decoder was built with (feat.params included):
+ * pre-emphasis, Hamming window, power spectrum, triangular mel filters placed and rounded the same way, log,
+ * then the legacy, dct or htk cosine transform and the sin lifter. Each stage runs on the SpeechAudioDSP kernels,
+ * and the transform and lifter are folded into one matrix, so a frame is a handful of dot products.
+ * The work is single precision where sphinxbase uses double, so the cepstra match it to a tolerance rather than
+ * bit for bit; SpeechRecognition.ValidateFrontEnd measures the difference.
+ *
+ * -remove_noise (on by default) follows fe_remove_noise: each mel band's smoothed power is compared with its tracked
+ * noise level, the difference is floored and temporally masked, and the band is scaled by a gain that is smoothed over
+ * neighbouring bands and clamped to 1/20..20. Frames that are not speech get the smallest gain.
+ * The VAD replaces sphinxbase's when -remove_silence is on: a frame is speech when a mel band rises -vad_threshold
+ * (a natural log ratio) above its tracked noise level, -vad_prespeech such frames in a row start speech, and are
+ * decoded along with it, and -vad_postspeech frames without speech end it.
+ *
+ * Used from one thread at a time.
+ */
+class FSpeechMfccFrontEnd
+{
+public:
+	enum class ETransform : uint8
+	{
+		Legacy,
+		Dct,
+		Htk
+	};
+
+	struct FSettings
+	{
+		float SampleRate = 16000.0f;
+		int32 FrameRate = 100;
+		float WindowLength = 0.025625f;
+		int32 FftSize = 512;
+		int32 NumFilters = 40;
+		float LowerFreq = 133.33334f;
+		float UpperFreq = 6855.4976f;
+		int32 NumCepstra = 13;
+		int32 Lifter = 0;
+		float PreEmphasis = 0.97f;
+		ETransform Transform = ETransform::Legacy;
+		bool bRemoveDC = false;
+		bool bUnitArea = true;
+		bool bRoundFilters = true;
+
+		bool bRemoveNoise = true;
+		bool bRemoveSilence = true;
+		float VadThreshold = 2.0f;
+		int32 VadPreSpeech = 10;
+		int32 VadPostSpeech = 50;
+	};
+
+	/** Reads the front end switches of a decoder config. False, with the reason logged, if it needs something not implemented here */
+	static bool ReadSettings(cmd_ln_t* Config, FSettings& OutSettings);
+
+	/** Builds the window, filters and transform. False if the settings are inconsistent */
+	bool Init(const FSettings& InSettings);
+
+	/** Starts a new stream: drops buffered samples, and the noise estimate */
+	void Reset();
+
+	/**
+	 * Consumes the samples, and returns the number of frames ready to decode, retrieved with GetFrames.
+	 * Frames are only valid until the next call. Samples short of a whole frame are kept for the next call
+	 */
+	int32 Process(const int16* Samples, int32 NumSamples);
+	mfcc_t** GetFrames() { return FramePointers.GetData(); }
+
+	/** Every frame of the samples, speech or not, ignoring the VAD. For checking against fe_process_frames */
+	int32 ProcessAll(const int16* Samples, int32 NumSamples);
+
+	bool IsInSpeech() const { return bInSpeech; }
+	const FSettings& GetSettings() const { return Settings; }
+	int32 GetFrameShift() const { return FrameShift; }
+	int32 GetFrameSize() const { return FrameSize; }
+
+private:
+	/** Cepstrum of the FrameSize samples at Frame, with Prior the sample before them. Leaves the mel spectrum in MelSpectrum */
+	void ComputeFrame(const int16* Frame, int16 FramePrior, float* OutCepstrum);
+
+	/** Updates the band powers and noise levels from the mel spectrum. Returns the largest band's log ratio to its noise */
+	float TrackNoise();
+
+	/** Scales the mel spectrum by fe_remove_noise's gains. bSpeech false attenuates every band */
+	void RemoveNoise(bool bSpeech);
+
+	/** The VAD's decision on the frame just computed */
+	bool IsSpeechFrame() const;
+
+	/** Hands the cepstrum to the decoder, or holds it as pre-speech, as the VAD decides */
+	void EmitFrame(const float* Cepstrum, bool bSpeech);
+	float* AddOutputFrame();
+
+	/** Frames the buffered samples. bVad false outputs every frame */
+	int32 ProcessFrames(const int16* Samples, int32 NumSamples, bool bVad);
+
+	FSettings Settings;
+	int32 FrameShift = 0;
+	int32 FrameSize = 0;
+
+	FSpeechRealFft Fft;
+	TArray<float> Window;
+	TArray<float> FrameBuffer;
+	TArray<float> Power;
+
+	// mel filters: for each, its first bin, width, and offset into the weights
+	TArray<int32> FilterStart;
+	TArray<int32> FilterWidth;
+	TArray<int32> FilterOffset;
+	TArray<float> FilterWeights;
+	TArray<float> MelSpectrum;
+	TArray<float> LogSpectrum;
+
+	// cosine transform, lifter and scaling, NumCepstra rows of NumFilters
+	TArray<float> Transform;
+
+	// samples from the start of the next frame, and the one before them
+	TArray<int16> Pending;
+	int16 Prior = 0;
+
+	// output of the last Process call
+	TArray<mfcc_t> Cepstra;
+	TArray<mfcc_t*> FramePointers;
+	int32 NumOutput = 0;
+	TArray<float> Cepstrum;
+
+	// noise tracking, shared by noise removal and the VAD
+	TArray<float> SmoothedPower;
+	TArray<float> NoisePower;
+	bool bHasNoise = false;
+	float FrameRatio = 0.0f;
+
+	// noise removal: the floor of the signal over the noise, its masking peak, and the band gains
+	TArray<float> SignalPower;
+	TArray<float> SignalFloor;
+	TArray<float> SignalPeak;
+	TArray<float> Gain;
+
+	// VAD
+	bool bInSpeech = false;
+	int32 SpeechRun = 0;
+	int32 SilenceRun = 0;
+	TArray<float> PreSpeech;
+	int32 PreSpeechHead = 0;
+	int32 PreSpeechNum = 0;
+};
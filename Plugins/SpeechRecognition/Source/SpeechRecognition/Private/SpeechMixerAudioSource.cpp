@@ -0,0 +1,233 @@
+#include "SpeechMixerAudioSource.h"
+#include "SpeechAudioDSP.h"
+#include "SpeechAudioRingBuffer.h"
+#include "SpeechRecognitionWorker.h"
+#include "AudioDevice.h"
+#include "Async/Async.h"
+#include "Sound/SoundSubmix.h"
+
+/**************************
+// Mixer
+**************************/
+FSpeechMixerAudioSource::FSpeechMixerAudioSource()
+	: Output(nullptr)
+	, Resampler(MakeUnique<FSpeechResampler>())
+{
+}
+
+FSpeechMixerAudioSource::~FSpeechMixerAudioSource()
+{
+}
+
+bool FSpeechMixerAudioSource::Open(int32 SampleRate)
+{
+	TargetSampleRate = SampleRate;
+	Resampler->Init(SampleRate, SampleRate);
+	return true;
+}
+
+void FSpeechMixerAudioSource::BindOutput(FSpeechAudioRingBuffer* InRingBuffer)
+{
+	Output.store(InRingBuffer, std::memory_order_release);
+}
+
+void FSpeechMixerAudioSource::PushAudio(const float* InterleavedAudio, int32 NumFrames, int32 NumChannels, int32 InSampleRate)
+{
+	FSpeechAudioRingBuffer* output = Output.load(std::memory_order_acquire);
+	if (output == nullptr || NumFrames <= 0 || NumChannels <= 0 || InSampleRate <= 0) {
+		return;
+	}
+
+	// scratch only grows until it fits the engine's callback size, after that this path does not allocate
+	const float* mono = InterleavedAudio;
+	if (NumChannels != 1) {
+		if (MonoScratch.Num() < NumFrames) {
+			MonoScratch.SetNumUninitialized(NumFrames);
+		}
+		SpeechAudioDSP::DownmixToMono(InterleavedAudio, NumFrames, NumChannels, MonoScratch.GetData());
+		mono = MonoScratch.GetData();
+	}
+
+	const float* samples = mono;
+	int32 numSamples = NumFrames;
+	if (InSampleRate != TargetSampleRate) {
+		if (Resampler->GetInputRate() != InSampleRate) {
+			Resampler->Init(InSampleRate, TargetSampleRate);
+		}
+		const int32 maxOutput = Resampler->GetMaxOutput(NumFrames);
+		if (ResampledScratch.Num() < maxOutput) {
+			ResampledScratch.SetNumUninitialized(maxOutput);
+		}
+		numSamples = Resampler->Process(mono, NumFrames, ResampledScratch.GetData(), maxOutput);
+		samples = ResampledScratch.GetData();
+	}
+
+	// convert straight into the capture buffer
+	int16* first;
+	int16* second;
+	int32 firstNum, secondNum;
+	const int32 reserved = output->BeginWrite(numSamples, first, firstNum, second, secondNum);
+	SpeechAudioDSP::ConvertFloatToInt16(samples, first, firstNum);
+	SpeechAudioDSP::ConvertFloatToInt16(samples + firstNum, second, secondNum);
+	output->EndWrite(reserved);
+}
+
+/**************************
+// AudioCapture
+**************************/
+FSpeechAudioCaptureSource::~FSpeechAudioCaptureSource()
+{
+	Close();
+}
+
+bool FSpeechAudioCaptureSource::Open(int32 SampleRate)
+{
+	FSpeechMixerAudioSource::Open(SampleRate);
+
+	Audio::FCaptureDeviceInfo deviceInfo;
+	if (AudioCapture.GetCaptureDeviceInfo(deviceInfo)) {
+		DeviceName = deviceInfo.DeviceName;
+	}
+
+	Audio::FAudioCaptureDeviceParams params;
+	Audio::FOnAudioCaptureFunction onCapture = [this](const void* InAudio, int32 NumFrames, int32 NumChannels, int32 InSampleRate, double StreamTime, bool bOverFlow)
+	{
+		PushAudio((const float*)InAudio, NumFrames, NumChannels, InSampleRate);
+	};
+
+	if (!AudioCapture.OpenAudioCaptureStream(params, MoveTemp(onCapture), 1024)) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to open the AudioCapture stream"));
+		return false;
+	}
+
+	if (!AudioCapture.StartStream()) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to start the AudioCapture stream"));
+		AudioCapture.CloseStream();
+		return false;
+	}
+
+	return true;
+}
+
+void FSpeechAudioCaptureSource::Close()
+{
+	// stopping the stream waits for any callback in flight, so nothing writes to the buffer once this returns
+	if (AudioCapture.IsStreamOpen()) {
+		AudioCapture.StopStream();
+		AudioCapture.CloseStream();
+	}
+	BindOutput(nullptr);
+}
+
+FString FSpeechAudioCaptureSource::GetDescription() const
+{
+	return FString::Printf(TEXT("AudioCapture (%s)"), DeviceName.IsEmpty() ? TEXT("default device") : *DeviceName);
+}
+
+/**************************
+// Submix
+**************************/
+class FSpeechSubmixTap : public ISubmixBufferListener
+{
+public:
+	explicit FSpeechSubmixTap(FSpeechSubmixAudioSource* InOwner)
+		: Owner(InOwner)
+	{
+	}
+
+	virtual void OnNewSubmixBuffer(const USoundSubmix* OwningSubmix, float* AudioData, int32 NumSamples, int32 NumChannels, const int32 SampleRate, double AudioClock) override
+	{
+		FScopeLock lock(&OwnerLock);
+		if (Owner != nullptr && NumChannels > 0) {
+			Owner->PushAudio(AudioData, NumSamples / NumChannels, NumChannels, SampleRate);
+		}
+	}
+
+	virtual const FString& GetListenerName() const override
+	{
+		static const FString ListenerName(TEXT("SpeechRecognitionSubmixTap"));
+		return ListenerName;
+	}
+
+	/** Unregistering is asynchronous, so the owner detaches itself here before it goes away */
+	void Detach()
+	{
+		FScopeLock lock(&OwnerLock);
+		Owner = nullptr;
+	}
+
+private:
+	FCriticalSection OwnerLock;
+	FSpeechSubmixAudioSource* Owner;
+};
+
+FSpeechSubmixAudioSource::FSpeechSubmixAudioSource(UWorld* InWorld, USoundSubmix* InSubmix)
+	: World(InWorld)
+	, Submix(InSubmix)
+	, SubmixName(InSubmix != nullptr ? InSubmix->GetName() : FString(TEXT("main submix")))
+{
+}
+
+FSpeechSubmixAudioSource::~FSpeechSubmixAudioSource()
+{
+	Close();
+}
+
+bool FSpeechSubmixAudioSource::Open(int32 SampleRate)
+{
+	Close();
+	FSpeechMixerAudioSource::Open(SampleRate);
+
+	if (!World.IsValid()) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Cannot tap %s, the world has gone away"), *SubmixName);
+		return false;
+	}
+
+	// listeners are registered from the game thread
+	Tap = MakeShared<FSpeechSubmixTap, ESPMode::ThreadSafe>(this);
+	AsyncTask(ENamedThreads::GameThread, [WeakWorld = World, WeakSubmix = Submix, bMainSubmix = Submix.IsExplicitlyNull(), RegisteredTap = Tap.ToSharedRef()]()
+	{
+		UWorld* world = WeakWorld.Get();
+		FAudioDevice* audioDevice = world != nullptr ? world->GetAudioDeviceRaw() : nullptr;
+		if (audioDevice == nullptr) {
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Cannot tap a submix, there is no audio device"));
+			return;
+		}
+
+		USoundSubmix* submix = bMainSubmix ? &audioDevice->GetMainSubmixObject() : WeakSubmix.Get();
+		if (submix != nullptr) {
+			audioDevice->RegisterSubmixBufferListener(RegisteredTap, *submix);
+		}
+	});
+
+	return true;
+}
+
+void FSpeechSubmixAudioSource::Close()
+{
+	if (!Tap.IsValid()) {
+		return;
+	}
+
+	Tap->Detach();
+	AsyncTask(ENamedThreads::GameThread, [WeakWorld = World, WeakSubmix = Submix, bMainSubmix = Submix.IsExplicitlyNull(), RegisteredTap = Tap.ToSharedRef()]()
+	{
+		UWorld* world = WeakWorld.Get();
+		FAudioDevice* audioDevice = world != nullptr ? world->GetAudioDeviceRaw() : nullptr;
+		if (audioDevice == nullptr) {
+			return;
+		}
+
+		USoundSubmix* submix = bMainSubmix ? &audioDevice->GetMainSubmixObject() : WeakSubmix.Get();
+		if (submix != nullptr) {
+			audioDevice->UnregisterSubmixBufferListener(RegisteredTap, *submix);
+		}
+	});
+	Tap.Reset();
+	BindOutput(nullptr);
+}
+
+FString FSpeechSubmixAudioSource::GetDescription() const
+{
+	return FString::Printf(TEXT("submix %s"), *SubmixName);
+}
@@ -0,0 +1,59 @@
+#include "SpeechModelCache.h"
+#include "SpeechDictionaryIndex.h"
+#include "SpeechRecognitionWorker.h"
+
+FSpeechModelCache::~FSpeechModelCache()
+{
+	// decoders hold their own references, so these only go once they are done with them
+	for (const TPair<float64, logmath_t*>& logMath : LogMaths) {
+		logmath_free(logMath.Value);
+	}
+}
+
+TSharedRef<const FSpeechDictionaryIndex, ESPMode::ThreadSafe> FSpeechModelCache::AcquireDictionaryIndex(const FString& DictionaryPath)
+{
+	FScopeLock lock(&Lock);
+
+	// shared while the dictionary is unchanged. An edited one is mapped again, and decoders still on the old mapping keep it
+	TSharedPtr<const FSpeechDictionaryIndex, ESPMode::ThreadSafe> index = DictionaryIndices.FindRef(DictionaryPath).Pin();
+	if (index.IsValid() && index->IsUpToDate()) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Sharing the dictionary index for %s with %d other decoders"), *DictionaryPath, index.GetSharedReferenceCount() - 1);
+		return index.ToSharedRef();
+	}
+
+	TSharedRef<FSpeechDictionaryIndex, ESPMode::ThreadSafe> newIndex = MakeShared<FSpeechDictionaryIndex, ESPMode::ThreadSafe>();
+	if (newIndex->Open(DictionaryPath)) {
+		DictionaryIndices.Add(DictionaryPath, newIndex);
+	}
+
+	// forget the ones nobody uses any more
+	for (TMap<FString, TWeakPtr<const FSpeechDictionaryIndex, ESPMode::ThreadSafe>>::TIterator it(DictionaryIndices); it; ++it) {
+		if (!it.Value().IsValid()) {
+			it.RemoveCurrent();
+		}
+	}
+	return newIndex;
+}
+
+logmath_t* FSpeechModelCache::AcquireLogMath(float64 Base)
+{
+	FScopeLock lock(&Lock);
+	logmath_t*& logMath = LogMaths.FindOrAdd(Base, nullptr);
+	if (logMath == nullptr) {
+		logMath = logmath_init(Base, 0, 0);
+		if (logMath == nullptr) {
+			LogMaths.Remove(Base);
+			return nullptr;
+		}
+	}
+	return logmath_retain(logMath);
+}
+
+void FSpeechModelCache::ReleaseLogMath(logmath_t* LogMath)
+{
+	// sphinxbase refcounts are not atomic, so they only change under the lock
+	FScopeLock lock(&Lock);
+	if (LogMath != nullptr) {
+		logmath_free(LogMath);
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <sphinxbase/logmath.h>
+
+#include "CoreMinimal.h"
+
+class FSpeechDictionaryIndex;
+
+/**
+ * Lookup data shared by every recognizer in the process, owned by the module.
+ *
+ * Worlds, including each PIE client, share one decoder through the module (ISpeechRecognition::AcquireWorker), so they
+ * load one acoustic model between them. The decoders that still coexist, a shared one being replaced and the batch
+ * transcriber's, each run their own ps_init. The dictionary index used to check keyphrases and trim the dictionary, and
+ * the log tables used to compile grammars, are the same for all of them, so the first decoder to ask loads them, and the
+ * rest share that copy. Entries are refcounted: the cache only holds weak references to dictionary indices, so the
+ * mapping goes away with the last decoder using it, and is reloaded when the dictionary file changes.
+ *
+ * Safe to use from any decode thread.
+ */
+class FSpeechModelCache
+{
+public:
+	~FSpeechModelCache();
+
+	/** The index for a dictionary, mapped by whichever decoder asked first. Never null, but not open if the dictionary could not be read */
+	TSharedRef<const FSpeechDictionaryIndex, ESPMode::ThreadSafe> AcquireDictionaryIndex(const FString& DictionaryPath);
+
+	/** Log tables for Base, retained for the caller until ReleaseLogMath */
+	logmath_t* AcquireLogMath(float64 Base);
+	void ReleaseLogMath(logmath_t* LogMath);
+
+private:
+	TMap<FString, TWeakPtr<const FSpeechDictionaryIndex, ESPMode::ThreadSafe>> DictionaryIndices;
+	TMap<float64, logmath_t*> LogMaths;
+	FCriticalSection Lock;
+};
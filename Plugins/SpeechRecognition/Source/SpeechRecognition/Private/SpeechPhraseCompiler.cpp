@@ -0,0 +1,172 @@
+#include "SpeechPhraseCompiler.h"
+#include "SpeechDictionaryIndex.h"
+#include "SpeechRecognitionWorker.h"
+
+std::string FSpeechPhraseCompiler::Normalize(const char* Phrase)
+{
+	std::string result;
+	result.reserve(strlen(Phrase));
+	bool bPendingSpace = false;
+	for (const char* c = Phrase; *c != '\0'; c++) {
+		const unsigned char ch = (unsigned char)*c;
+		if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+			bPendingSpace = !result.empty();
+			continue;
+		}
+		if (bPendingSpace) {
+			result += ' ';
+			bPendingSpace = false;
+		}
+		result += (ch >= 'A' && ch <= 'Z') ? (char)(ch - 'A' + 'a') : (char)ch;
+	}
+	return result;
+}
+
+std::string FSpeechPhraseCompiler::StripVariants(const std::string& Phrase)
+{
+	std::string result;
+	result.reserve(Phrase.size());
+	size_t i = 0;
+	while (i < Phrase.size()) {
+		// a variant suffix is a bracketed number closing a word
+		if (Phrase[i] == '(') {
+			size_t close = i + 1;
+			while (close < Phrase.size() && Phrase[close] >= '0' && Phrase[close] <= '9') {
+				close++;
+			}
+			if (close > i + 1 && close < Phrase.size() && Phrase[close] == ')' && (close + 1 == Phrase.size() || Phrase[close + 1] == ' ')) {
+				i = close + 1;
+				continue;
+			}
+		}
+		result += Phrase[i++];
+	}
+	return result;
+}
+
+bool FSpeechPhraseCompiler::GetPronunciations(const std::string& Word, const FSpeechDictionaryIndex& Index, TFunctionRef<bool(const char*)> IsDecoderWord, std::vector<std::string>& OutVariants)
+{
+	OutVariants.clear();
+
+	// read(2) pins that one pronunciation, read brings in all of them
+	if (StripVariants(Word).size() == Word.size()) {
+		const int32 wordIndex = Index.FindWord(Word.c_str(), (int32)Word.size());
+		if (wordIndex != INDEX_NONE) {
+			const int32 numVariants = Index.GetNumVariants(wordIndex);
+			for (int32 v = 0; v < numVariants; v++) {
+				OutVariants.push_back(Index.GetVariant(wordIndex, v));
+			}
+			return true;
+		}
+	}
+	else if (Index.Contains(Word.c_str())) {
+		OutVariants.push_back(Word);
+		return true;
+	}
+
+	if (IsDecoderWord(Word.c_str())) {
+		OutVariants.push_back(Word);
+		return true;
+	}
+	return false;
+}
+
+int32 FSpeechPhraseCompiler::Compile(const std::vector<std::pair<std::string, int32>>& InPhrases, const FSpeechDictionaryIndex& Index, TFunctionRef<bool(const char*)> IsDecoderWord)
+{
+	Phrases.clear();
+	Keyphrases.clear();
+	KeyphrasePointers.clear();
+	Thresholds.clear();
+	KeyphrasePhrase.clear();
+
+	std::unordered_map<std::string, int32> phraseIndices;
+	std::vector<std::vector<std::string>> options;
+	std::vector<size_t> choice;
+	std::string word;
+	std::string keyphrase;
+
+	for (const std::pair<std::string, int32>& phrase : InPhrases) {
+		const std::string& text = phrase.first;
+		if (text.empty()) {
+			continue;
+		}
+
+		// the text is normalised, so words are separated by exactly one space
+		size_t numWords = 0;
+		bool bKnown = true;
+		size_t start = 0;
+		while (start <= text.size()) {
+			size_t end = text.find(' ', start);
+			if (end == std::string::npos) {
+				end = text.size();
+			}
+			word.assign(text, start, end - start);
+			start = end + 1;
+
+			if (options.size() <= numWords) {
+				options.emplace_back();
+			}
+			if (!GetPronunciations(word, Index, IsDecoderWord, options[numWords])) {
+				UE_LOG(SpeechRecognitionPlugin, Log, TEXT("SKIPPED PHRASE: The phrase '%s' can not be added, as the word '%s' is not in the dictionary."), UTF8_TO_TCHAR(text.c_str()), UTF8_TO_TCHAR(word.c_str()));
+				bKnown = false;
+				break;
+			}
+			numWords++;
+		}
+		if (!bKnown) {
+			continue;
+		}
+
+		const std::pair<std::unordered_map<std::string, int32>::iterator, bool> reported = phraseIndices.emplace(StripVariants(text), (int32)Phrases.size());
+		if (reported.second) {
+			Phrases.push_back(reported.first->first);
+		}
+		const int32 phraseIndex = reported.first->second;
+
+		// walk every combination of pronunciations, first word fastest
+		choice.assign(numWords, 0);
+		int32 numExpanded = 0;
+		for (;;) {
+			if (numExpanded == MaxExpansions) {
+				UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The phrase '%s' has too many pronunciations, only the first %d are used"), UTF8_TO_TCHAR(text.c_str()), MaxExpansions);
+				break;
+			}
+
+			keyphrase.clear();
+			for (size_t w = 0; w < numWords; w++) {
+				if (w > 0) {
+					keyphrase += ' ';
+				}
+				keyphrase += options[w][choice[w]];
+			}
+			// the first phrase to produce a keyphrase keeps it, along with its threshold
+			if (KeyphrasePhrase.emplace(keyphrase, phraseIndex).second) {
+				Keyphrases.push_back(keyphrase);
+				Thresholds.push_back(phrase.second);
+			}
+			numExpanded++;
+
+			size_t w = 0;
+			while (w < numWords && ++choice[w] == options[w].size()) {
+				choice[w] = 0;
+				w++;
+			}
+			if (w == numWords) {
+				break;
+			}
+		}
+	}
+
+	// Keyphrases is complete, so its strings stay put
+	KeyphrasePointers.reserve(Keyphrases.size());
+	for (const std::string& compiled : Keyphrases) {
+		KeyphrasePointers.push_back(compiled.c_str());
+	}
+	return Num();
+}
+
+const std::string* FSpeechPhraseCompiler::FindPhrase(const char* Keyphrase) const
+{
+	const std::unordered_map<std::string, int32>::const_iterator found = KeyphrasePhrase.find(Keyphrase);
+	return found != KeyphrasePhrase.end() ? &Phrases[found->second] : nullptr;
+}
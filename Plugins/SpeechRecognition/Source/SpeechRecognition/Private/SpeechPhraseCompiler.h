@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Function.h"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class FSpeechDictionaryIndex;
+
+/**
+ * Turns a keyword list into the keyphrases handed to ps_set_keyphrase.
+ *
+ * A word written without a (n) suffix is expanded to every pronunciation the dictionary has for it, and a phrase becomes
+ * one keyphrase per combination, all sharing the phrase's threshold. Each keyphrase remembers the phrase it came from,
+ * so a detection of "read(2) it" is reported as "read it", and phrases that differ only in variants fold together.
+ *
+ * Normalising and splitting are single passes over the text, and every lookup is hashed or a binary search,
+ * so compiling is linear in the size of the keyword list.
+ */
+class FSpeechPhraseCompiler
+{
+public:
+	/** Most keyphrases a single phrase may expand to, the remaining combinations are dropped */
+	static constexpr int32 MaxExpansions = 64;
+
+	/** Lower cases Phrase, and collapses whitespace to single spaces, with none leading or trailing */
+	static std::string Normalize(const char* Phrase);
+
+	/** Phrase with every (n) pronunciation suffix removed */
+	static std::string StripVariants(const std::string& Phrase);
+
+	/**
+	 * Compiles normalised phrases and their thresholds against the dictionary index.
+	 * IsDecoderWord covers words the index does not have, like ones added with ps_add_word.
+	 * Phrases using a word neither knows are logged, and skipped. Returns the number of keyphrases.
+	 */
+	int32 Compile(const std::vector<std::pair<std::string, int32>>& InPhrases, const FSpeechDictionaryIndex& Index, TFunctionRef<bool(const char*)> IsDecoderWord);
+
+	int32 Num() const { return (int32)Keyphrases.size(); }
+
+	/** The keyphrases and their thresholds, valid until the next Compile */
+	const char** GetKeyphrases() { return KeyphrasePointers.data(); }
+	int32* GetThresholds() { return Thresholds.data(); }
+
+	/** The phrase a detected keyphrase was compiled from, or nullptr if it is not one of them */
+	const std::string* FindPhrase(const char* Keyphrase) const;
+
+private:
+	/** Every pronunciation of Word, or just Word itself if it names one. False if nothing knows the word */
+	static bool GetPronunciations(const std::string& Word, const FSpeechDictionaryIndex& Index, TFunctionRef<bool(const char*)> IsDecoderWord, std::vector<std::string>& OutVariants);
+
+	// phrases as they are reported
+	std::vector<std::string> Phrases;
+
+	// expanded keyphrases, in registration order
+	std::vector<std::string> Keyphrases;
+	std::vector<const char*> KeyphrasePointers;
+	std::vector<int32> Thresholds;
+
+	// keyphrase -> index into Phrases
+	std::unordered_map<std::string, int32> KeyphrasePhrase;
+};
@@ -1,11 +1,44 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
 #include "SpeechRecognition.h"
+#include "SpeechRecognitionStats.h"
+#include "SpeechRecognitionWorker.h"
+#include "SpeechModelCache.h"
+#include "Async/Async.h"
 
 IMPLEMENT_MODULE( FSpeechRecognition, SpeechRecognition )
 
+DEFINE_STAT(STAT_SpeechRecognition_DecodeWaitMs);
+DEFINE_STAT(STAT_SpeechRecognition_DecodeCpuPercent);
+DEFINE_STAT(STAT_SpeechRecognition_Wakeups);
+DEFINE_STAT(STAT_SpeechRecognition_SearchSwitch);
+DEFINE_STAT(STAT_SpeechRecognition_DictionaryWords);
+DEFINE_STAT(STAT_SpeechRecognition_DictionaryLoadMs);
+DEFINE_STAT(STAT_SpeechRecognition_DictionaryEntries);
+DEFINE_STAT(STAT_SpeechRecognition_DictionaryKB);
+DEFINE_STAT(STAT_SpeechRecognition_FullDictionaryEntries);
+DEFINE_STAT(STAT_SpeechRecognition_FullDictionaryKB);
+DEFINE_STAT(STAT_SpeechRecognition_GateOpen);
+DEFINE_STAT(STAT_SpeechRecognition_GateNoiseFloor);
+DEFINE_STAT(STAT_SpeechRecognition_GatedSamples);
+DEFINE_STAT(STAT_SpeechRecognition_AudioRead);
+DEFINE_STAT(STAT_SpeechRecognition_FrontEnd);
+DEFINE_STAT(STAT_SpeechRecognition_Decode);
+DEFINE_STAT(STAT_SpeechRecognition_VadTransition);
+DEFINE_STAT(STAT_SpeechRecognition_Hypothesis);
+DEFINE_STAT(STAT_SpeechRecognition_Dispatch);
+DEFINE_STAT(STAT_SpeechRecognition_RealTimeFactor);
+DEFINE_STAT(STAT_SpeechRecognition_FramesPerSecond);
+DEFINE_STAT(STAT_SpeechRecognition_ActiveSearch);
+DEFINE_STAT(STAT_SpeechRecognition_ResultDelayMs);
+DEFINE_STAT(STAT_SpeechRecognition_DispatchDelayMs);
+
+UE_TRACE_CHANNEL_DEFINE(SpeechRecognitionChannel);
+
 void FSpeechRecognition::StartupModule()
 {
+    ModelCache = new FSpeechModelCache();
+
     if(PLATFORM_WINDOWS) {
         //Search project plugins folder for Dll
         FString dllName = "SphinxBase.dll";
@@ -62,5 +95,103 @@ bool FSpeechRecognition::SearchForDllPath(const FString& _searchBase, FString _d
 
 void FSpeechRecognition::ShutdownModule()
 {
-	//TODO
+	FSpeechRecognitionWorker* shared;
+	{
+		FScopeLock lock(&WorkerLock);
+		shared = SharedWorker;
+		SharedWorker = nullptr;
+		NumWorkerRefs = 0;
+	}
+	if (shared != nullptr) {
+		shared->ShutDown();
+		delete shared;
+	}
+
+	// the recognizers still hold dictionary indices from the cache
+	TArray<TFuture<void>> pending;
+	{
+		FScopeLock lock(&ShutdownLock);
+		pending = MoveTemp(PendingShutdowns);
+	}
+	for (TFuture<void>& shutdown : pending) {
+		shutdown.Wait();
+	}
+
+	delete ModelCache;
+	ModelCache = nullptr;
+}
+
+void FSpeechRecognition::Preload(ESpeechRecognitionLanguage Language)
+{
+	FScopeLock lock(&WorkerLock);
+	if (SharedWorker == nullptr) {
+		CreateWorker(Language);
+	}
+}
+
+void FSpeechRecognition::CreateWorker(ESpeechRecognitionLanguage Language)
+{
+	// loads on its own thread, and waits until a subsystem acquires it. It is built with the params Init
+	// defaults to, so acquiring it does not rebuild it
+	LastLanguage = Language;
+	SharedWorker = new FSpeechRecognitionWorker();
+	SharedWorker->SetLanguage(Language);
+	SharedWorker->SetDefaultConfigParams(true);
+	SharedWorker->StartThread();
+	SharedWorker->Preload();
+}
+
+FSpeechRecognitionWorker* FSpeechRecognition::AcquireWorker(USpeechRecognitionSubsystem* Manager)
+{
+	// one decoder, one acoustic model and one capture for every world. Each world that joins only adds itself to the results
+	FScopeLock lock(&WorkerLock);
+	if (SharedWorker == nullptr) {
+		CreateWorker(LastLanguage);
+	}
+	NumWorkerRefs++;
+	SharedWorker->AddManager(Manager);
+	return SharedWorker;
+}
+
+void FSpeechRecognition::ReleaseWorker(USpeechRecognitionSubsystem* Manager, bool bUnload)
+{
+	FSpeechRecognitionWorker* unloaded = nullptr;
+	{
+		FScopeLock lock(&WorkerLock);
+		if (SharedWorker == nullptr) {
+			return;
+		}
+		SharedWorker->RemoveManager(Manager);
+		NumWorkerRefs = FMath::Max(NumWorkerRefs - 1, 0);
+		LastLanguage = SharedWorker->GetLanguage();
+
+		// other worlds still listening keep it
+		if (NumWorkerRefs > 0) {
+			if (bUnload) {
+				UE_LOG(SpeechRecognitionPlugin, Log, TEXT("The recognizer stays loaded: %d other worlds still use it"), NumWorkerRefs);
+			}
+		}
+		else if (bUnload) {
+			unloaded = SharedWorker;
+			SharedWorker = nullptr;
+		}
+	}
+	ShutDownWorker(unloaded);
+}
+
+void FSpeechRecognition::ShutDownWorker(FSpeechRecognitionWorker* Worker)
+{
+	if (Worker == nullptr) {
+		return;
+	}
+
+	// a worker inside ps_init only sees the stop once the model has loaded, which would hitch the game thread
+	Worker->Stop();
+	FScopeLock lock(&ShutdownLock);
+	PendingShutdowns.RemoveAll([](const TFuture<void>& shutdown) { return shutdown.IsReady(); });
+	PendingShutdowns.Add(Async(EAsyncExecution::ThreadPool, [Worker]()
+	{
+		Worker->ShutDown();
+		delete Worker;
+	}));
 }
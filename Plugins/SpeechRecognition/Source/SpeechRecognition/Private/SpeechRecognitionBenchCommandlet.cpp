@@ -0,0 +1,794 @@
+#include "SpeechRecognitionBenchCommandlet.h"
+
+#include "Dom/JsonObject.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Math/RandomStream.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "ISpeechRecognitionListener.h"
+#include "SpeechAudioSource.h"
+#include "SpeechRecognitionConfigAsset.h"
+#include "SpeechRecognitionSubsystem.h"
+#include "SpeechRecognitionWorker.h"
+#include <atomic>
+
+namespace
+{
+	// quiet time after a recording has been decoded, before its last result is taken as final
+	const double SettleSeconds = 0.25;
+	const double InitTimeoutSeconds = 120.0;
+
+	/** A recording, loaded before it is handed over, so a bad file is skipped rather than stopping the recognizer */
+	class FBenchAudioSource : public FSpeechFileAudioSource
+	{
+	public:
+		FBenchAudioSource(const FString& InFilePath, float InPlaybackSpeed)
+			: FSpeechFileAudioSource(InFilePath, InPlaybackSpeed)
+		{
+		}
+
+		bool Load(int32 SampleRate)
+		{
+			bLoaded = FSpeechFileAudioSource::Open(SampleRate);
+			return bLoaded;
+		}
+
+		virtual bool Open(int32 SampleRate) override
+		{
+			OpenTime = FPlatformTime::Seconds();
+			return bLoaded && FSpeechMemoryAudioSource::Open(SampleRate);
+		}
+
+		// the samples are kept, for GetDuration, until the source is released
+		virtual void Close() override {}
+
+		virtual int32 Read(int16* OutSamples, int32 MaxSamples) override
+		{
+			const int32 numRead = FSpeechMemoryAudioSource::Read(OutSamples, MaxSamples);
+			if (IsFinished() && FinishTime.load() == 0.0) {
+				FinishTime = FPlatformTime::Seconds();
+			}
+			return numRead;
+		}
+
+		// when the recognizer opened it, and took its last sample
+		std::atomic<double> OpenTime = 0.0;
+		std::atomic<double> FinishTime = 0.0;
+
+	private:
+		bool bLoaded = false;
+	};
+
+	/** What the recognizer reported for the recording being played. Called from the subsystem's Tick */
+	class FBenchListener : public ISpeechRecognitionListener
+	{
+	public:
+		virtual void OnStartedSpeaking() override
+		{
+			NumStarted++;
+			LastEventTime = FPlatformTime::Seconds();
+		}
+
+		virtual void OnStoppedSpeaking() override
+		{
+			NumStopped++;
+			LastEventTime = LastStoppedTime = FPlatformTime::Seconds();
+		}
+
+		virtual void OnWordsSpoken(const FRecognisedPhrases& Phrases) override
+		{
+			Results.Add(Phrases);
+			LastEventTime = FPlatformTime::Seconds();
+		}
+
+		virtual void OnUnknownPhrase() override
+		{
+			NumUnknown++;
+			LastEventTime = FPlatformTime::Seconds();
+		}
+
+		virtual void OnRecognizerReady(const FSpeechRecognizerLoadTimings& Timings) override
+		{
+			bReady = true;
+			ReadyTime = FPlatformTime::Seconds();
+			LoadTimings = Timings;
+		}
+
+		void BeginRecording()
+		{
+			Results.Reset();
+			NumUnknown = 0;
+			LastStoppedTime = 0.0;
+			LastEventTime = FPlatformTime::Seconds();
+		}
+
+		TArray<FRecognisedPhrases> Results;
+		int32 NumUnknown = 0;
+		// over every recording, so an utterance still open when one ends is waited for
+		int32 NumStarted = 0;
+		int32 NumStopped = 0;
+		double LastEventTime = 0.0;
+		double LastStoppedTime = 0.0;
+
+		bool bReady = false;
+		double ReadyTime = 0.0;
+		FSpeechRecognizerLoadTimings LoadTimings;
+	};
+
+	struct FBenchSettings
+	{
+		ESpeechRecognitionLanguage Language = ESpeechRecognitionLanguage::VE_English;
+		int32 SampleRate = 16000;
+		float PlaybackSpeed = 0.0f;
+		ESpeechRecognitionWaitMode WaitMode = ESpeechRecognitionWaitMode::VE_EVENT;
+
+		// background noise played in real time, with the energy gate on and off, for the idle cost
+		double IdleSeconds = 0.0;
+		float IdleDecibels = -50.0f;
+
+		bool bHasConfig = false;
+		FSpeechRecognitionConfig Config;
+
+		TArray<FRecognitionPhrase> Keywords;
+		FString Grammar;
+		FString LanguageModel;
+	};
+
+	struct FBenchRecording
+	{
+		FString File;
+		FString Name;
+		FString Reference;
+		bool bHasReference = false;
+	};
+
+	/** The figures the regression thresholds are checked against. Negative when the mode does not measure it */
+	struct FBenchModeSummary
+	{
+		bool bRan = false;
+		double WordErrorRate = -1.0;
+		double KeywordRecall = -1.0;
+		double RealTimeFactor = -1.0;
+	};
+
+	/** Lower case words without punctuation, so references and hypotheses compare alike */
+	TArray<FString> Tokenize(const FString& Text)
+	{
+		TArray<FString> words;
+		FString word;
+		for (TCHAR c : Text.ToLower()) {
+			if (FChar::IsAlnum(c) || c == TEXT('\'')) {
+				word.AppendChar(c);
+			}
+			else if (!word.IsEmpty()) {
+				words.Add(word);
+				word.Reset();
+			}
+		}
+		if (!word.IsEmpty()) {
+			words.Add(word);
+		}
+		return words;
+	}
+
+	/** <s>, <sil>, [NOISE] and ++NOISE++ are not words of the transcript */
+	bool IsFiller(const FString& Word)
+	{
+		return Word.StartsWith(TEXT("<")) || Word.StartsWith(TEXT("[")) || Word.StartsWith(TEXT("+"));
+	}
+
+	/** Substitutions, deletions and insertions turning the reference into the hypothesis */
+	int32 EditDistance(const TArray<FString>& Reference, const TArray<FString>& Hypothesis)
+	{
+		TArray<int32> previous;
+		TArray<int32> current;
+		previous.SetNumUninitialized(Hypothesis.Num() + 1);
+		current.SetNumUninitialized(Hypothesis.Num() + 1);
+		for (int32 j = 0; j <= Hypothesis.Num(); j++) {
+			previous[j] = j;
+		}
+		for (int32 i = 1; i <= Reference.Num(); i++) {
+			current[0] = i;
+			for (int32 j = 1; j <= Hypothesis.Num(); j++) {
+				const int32 substitution = previous[j - 1] + (Reference[i - 1] == Hypothesis[j - 1] ? 0 : 1);
+				current[j] = FMath::Min3(substitution, previous[j] + 1, current[j - 1] + 1);
+			}
+			Swap(previous, current);
+		}
+		return previous[Hypothesis.Num()];
+	}
+
+	/** Times the phrase occurs in the words, without overlapping */
+	int32 CountOccurrences(const TArray<FString>& Words, const TArray<FString>& Phrase)
+	{
+		int32 count = 0;
+		if (Phrase.Num() == 0) {
+			return 0;
+		}
+		for (int32 i = 0; i + Phrase.Num() <= Words.Num();) {
+			bool match = true;
+			for (int32 j = 0; j < Phrase.Num() && match; j++) {
+				match = Words[i + j] == Phrase[j];
+			}
+			i += match ? Phrase.Num() : 1;
+			count += match ? 1 : 0;
+		}
+		return count;
+	}
+
+	/** Nearest rank, of samples already sorted */
+	double Percentile(const TArray<double>& Sorted, double P)
+	{
+		if (Sorted.Num() == 0) {
+			return 0.0;
+		}
+		const int32 index = FMath::CeilToInt32(P * Sorted.Num()) - 1;
+		return Sorted[FMath::Clamp(index, 0, Sorted.Num() - 1)];
+	}
+
+	bool ParseLanguage(const FString& Name, ESpeechRecognitionLanguage& OutLanguage)
+	{
+		const UEnum* languageEnum = StaticEnum<ESpeechRecognitionLanguage>();
+		for (int32 i = 0; i < languageEnum->NumEnums() - 1; i++) {
+			if (languageEnum->GetDisplayNameTextByIndex(i).ToString().Equals(Name, ESearchCase::IgnoreCase)
+				|| languageEnum->GetNameStringByIndex(i).Equals(Name, ESearchCase::IgnoreCase)) {
+				OutLanguage = (ESpeechRecognitionLanguage)languageEnum->GetValueByIndex(i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/** One phrase per line, optionally followed by |<tolerance 1-10>. Lines starting with # are comments */
+	bool LoadKeywords(const FString& FilePath, TArray<FRecognitionPhrase>& OutKeywords)
+	{
+		TArray<FString> lines;
+		if (!FFileHelper::LoadFileToStringArray(lines, *FilePath)) {
+			return false;
+		}
+		for (const FString& line : lines) {
+			FString phrase = line.TrimStartAndEnd();
+			if (phrase.IsEmpty() || phrase.StartsWith(TEXT("#"))) {
+				continue;
+			}
+			int32 tolerance = 5;
+			FString left;
+			FString toleranceText;
+			if (phrase.Split(TEXT("|"), &left, &toleranceText, ESearchCase::CaseSensitive, ESearchDir::FromEnd)) {
+				tolerance = FMath::Clamp(FCString::Atoi(*toleranceText), 1, 10);
+				phrase = left.TrimEnd();
+			}
+			OutKeywords.Emplace(phrase.ToLower(), (EPhraseRecognitionTolerance)(tolerance - 1));
+		}
+		return OutKeywords.Num() > 0;
+	}
+
+	void Pump(USpeechRecognitionSubsystem* Speech)
+	{
+		Speech->Tick(0.005f);
+		FPlatformProcess::Sleep(0.005f);
+	}
+
+	/** Starts a new recognizer on the mode's search, as the game would. Returns false if the search could not be enabled */
+	bool StartRecognizer(USpeechRecognitionSubsystem* Speech, const FString& Mode, const FBenchSettings& Settings, const TSharedRef<FJsonObject>& Json)
+	{
+		bool bEnabled = Speech->Init(Settings.Language);
+		Speech->SetAudioWaitMode(Settings.WaitMode);
+		if (Settings.bHasConfig) {
+			Speech->ApplyConfig(Settings.Config);
+		}
+		if (Mode == TEXT("keyword")) {
+			Json->SetStringField(TEXT("Search"), TEXT("keyphrase_search"));
+			bEnabled = bEnabled && Speech->EnableKeywordMode(Settings.Keywords);
+		}
+		else if (Mode == TEXT("grammar")) {
+			Json->SetStringField(TEXT("Search"), TEXT("grammar:") + Settings.Grammar);
+			bEnabled = bEnabled && Speech->EnableGrammarMode(Settings.Grammar);
+		}
+		else {
+			Json->SetStringField(TEXT("Search"), TEXT("lm:") + Settings.LanguageModel);
+			bEnabled = bEnabled && Speech->EnableLanguageModel(Settings.LanguageModel);
+		}
+		return bEnabled;
+	}
+
+	TSharedRef<FJsonObject> RunMode(UWorld* World, const FString& Mode, const FBenchSettings& Settings, const TArray<FBenchRecording>& Recordings, FBenchModeSummary& OutSummary)
+	{
+		TSharedRef<FJsonObject> json = MakeShared<FJsonObject>();
+		json->SetStringField(TEXT("Mode"), Mode);
+		const bool bKeywords = Mode == TEXT("keyword");
+
+		USpeechRecognitionSubsystem* speech = World->GetSubsystem<USpeechRecognitionSubsystem>();
+		if (speech == nullptr) {
+			json->SetStringField(TEXT("Error"), TEXT("No speech recognition subsystem"));
+			return json;
+		}
+
+		FBenchListener listener;
+		speech->AddListener(&listener, ESpeechListenerThread::GameThread);
+
+		// a new recognizer for each mode, so each one's init is measured from cold
+		const double initStart = FPlatformTime::Seconds();
+		bool bEnabled = StartRecognizer(speech, Mode, Settings, json);
+
+		TArray<TArray<FString>> keywordWords;
+		for (const FRecognitionPhrase& keyword : Settings.Keywords) {
+			keywordWords.Add(Tokenize(keyword.phrase));
+		}
+
+		TArray<TSharedPtr<FJsonValue>> files;
+		TArray<double> finalizationMs;
+		double totalAudioSeconds = 0.0;
+		double totalWallSeconds = 0.0;
+		int32 totalErrors = 0;
+		int32 totalReferenceWords = 0;
+		int32 totalKeywordHits = 0;
+		int32 totalKeywordReferences = 0;
+		int32 totalFalseAlarms = 0;
+		int32 numTimedOut = 0;
+		FString error;
+
+		for (int32 index = 0; index < Recordings.Num() && bEnabled && error.IsEmpty(); index++) {
+			const FBenchRecording& recording = Recordings[index];
+			TSharedRef<FJsonObject> file = MakeShared<FJsonObject>();
+			file->SetStringField(TEXT("File"), recording.Name);
+			files.Add(MakeShared<FJsonValueObject>(file));
+
+			TSharedRef<FBenchAudioSource> source = MakeShared<FBenchAudioSource>(recording.File, Settings.PlaybackSpeed);
+			if (!source->Load(Settings.SampleRate)) {
+				file->SetStringField(TEXT("Error"), FString::Printf(TEXT("Not 16-bit mono at %d Hz, or unreadable"), Settings.SampleRate));
+				continue;
+			}
+
+			// the first recording is set before the recognizer is ready, so it never opens the recording device
+			listener.BeginRecording();
+			speech->SetAudioSource(source);
+			if (!listener.bReady) {
+				const double deadline = FPlatformTime::Seconds() + InitTimeoutSeconds;
+				while (!listener.bReady && FPlatformTime::Seconds() < deadline) {
+					Pump(speech);
+				}
+				if (!listener.bReady) {
+					error = TEXT("The recognizer did not start");
+					break;
+				}
+
+				const FSpeechRecognizerLoadTimings& timings = listener.LoadTimings;
+				TSharedRef<FJsonObject> init = MakeShared<FJsonObject>();
+				init->SetNumberField(TEXT("WallMs"), (listener.ReadyTime - initStart) * 1000.0);
+				init->SetNumberField(TEXT("ConfigMs"), timings.ConfigMs);
+				init->SetNumberField(TEXT("DictionaryMs"), timings.DictionaryMs);
+				init->SetNumberField(TEXT("DecoderMs"), timings.DecoderMs);
+				init->SetNumberField(TEXT("SearchesMs"), timings.SearchesMs);
+				init->SetNumberField(TEXT("CaptureMs"), timings.CaptureMs);
+				init->SetNumberField(TEXT("TotalMs"), timings.TotalMs);
+				json->SetObjectField(TEXT("Init"), init);
+			}
+
+			// done once every sample is decoded, the last utterance has ended, and nothing more arrived for a moment
+			const double audioSeconds = source->GetDuration();
+			const double deadline = FPlatformTime::Seconds() + 30.0 + audioSeconds * FMath::Max(10.0, Settings.PlaybackSpeed > 0.0f ? 2.0 / Settings.PlaybackSpeed : 0.0);
+			bool bTimedOut = false;
+			for (;;) {
+				Pump(speech);
+				const double now = FPlatformTime::Seconds();
+				const double finishTime = source->FinishTime.load();
+				if (finishTime > 0.0 && speech->IsAudioSourceFinished() && listener.NumStarted == listener.NumStopped
+					&& now - FMath::Max(finishTime, listener.LastEventTime) > SettleSeconds) {
+					break;
+				}
+				if (now > deadline) {
+					bTimedOut = true;
+					break;
+				}
+			}
+
+			const double openTime = source->OpenTime.load();
+			const double wallSeconds = openTime > 0.0 ? FMath::Max(source->FinishTime.load(), listener.LastStoppedTime) - openTime : 0.0;
+			totalAudioSeconds += audioSeconds;
+			totalWallSeconds += wallSeconds;
+			numTimedOut += bTimedOut ? 1 : 0;
+
+			// keyword searches report each detection as one word, the whole phrase
+			TArray<FString> hypothesisWords;
+			TArray<TArray<FString>> detections;
+			TArray<FString> hypothesisText;
+			TArray<TSharedPtr<FJsonValue>> utterances;
+			for (const FRecognisedPhrases& phrases : listener.Results) {
+				TArray<FString> text;
+				for (const FRecognisedWord& word : phrases.Words) {
+					const FString& wordText = word.Word;
+					if (IsFiller(wordText)) {
+						continue;
+					}
+					text.Add(wordText);
+					if (bKeywords) {
+						detections.Add(Tokenize(wordText));
+					}
+					else {
+						hypothesisWords.Append(Tokenize(wordText));
+					}
+				}
+
+				const double latencyMs = (phrases.HypothesisTime - phrases.SpeechEndTime) * 1000.0;
+				finalizationMs.Add(latencyMs);
+
+				TSharedRef<FJsonObject> utterance = MakeShared<FJsonObject>();
+				utterance->SetStringField(TEXT("Text"), FString::Join(text, TEXT(" ")));
+				utterance->SetNumberField(TEXT("FinalizationMs"), latencyMs);
+				utterances.Add(MakeShared<FJsonValueObject>(utterance));
+				hypothesisText.Append(text);
+			}
+
+			file->SetNumberField(TEXT("AudioSeconds"), audioSeconds);
+			file->SetNumberField(TEXT("WallSeconds"), wallSeconds);
+			file->SetNumberField(TEXT("RealTimeFactor"), audioSeconds > 0.0 ? wallSeconds / audioSeconds : 0.0);
+			file->SetStringField(TEXT("Hypothesis"), FString::Join(hypothesisText, TEXT(" ")));
+			file->SetArrayField(TEXT("Utterances"), utterances);
+			file->SetNumberField(TEXT("UnknownPhrases"), listener.NumUnknown);
+			file->SetBoolField(TEXT("TimedOut"), bTimedOut);
+			if (!recording.bHasReference) {
+				continue;
+			}
+			file->SetStringField(TEXT("Reference"), recording.Reference);
+
+			const TArray<FString> referenceWords = Tokenize(recording.Reference);
+			if (bKeywords) {
+				int32 hits = 0;
+				int32 references = 0;
+				int32 falseAlarms = 0;
+				for (const TArray<FString>& keyword : keywordWords) {
+					const int32 expected = CountOccurrences(referenceWords, keyword);
+					const int32 detected = detections.FilterByPredicate([&keyword](const TArray<FString>& detection) { return detection == keyword; }).Num();
+					hits += FMath::Min(expected, detected);
+					falseAlarms += FMath::Max(detected - expected, 0);
+					references += expected;
+				}
+				file->SetNumberField(TEXT("KeywordHits"), hits);
+				file->SetNumberField(TEXT("KeywordReferences"), references);
+				file->SetNumberField(TEXT("FalseAlarms"), falseAlarms);
+				totalKeywordHits += hits;
+				totalKeywordReferences += references;
+				totalFalseAlarms += falseAlarms;
+			}
+			else {
+				const int32 errors = EditDistance(referenceWords, hypothesisWords);
+				file->SetNumberField(TEXT("Errors"), errors);
+				file->SetNumberField(TEXT("ReferenceWords"), referenceWords.Num());
+				file->SetNumberField(TEXT("WER"), referenceWords.Num() > 0 ? (double)errors / referenceWords.Num() : 0.0);
+				totalErrors += errors;
+				totalReferenceWords += referenceWords.Num();
+			}
+		}
+
+		// the decode thread's CPU over the whole mode, init aside, in the wait mode it ran in
+		const FSpeechRecognitionAudioStats audioStats = speech->GetAudioStats();
+		const bool bPoll = Settings.WaitMode == ESpeechRecognitionWaitMode::VE_POLL;
+		speech->RemoveListener(&listener);
+		speech->Shutdown();
+
+		if (!bEnabled) {
+			error = FString::Printf(TEXT("Could not enable %s mode"), *Mode);
+		}
+		if (!error.IsEmpty()) {
+			json->SetStringField(TEXT("Error"), error);
+			return json;
+		}
+
+		OutSummary.bRan = true;
+		OutSummary.RealTimeFactor = totalAudioSeconds > 0.0 ? totalWallSeconds / totalAudioSeconds : 0.0;
+		json->SetNumberField(TEXT("AudioSeconds"), totalAudioSeconds);
+		json->SetNumberField(TEXT("WallSeconds"), totalWallSeconds);
+		json->SetNumberField(TEXT("RealTimeFactor"), OutSummary.RealTimeFactor);
+		json->SetNumberField(TEXT("TimedOut"), numTimedOut);
+		json->SetNumberField(TEXT("DecodeCpuSeconds"), bPoll ? audioStats.DecodeCpuSecondsPoll : audioStats.DecodeCpuSecondsEvent);
+		json->SetNumberField(TEXT("DecodeCpuLoad"), bPoll ? audioStats.DecodeCpuLoadPoll : audioStats.DecodeCpuLoadEvent);
+
+		if (bKeywords) {
+			if (totalKeywordReferences > 0) {
+				OutSummary.KeywordRecall = (double)totalKeywordHits / totalKeywordReferences;
+				json->SetNumberField(TEXT("KeywordRecall"), OutSummary.KeywordRecall);
+			}
+			json->SetNumberField(TEXT("KeywordHits"), totalKeywordHits);
+			json->SetNumberField(TEXT("KeywordReferences"), totalKeywordReferences);
+			json->SetNumberField(TEXT("FalseAlarms"), totalFalseAlarms);
+			json->SetNumberField(TEXT("FalseAlarmsPerHour"), totalAudioSeconds > 0.0 ? totalFalseAlarms * 3600.0 / totalAudioSeconds : 0.0);
+		}
+		else {
+			if (totalReferenceWords > 0) {
+				OutSummary.WordErrorRate = (double)totalErrors / totalReferenceWords;
+				json->SetNumberField(TEXT("WER"), OutSummary.WordErrorRate);
+			}
+			json->SetNumberField(TEXT("Errors"), totalErrors);
+			json->SetNumberField(TEXT("ReferenceWords"), totalReferenceWords);
+		}
+
+		finalizationMs.Sort();
+		double sumMs = 0.0;
+		for (double latencyMs : finalizationMs) {
+			sumMs += latencyMs;
+		}
+		TSharedRef<FJsonObject> finalization = MakeShared<FJsonObject>();
+		finalization->SetNumberField(TEXT("Utterances"), finalizationMs.Num());
+		finalization->SetNumberField(TEXT("MeanMs"), finalizationMs.Num() > 0 ? sumMs / finalizationMs.Num() : 0.0);
+		finalization->SetNumberField(TEXT("P50Ms"), Percentile(finalizationMs, 0.50));
+		finalization->SetNumberField(TEXT("P95Ms"), Percentile(finalizationMs, 0.95));
+		finalization->SetNumberField(TEXT("P99Ms"), Percentile(finalizationMs, 0.99));
+		finalization->SetNumberField(TEXT("MaxMs"), finalizationMs.Num() > 0 ? finalizationMs.Last() : 0.0);
+		json->SetObjectField(TEXT("Finalization"), finalization);
+
+		// the process' peak so far, so it covers this mode and the ones before it
+		json->SetNumberField(TEXT("PeakRSSMB"), FPlatformMemory::GetStats().PeakUsedPhysical / (1024.0 * 1024.0));
+		json->SetArrayField(TEXT("Files"), files);
+		return json;
+	}
+
+	/**
+	 * Plays Settings.IdleSeconds of steady noise in real time, and measures the decode thread's CPU over it.
+	 * A streamer is silent most of the time, so this is what the recognizer costs while nobody talks
+	 */
+	TSharedRef<FJsonObject> RunIdle(UWorld* World, const FString& Mode, const FBenchSettings& Settings, bool bEnergyGate)
+	{
+		TSharedRef<FJsonObject> json = MakeShared<FJsonObject>();
+		USpeechRecognitionSubsystem* speech = World->GetSubsystem<USpeechRecognitionSubsystem>();
+		if (speech == nullptr) {
+			json->SetStringField(TEXT("Error"), TEXT("No speech recognition subsystem"));
+			return json;
+		}
+
+		// white noise at the requested RMS level. Uniform noise has an RMS of its peak over sqrt(3)
+		TArray<int16> noise;
+		noise.SetNumUninitialized(FMath::CeilToInt32(Settings.IdleSeconds * Settings.SampleRate));
+		const float peak = FMath::Min(32767.0f * FMath::Pow(10.0f, Settings.IdleDecibels / 20.0f) * FMath::Sqrt(3.0f), 32767.0f);
+		FRandomStream random(1);
+		for (int16& sample : noise) {
+			sample = (int16)FMath::RoundToInt32(random.FRandRange(-peak, peak));
+		}
+
+		FBenchListener listener;
+		speech->AddListener(&listener, ESpeechListenerThread::GameThread);
+		bool bEnabled = StartRecognizer(speech, Mode, Settings, json);
+		FSpeechEnergyGateSettings gate;
+		gate.bEnabled = bEnergyGate;
+		speech->SetEnergyGate(gate);
+		speech->SetAudioSource(MakeShared<FSpeechMemoryAudioSource>(MoveTemp(noise), Settings.SampleRate, 1.0f));
+
+		const double deadline = FPlatformTime::Seconds() + InitTimeoutSeconds + Settings.IdleSeconds * 2.0;
+		while (bEnabled && !(listener.bReady && speech->IsAudioSourceFinished())) {
+			Pump(speech);
+			if (FPlatformTime::Seconds() > deadline) {
+				bEnabled = false;
+			}
+		}
+
+		const FSpeechRecognitionAudioStats audioStats = speech->GetAudioStats();
+		const bool bPoll = Settings.WaitMode == ESpeechRecognitionWaitMode::VE_POLL;
+		speech->RemoveListener(&listener);
+		speech->Shutdown();
+		if (!bEnabled) {
+			json->SetStringField(TEXT("Error"), TEXT("The recognizer did not start, or did not finish in time"));
+			return json;
+		}
+		json->SetBoolField(TEXT("EnergyGate"), bEnergyGate);
+		json->SetNumberField(TEXT("DecodeCpuSeconds"), bPoll ? audioStats.DecodeCpuSecondsPoll : audioStats.DecodeCpuSecondsEvent);
+		json->SetNumberField(TEXT("DecodeCpuLoad"), bPoll ? audioStats.DecodeCpuLoadPoll : audioStats.DecodeCpuLoadEvent);
+		json->SetNumberField(TEXT("GatedSamples"), (double)audioStats.GatedSamples);
+		json->SetNumberField(TEXT("NoiseFloorDecibels"), audioStats.NoiseFloorDecibels);
+		json->SetNumberField(TEXT("Utterances"), listener.NumStarted);
+		return json;
+	}
+}
+
+USpeechRecognitionBenchCommandlet::USpeechRecognitionBenchCommandlet()
+{
+	LogToConsole = true;
+	HelpDescription = TEXT("Replays recordings with reference transcripts through the speech recognizer, and reports WER, keyword recall, speed and latency as JSON");
+	HelpUsage = TEXT("-run=SpeechRecognitionBench -Dir=<recordings> [-Out=<report.json>] [-Modes=keyword,grammar,lm] [-Keywords=<file>] [-Grammar=<name>] [-LM=<name>] [-Config=(...)] [-Speed=0] [-WaitMode=Event|Poll] [-IdleSeconds=60] [-IdleLevel=-50]");
+}
+
+int32 USpeechRecognitionBenchCommandlet::Main(const FString& Params)
+{
+	FString dir;
+	if (!FParse::Value(*Params, TEXT("Dir="), dir)) {
+		UE_LOG(SpeechRecognitionPlugin, Error, TEXT("Usage: %s"), *HelpUsage);
+		return 1;
+	}
+	dir = FPaths::ConvertRelativePathToFull(dir);
+
+	FBenchSettings settings;
+	FString languageName;
+	if (FParse::Value(*Params, TEXT("Language="), languageName) && !ParseLanguage(languageName, settings.Language)) {
+		UE_LOG(SpeechRecognitionPlugin, Error, TEXT("Unknown language %s"), *languageName);
+		return 1;
+	}
+	FParse::Value(*Params, TEXT("SampleRate="), settings.SampleRate);
+	FParse::Value(*Params, TEXT("Speed="), settings.PlaybackSpeed);
+	FString waitModeName;
+	if (FParse::Value(*Params, TEXT("WaitMode="), waitModeName)) {
+		settings.WaitMode = waitModeName.Equals(TEXT("Poll"), ESearchCase::IgnoreCase) ? ESpeechRecognitionWaitMode::VE_POLL : ESpeechRecognitionWaitMode::VE_EVENT;
+	}
+	FParse::Value(*Params, TEXT("IdleSeconds="), settings.IdleSeconds);
+	FParse::Value(*Params, TEXT("IdleLevel="), settings.IdleDecibels);
+
+	// an asset first, then fields of -Config on top of it
+	FString assetPath;
+	if (FParse::Value(*Params, TEXT("ConfigAsset="), assetPath)) {
+		const USpeechRecognitionConfigAsset* asset = LoadObject<USpeechRecognitionConfigAsset>(nullptr, *assetPath);
+		if (asset == nullptr) {
+			UE_LOG(SpeechRecognitionPlugin, Error, TEXT("Could not load config asset %s"), *assetPath);
+			return 1;
+		}
+		settings.Config = asset->Config;
+		settings.bHasConfig = true;
+	}
+	FString configText;
+	if (FParse::Value(*Params, TEXT("Config="), configText, false)) {
+		if (FSpeechRecognitionConfig::StaticStruct()->ImportText(*configText, &settings.Config, nullptr, PPF_None, GWarn, TEXT("Config")) == nullptr) {
+			UE_LOG(SpeechRecognitionPlugin, Error, TEXT("Could not read -Config=%s"), *configText);
+			return 1;
+		}
+		settings.bHasConfig = true;
+	}
+
+	FString keywordsPath;
+	if (FParse::Value(*Params, TEXT("Keywords="), keywordsPath) && !LoadKeywords(keywordsPath, settings.Keywords)) {
+		UE_LOG(SpeechRecognitionPlugin, Error, TEXT("No keywords in %s"), *keywordsPath);
+		return 1;
+	}
+	FParse::Value(*Params, TEXT("Grammar="), settings.Grammar);
+	FParse::Value(*Params, TEXT("LM="), settings.LanguageModel);
+
+	// every mode there is input for, unless they are named
+	TArray<FString> modes;
+	FString modesText;
+	if (FParse::Value(*Params, TEXT("Modes="), modesText, false)) {
+		modesText.ToLower().ParseIntoArray(modes, TEXT(","));
+	}
+	else {
+		if (settings.Keywords.Num() > 0) {
+			modes.Add(TEXT("keyword"));
+		}
+		if (!settings.Grammar.IsEmpty()) {
+			modes.Add(TEXT("grammar"));
+		}
+		if (!settings.LanguageModel.IsEmpty()) {
+			modes.Add(TEXT("lm"));
+		}
+	}
+	for (const FString& mode : modes) {
+		const bool bHasInput = (mode == TEXT("keyword") && settings.Keywords.Num() > 0) || (mode == TEXT("grammar") && !settings.Grammar.IsEmpty())
+			|| (mode == TEXT("lm") && !settings.LanguageModel.IsEmpty());
+		if (!bHasInput) {
+			UE_LOG(SpeechRecognitionPlugin, Error, TEXT("Mode %s needs -Keywords, -Grammar or -LM, and is one of keyword, grammar, lm"), *mode);
+			return 1;
+		}
+	}
+	if (modes.Num() == 0) {
+		UE_LOG(SpeechRecognitionPlugin, Error, TEXT("Nothing to run: pass -Keywords, -Grammar or -LM"));
+		return 1;
+	}
+
+	// in name order, so runs compare file for file
+	TArray<FString> files;
+	IFileManager::Get().FindFilesRecursive(files, *dir, TEXT("*.wav"), true, false);
+	files.Sort();
+	TArray<FBenchRecording> recordings;
+	for (const FString& file : files) {
+		FBenchRecording& recording = recordings.AddDefaulted_GetRef();
+		recording.File = file;
+		recording.Name = file;
+		FPaths::MakePathRelativeTo(recording.Name, *(dir / TEXT("")));
+		recording.bHasReference = FFileHelper::LoadFileToString(recording.Reference, *FPaths::ChangeExtension(file, TEXT("txt")));
+		recording.Reference.TrimStartAndEndInline();
+	}
+	if (recordings.Num() == 0) {
+		UE_LOG(SpeechRecognitionPlugin, Error, TEXT("No .wav files in %s"), *dir);
+		return 1;
+	}
+
+	// not a game world: those preload a recognizer as they start, which Init would take over, and each mode is timed from cold
+	UWorld* world = UWorld::CreateWorld(EWorldType::Editor, false, TEXT("SpeechRecognitionBench"));
+
+	TArray<FString> regressions;
+	TArray<TSharedPtr<FJsonValue>> modeResults;
+	double maxWer = -1.0;
+	double minRecall = -1.0;
+	double maxRtf = -1.0;
+	FParse::Value(*Params, TEXT("MaxWER="), maxWer);
+	FParse::Value(*Params, TEXT("MinRecall="), minRecall);
+	FParse::Value(*Params, TEXT("MaxRTF="), maxRtf);
+
+	for (const FString& mode : modes) {
+		UE_LOG(SpeechRecognitionPlugin, Display, TEXT("Benchmarking %s mode on %d recordings"), *mode, recordings.Num());
+		FBenchModeSummary summary;
+		modeResults.Add(MakeShared<FJsonValueObject>(RunMode(world, mode, settings, recordings, summary)));
+
+		if (!summary.bRan) {
+			regressions.Add(FString::Printf(TEXT("%s: did not run"), *mode));
+			continue;
+		}
+		if (maxWer >= 0.0 && summary.WordErrorRate > maxWer) {
+			regressions.Add(FString::Printf(TEXT("%s: WER %.4f above %.4f"), *mode, summary.WordErrorRate, maxWer));
+		}
+		if (minRecall >= 0.0 && summary.KeywordRecall >= 0.0 && summary.KeywordRecall < minRecall) {
+			regressions.Add(FString::Printf(TEXT("%s: keyword recall %.4f below %.4f"), *mode, summary.KeywordRecall, minRecall));
+		}
+		if (maxRtf >= 0.0 && summary.RealTimeFactor > maxRtf) {
+			regressions.Add(FString::Printf(TEXT("%s: real-time factor %.4f above %.4f"), *mode, summary.RealTimeFactor, maxRtf));
+		}
+	}
+
+	// the same noise with the gate on and off, on the first mode's search
+	TSharedPtr<FJsonObject> idle;
+	if (settings.IdleSeconds > 0.0) {
+		UE_LOG(SpeechRecognitionPlugin, Display, TEXT("Measuring %.0f s of idle noise at %.0f dBFS, with the energy gate on and off"), settings.IdleSeconds, settings.IdleDecibels);
+		const TSharedRef<FJsonObject> gateOn = RunIdle(world, modes[0], settings, true);
+		const TSharedRef<FJsonObject> gateOff = RunIdle(world, modes[0], settings, false);
+		idle = MakeShared<FJsonObject>();
+		idle->SetNumberField(TEXT("Seconds"), settings.IdleSeconds);
+		idle->SetNumberField(TEXT("LevelDecibels"), settings.IdleDecibels);
+		idle->SetObjectField(TEXT("GateOn"), gateOn);
+		idle->SetObjectField(TEXT("GateOff"), gateOff);
+
+		// how much of the idle decode cost the gate takes away. -1 when the thread's CPU time can't be read here
+		const double cpuOn = gateOn->GetNumberField(TEXT("DecodeCpuSeconds"));
+		const double cpuOff = gateOff->GetNumberField(TEXT("DecodeCpuSeconds"));
+		idle->SetNumberField(TEXT("CpuSaved"), cpuOn >= 0.0 && cpuOff > 0.0 ? 1.0 - cpuOn / cpuOff : -1.0);
+		if (gateOn->HasField(TEXT("Error")) || gateOff->HasField(TEXT("Error"))) {
+			regressions.Add(TEXT("idle: did not run"));
+		}
+	}
+
+	world->DestroyWorld(false);
+
+	// what the numbers depend on, so two reports can be told apart
+	FString exportedConfig;
+	if (settings.bHasConfig) {
+		FSpeechRecognitionConfig::StaticStruct()->ExportText(exportedConfig, &settings.Config, nullptr, nullptr, PPF_None, nullptr);
+	}
+	TSharedRef<FJsonObject> root = MakeShared<FJsonObject>();
+	root->SetStringField(TEXT("Date"), FDateTime::UtcNow().ToIso8601());
+	root->SetStringField(TEXT("Platform"), FPlatformProperties::IniPlatformName());
+	root->SetStringField(TEXT("CPU"), FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+	root->SetNumberField(TEXT("Cores"), FPlatformMisc::NumberOfCores());
+	root->SetStringField(TEXT("EngineVersion"), FEngineVersion::Current().ToString());
+	root->SetStringField(TEXT("Dir"), dir);
+	root->SetNumberField(TEXT("Recordings"), recordings.Num());
+	root->SetStringField(TEXT("Language"), StaticEnum<ESpeechRecognitionLanguage>()->GetDisplayNameTextByValue((int64)settings.Language).ToString());
+	root->SetNumberField(TEXT("SampleRate"), settings.SampleRate);
+	root->SetNumberField(TEXT("PlaybackSpeed"), settings.PlaybackSpeed);
+	root->SetStringField(TEXT("WaitMode"), settings.WaitMode == ESpeechRecognitionWaitMode::VE_POLL ? TEXT("Poll") : TEXT("Event"));
+	root->SetStringField(TEXT("Config"), exportedConfig);
+	root->SetArrayField(TEXT("Modes"), modeResults);
+	if (idle.IsValid()) {
+		root->SetObjectField(TEXT("Idle"), idle);
+	}
+	root->SetNumberField(TEXT("PeakRSSMB"), FPlatformMemory::GetStats().PeakUsedPhysical / (1024.0 * 1024.0));
+	TArray<TSharedPtr<FJsonValue>> regressionValues;
+	for (const FString& regression : regressions) {
+		regressionValues.Add(MakeShared<FJsonValueString>(regression));
+		UE_LOG(SpeechRecognitionPlugin, Error, TEXT("%s"), *regression);
+	}
+	root->SetArrayField(TEXT("Regressions"), regressionValues);
+
+	FString report;
+	const TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&report);
+	FJsonSerializer::Serialize(root, writer);
+
+	FString outPath;
+	if (!FParse::Value(*Params, TEXT("Out="), outPath)) {
+		outPath = FPaths::ProjectSavedDir() / TEXT("SpeechRecognitionBench") / FString::Printf(TEXT("Bench-%s.json"), *FDateTime::Now().ToString());
+	}
+	if (!FFileHelper::SaveStringToFile(report, *outPath)) {
+		UE_LOG(SpeechRecognitionPlugin, Error, TEXT("Could not write %s"), *outPath);
+		return 1;
+	}
+	UE_LOG(SpeechRecognitionPlugin, Display, TEXT("Wrote %s"), *FPaths::ConvertRelativePathToFull(outPath));
+
+	return regressions.Num() > 0 ? 1 : 0;
+}
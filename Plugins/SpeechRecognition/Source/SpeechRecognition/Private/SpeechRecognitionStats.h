@@ -0,0 +1,59 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+DECLARE_STATS_GROUP(TEXT("SpeechRecognition"), STATGROUP_SpeechRecognition, STATCAT_Advanced);
+
+// Unreal Insights channel for the recognizer's CPU events, enabled with -trace=cpu,SpeechRecognition
+UE_TRACE_CHANNEL_EXTERN(SpeechRecognitionChannel);
+
+// A cycle counter for stat SpeechRecognition, which is also a CPU event on the trace channel
+#define SPEECH_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Stat, SpeechRecognitionChannel)
+
+// A gauge for stat SpeechRecognition, which is also a trace counter. The counter is declared where it is set
+#define SPEECH_SET_FLOAT_GAUGE(Stat, Value) \
+	SET_FLOAT_STAT(Stat, Value); \
+	TRACE_COUNTER_SET(Stat, Value)
+#define SPEECH_SET_DWORD_GAUGE(Stat, Value) \
+	SET_DWORD_STAT(Stat, Value); \
+	TRACE_COUNTER_SET(Stat, Value)
+
+// Decoding
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Audio Source Read"), STAT_SpeechRecognition_AudioRead, STATGROUP_SpeechRecognition, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Native Front End"), STAT_SpeechRecognition_FrontEnd, STATGROUP_SpeechRecognition, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decode"), STAT_SpeechRecognition_Decode, STATGROUP_SpeechRecognition, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("VAD Transition"), STAT_SpeechRecognition_VadTransition, STATGROUP_SpeechRecognition, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Hypothesis"), STAT_SpeechRecognition_Hypothesis, STATGROUP_SpeechRecognition, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Game Thread Dispatch"), STAT_SpeechRecognition_Dispatch, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Real-Time Factor"), STAT_SpeechRecognition_RealTimeFactor, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Frames Per Second"), STAT_SpeechRecognition_FramesPerSecond, STATGROUP_SpeechRecognition, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Active Search (1 kws, 2 grammar, 3 lm)"), STAT_SpeechRecognition_ActiveSearch, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Speech End To Result (ms)"), STAT_SpeechRecognition_ResultDelayMs, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Result Dispatch Delay (ms)"), STAT_SpeechRecognition_DispatchDelayMs, STATGROUP_SpeechRecognition, );
+
+// Decode thread idling
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Decode Wait (ms)"), STAT_SpeechRecognition_DecodeWaitMs, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Decode Thread CPU (% of a core)"), STAT_SpeechRecognition_DecodeCpuPercent, STATGROUP_SpeechRecognition, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Decode Wakeups"), STAT_SpeechRecognition_Wakeups, STATGROUP_SpeechRecognition, );
+
+// Searches
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Search Switch"), STAT_SpeechRecognition_SearchSwitch, STATGROUP_SpeechRecognition, );
+
+// Dictionary
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Dictionary Words"), STAT_SpeechRecognition_DictionaryWords, STATGROUP_SpeechRecognition, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Dictionary Pronunciations"), STAT_SpeechRecognition_DictionaryEntries, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Dictionary Size (KB)"), STAT_SpeechRecognition_DictionaryKB, STATGROUP_SpeechRecognition, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Full Dictionary Pronunciations"), STAT_SpeechRecognition_FullDictionaryEntries, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Full Dictionary Size (KB)"), STAT_SpeechRecognition_FullDictionaryKB, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Dictionary Load (ms)"), STAT_SpeechRecognition_DictionaryLoadMs, STATGROUP_SpeechRecognition, );
+
+// Energy gate
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Energy Gate Open"), STAT_SpeechRecognition_GateOpen, STATGROUP_SpeechRecognition, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Energy Gate Noise Floor (dBFS)"), STAT_SpeechRecognition_GateNoiseFloor, STATGROUP_SpeechRecognition, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Gated Samples"), STAT_SpeechRecognition_GatedSamples, STATGROUP_SpeechRecognition, );
@@ -1,5 +1,11 @@
 
 #include "SpeechRecognitionSubsystem.h"
+#include "SpeechAudioSource.h"
+#include "SpeechMixerAudioSource.h"
+#include "SpeechRecognitionConfigAsset.h"
+#include "SpeechRecognitionStats.h"
+
+TRACE_DECLARE_FLOAT_COUNTER(STAT_SpeechRecognition_DispatchDelayMs, TEXT("SpeechRecognition/Result Dispatch Delay (ms)"));
 
 #define SPEECHRECOGNITIONPLUGIN ISpeechRecognition::Get()
 
@@ -10,41 +16,147 @@ USpeechRecognitionSubsystem::USpeechRecognitionSubsystem()
 
 bool USpeechRecognitionSubsystem::Init(ESpeechRecognitionLanguage Language, bool bInitDefaultConfigParams)
 {
-	bool bSuccess = false;
-	
-	// terminate any existing thread
+	// the recognizer preloaded during the level load, the one the last level left behind, or the one another world
+	// is already listening with. Only a new language rebuilds it
+	if (listenerThread == NULL) {
+		listenerThread = SPEECHRECOGNITIONPLUGIN.AcquireWorker(this);
+	}
+	listenerThread->SetLanguage(Language);
+	listenerThread->Preload();
+
+	// a preloaded recognizer was built with the defaults already, so this only costs a rebuild when they are turned off
+	listenerThread->SetDefaultConfigParams(bInitDefaultConfigParams);
+	return true;
+}
+
+int32 USpeechRecognitionSubsystem::GetCurrentVolume() const
+{
 	if (listenerThread != NULL) {
-		listenerThread->SetLanguage(Language);
-		bSuccess = true;
+		const int16 returnVal = listenerThread->GetCurrentVolume();
+		return returnVal;
 	}
+	return 0;
+}
 
-	if (!bSuccess)
-	{
-		// start listener thread
-		listenerThread = new FSpeechRecognitionWorker();
-		TArray<FRecognitionPhrase> dictionaryList;
-		listenerThread->SetLanguage(Language);
-		bSuccess = listenerThread->StartThread(this);
+FSpeechRecognitionLevel USpeechRecognitionSubsystem::GetCurrentLevel() const
+{
+	if (listenerThread != NULL) {
+		return listenerThread->GetCurrentLevel();
 	}
+	return FSpeechRecognitionLevel();
+}
 
-	if (bSuccess && bInitDefaultConfigParams)
-	{
-		SetConfigParam(TEXT("-vad_prespeech"), ESpeechRecognitionParamType::VE_INTEGER, TEXT("10"));
-		SetConfigParam(TEXT("-vad_postspeech"), ESpeechRecognitionParamType::VE_INTEGER, TEXT("10"));
-		SetConfigParam(TEXT("-agc"), ESpeechRecognitionParamType::VE_STRING, TEXT("noise"));
-		SetConfigParam(TEXT("-beam"), ESpeechRecognitionParamType::VE_FLOAT, TEXT("1e-40"));
+TArray<float> USpeechRecognitionSubsystem::GetLevelHistory() const
+{
+	TArray<float> levels;
+	if (listenerThread != NULL) {
+		listenerThread->GetLevelHistory(levels);
 	}
+	return levels;
+}
 
-	return bSuccess;
+FSpeechRecognitionAudioStats USpeechRecognitionSubsystem::GetAudioStats() const
+{
+	if (listenerThread != NULL) {
+		return listenerThread->GetAudioStats();
+	}
+	return FSpeechRecognitionAudioStats();
 }
 
-int32 USpeechRecognitionSubsystem::GetCurrentVolume() const
+void USpeechRecognitionSubsystem::SetAudioSourceFile(FString FilePath, float PlaybackSpeed)
+{
+	SetAudioSource(MakeShared<FSpeechFileAudioSource>(FilePath, PlaybackSpeed));
+}
+
+void USpeechRecognitionSubsystem::SetAudioSourceAudioCapture()
+{
+	SetAudioSource(MakeShared<FSpeechAudioCaptureSource>());
+}
+
+void USpeechRecognitionSubsystem::SetAudioSourceSubmix(USoundSubmix* Submix)
+{
+	// the main submix carries the game's own sounds, which the recognizer would try to decode
+	if (Submix == nullptr) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("SetAudioSourceSubmix needs a submix that only the microphone is routed to. The audio source is unchanged"));
+		return;
+	}
+	SetAudioSource(MakeShared<FSpeechSubmixAudioSource>(GetWorld(), Submix));
+}
+
+void USpeechRecognitionSubsystem::SetAudioSourceDevice(FString DeviceName)
+{
+	SetAudioSource(MakeShared<FSpeechDeviceAudioSource>(DeviceName));
+}
+
+bool USpeechRecognitionSubsystem::IsAudioSourceFinished() const
 {
 	if (listenerThread != NULL) {
-		const int16 returnVal = listenerThread->GetCurrentVolume();
-		return returnVal;
+		return listenerThread->IsAudioSourceFinished();
+	}
+	return false;
+}
+
+void USpeechRecognitionSubsystem::SetAudioSource(const TSharedPtr<ISpeechAudioSource>& Source)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetAudioSource(Source);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetDecodeChunkSize(int32 Samples)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetDecodeChunkSize(Samples);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetTargetLatency(int32 Milliseconds)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetTargetLatency(Milliseconds);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetAudioWaitMode(ESpeechRecognitionWaitMode WaitMode)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetWaitMode(WaitMode);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetTrimDictionary(bool bTrimDictionary)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetTrimDictionary(bTrimDictionary);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetNativeFrontEnd(bool bEnabled)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetNativeFrontEnd(bEnabled);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetEnergyGate(const FSpeechEnergyGateSettings& Settings)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetEnergyGateSettings(Settings);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetPartialHypothesisInterval(int32 Frames)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetPartialHypothesisInterval(Frames);
+	}
+}
+
+void USpeechRecognitionSubsystem::SetNBest(const FSpeechNBestSettings& Settings)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetNBestSettings(Settings);
 	}
-	return 0;
 }
 
 bool USpeechRecognitionSubsystem::SetConfigParam(FString param, ESpeechRecognitionParamType type, FString value)
@@ -56,10 +168,35 @@ bool USpeechRecognitionSubsystem::SetConfigParam(FString param, ESpeechRecogniti
 	return false;
 }
 
+void USpeechRecognitionSubsystem::ApplyConfig(const FSpeechRecognitionConfig& Config)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetConfig(Config);
+	}
+}
+
+void USpeechRecognitionSubsystem::ApplyConfigAsset(USpeechRecognitionConfigAsset* ConfigAsset)
+{
+	if (ConfigAsset != nullptr) {
+		ApplyConfig(ConfigAsset->Config);
+	}
+}
+
+void USpeechRecognitionSubsystem::PreloadRecognizer(ESpeechRecognitionLanguage Language)
+{
+	if (listenerThread != NULL) {
+		listenerThread->SetLanguage(Language);
+		listenerThread->Preload();
+	}
+	else {
+		SPEECHRECOGNITIONPLUGIN.Preload(Language);
+	}
+}
+
 bool USpeechRecognitionSubsystem::Shutdown()
 {
 	if (listenerThread != NULL) {
-		listenerThread->ShutDown();
+		SPEECHRECOGNITIONPLUGIN.ReleaseWorker(this, true);
 		listenerThread = NULL;
 		return true;
 	}
@@ -95,71 +232,257 @@ bool USpeechRecognitionSubsystem::EnableLanguageModel(FString languageModel)
 	return false;
 }
 
+bool USpeechRecognitionSubsystem::AddKeywords(const TArray<FRecognitionPhrase>& wordList)
+{
+	if (listenerThread != NULL) {
+		return listenerThread->AddKeywords(wordList);
+	}
+	return false;
+}
+
+bool USpeechRecognitionSubsystem::AddPronunciations(const TArray<FSpeechPronunciation>& Pronunciations)
+{
+	if (listenerThread != NULL) {
+		return listenerThread->AddPronunciations(Pronunciations);
+	}
+	return false;
+}
+
 /**************************
 // Callback methods
 **************************/
-void USpeechRecognitionSubsystem::WordsSpoken_trigger(FWordsSpokenSignature delegate_method, FRecognisedPhrases text)
+void USpeechRecognitionSubsystem::AddListener(ISpeechRecognitionListener* Listener, ESpeechListenerThread Thread)
+{
+	if (Listener == nullptr) {
+		return;
+	}
+	if (Thread == ESpeechListenerThread::Worker) {
+		FScopeLock lock(&WorkerListenersLock);
+		WorkerListeners.AddUnique(Listener);
+	}
+	else {
+		GameThreadListeners.AddUnique(Listener);
+	}
+}
+
+void USpeechRecognitionSubsystem::RemoveListener(ISpeechRecognitionListener* Listener)
+{
+	GameThreadListeners.Remove(Listener);
+
+	// wait out a callback in progress on the recognition thread, unless this is it
+	const uint32 threadId = FPlatformTLS::GetCurrentThreadId();
+	for (;;) {
+		{
+			FScopeLock lock(&WorkerListenersLock);
+			WorkerListeners.Remove(Listener);
+			if (NotifyingListener != Listener || NotifyingThreadId == threadId) {
+				return;
+			}
+		}
+		FPlatformProcess::YieldThread();
+	}
+}
+
+template <typename FunctionType>
+void USpeechRecognitionSubsystem::NotifyWorkerListeners(FunctionType&& Function)
+{
+	// called without the lock, so a listener can add or remove listeners. One removed since the snapshot is skipped
+	TArray<ISpeechRecognitionListener*, TInlineAllocator<8>> listeners;
+	{
+		FScopeLock lock(&WorkerListenersLock);
+		if (WorkerListeners.Num() == 0) {
+			return;
+		}
+		listeners = WorkerListeners;
+	}
+	const uint32 threadId = FPlatformTLS::GetCurrentThreadId();
+	for (ISpeechRecognitionListener* listener : listeners) {
+		{
+			FScopeLock lock(&WorkerListenersLock);
+			if (!WorkerListeners.Contains(listener)) {
+				continue;
+			}
+			NotifyingListener = listener;
+			NotifyingThreadId = threadId;
+		}
+		Function(*listener);
+		{
+			FScopeLock lock(&WorkerListenersLock);
+			NotifyingListener = nullptr;
+		}
+	}
+}
+
+FSpeechRecognitionEvent* USpeechRecognitionSubsystem::AllocateEvent(ESpeechRecognitionEventType Type)
+{
+	FSpeechRecognitionEvent* event = EventPool.Pop();
+	if (event == nullptr) {
+		event = new FSpeechRecognitionEvent();
+	}
+	event->Type = Type;
+	return event;
+}
+
+void USpeechRecognitionSubsystem::WordsSpoken_method(FRecognisedPhrases& phrases)
+{
+	NotifyWorkerListeners([&phrases](ISpeechRecognitionListener& listener) { listener.OnWordsSpoken(phrases); });
+
+	// swapped rather than copied. The worker fills the pooled event's old arrays in place next time
+	FSpeechRecognitionEvent* event = AllocateEvent(ESpeechRecognitionEventType::WordsSpoken);
+	Swap(event->Phrases, phrases);
+	event->QueuedTime = FPlatformTime::Seconds();
+	Events.Push(event);
+}
+
+void USpeechRecognitionSubsystem::UnknownPhrase_method()
 {
-	delegate_method.Broadcast(text);
+	NotifyWorkerListeners([](ISpeechRecognitionListener& listener) { listener.OnUnknownPhrase(); });
+
+	Events.Push(AllocateEvent(ESpeechRecognitionEventType::UnknownPhrase));
 }
 
-void USpeechRecognitionSubsystem::WordsSpoken_method(FRecognisedPhrases text) const
+void USpeechRecognitionSubsystem::StartedSpeaking_method()
 {
-	FSimpleDelegateGraphTask::CreateAndDispatchWhenReady
-		(
-			FSimpleDelegateGraphTask::FDelegate::CreateStatic(&WordsSpoken_trigger, OnWordsSpoken, text)
-			, TStatId()
-			, nullptr
-			, ENamedThreads::GameThread
-			);
+	NotifyWorkerListeners([](ISpeechRecognitionListener& listener) { listener.OnStartedSpeaking(); });
+
+	Events.Push(AllocateEvent(ESpeechRecognitionEventType::StartedSpeaking));
 }
 
-void USpeechRecognitionSubsystem::UnknownPhrase_trigger(FUnknownPhraseSignature delegate_method)
+void USpeechRecognitionSubsystem::StoppedSpeaking_method()
 {
-	delegate_method.Broadcast();
+	NotifyWorkerListeners([](ISpeechRecognitionListener& listener) { listener.OnStoppedSpeaking(); });
+
+	Events.Push(AllocateEvent(ESpeechRecognitionEventType::StoppedSpeaking));
 }
 
-void USpeechRecognitionSubsystem::UnknownPhrase_method() const
+void USpeechRecognitionSubsystem::PartialHypothesis_method(const FString& text)
 {
-	FSimpleDelegateGraphTask::CreateAndDispatchWhenReady
-		(
-			FSimpleDelegateGraphTask::FDelegate::CreateStatic(&UnknownPhrase_trigger, OnUnknownPhrase)
-			, TStatId()
-			, nullptr
-			, ENamedThreads::GameThread
-			);
+	NotifyWorkerListeners([&text](ISpeechRecognitionListener& listener) { listener.OnPartialHypothesis(text); });
+
+	// copied into the pooled string, which keeps its buffer when it is big enough
+	FSpeechRecognitionEvent* event = AllocateEvent(ESpeechRecognitionEventType::PartialHypothesis);
+	event->Text = text;
+	Events.Push(event);
 }
 
-void USpeechRecognitionSubsystem::StartedSpeaking_trigger(FStartedSpeakingSignature delegate_method)
+void USpeechRecognitionSubsystem::RecognizerReady_method(const FSpeechRecognizerLoadTimings& timings)
 {
-	delegate_method.Broadcast();
+	NotifyWorkerListeners([&timings](ISpeechRecognitionListener& listener) { listener.OnRecognizerReady(timings); });
+
+	FSpeechRecognitionEvent* event = AllocateEvent(ESpeechRecognitionEventType::RecognizerReady);
+	event->Timings = timings;
+	Events.Push(event);
 }
 
-void USpeechRecognitionSubsystem::StartedSpeaking_method() const
+void USpeechRecognitionSubsystem::SetEventTimeBudget(float Milliseconds)
 {
-	FSimpleDelegateGraphTask::CreateAndDispatchWhenReady
-		(
-			FSimpleDelegateGraphTask::FDelegate::CreateStatic(&StartedSpeaking_trigger, OnStartedSpeaking)
-			, TStatId()
-			, nullptr
-			, ENamedThreads::GameThread
-			);
+	EventTimeBudgetMs = FMath::Max(Milliseconds, 0.0f);
 }
 
-void USpeechRecognitionSubsystem::StoppedSpeaking_trigger(FStoppedSpeakingSignature delegate_method)
+void USpeechRecognitionSubsystem::AddPendingEvent(FSpeechRecognitionEvent* Event)
 {
-	delegate_method.Broadcast();
+	// only the newest of back to back partial hypotheses is worth showing. Utterance boundaries are always kept,
+	// so listeners see every started / stopped pair even when the queue runs behind
+	if (Event->Type == ESpeechRecognitionEventType::PartialHypothesis && PendingEvents.Num() > 0
+		&& PendingEvents.Last()->Type == ESpeechRecognitionEventType::PartialHypothesis) {
+		Swap(PendingEvents.Last(), Event);
+		EventPool.Push(Event);
+		return;
+	}
+	PendingEvents.Add(Event);
 }
 
-void USpeechRecognitionSubsystem::StoppedSpeaking_method() const
+void USpeechRecognitionSubsystem::DeleteEvents()
 {
-	FSimpleDelegateGraphTask::CreateAndDispatchWhenReady
-		(
-			FSimpleDelegateGraphTask::FDelegate::CreateStatic(&StoppedSpeaking_trigger, OnStoppedSpeaking)
-			, TStatId()
-			, nullptr
-			, ENamedThreads::GameThread
-			);
+	while (FSpeechRecognitionEvent* event = Events.Pop()) {
+		delete event;
+	}
+	while (FSpeechRecognitionEvent* event = EventPool.Pop()) {
+		delete event;
+	}
+	for (FSpeechRecognitionEvent* event : PendingEvents) {
+		delete event;
+	}
+	PendingEvents.Reset();
+}
+
+void USpeechRecognitionSubsystem::BroadcastEvent(const FSpeechRecognitionEvent& Event)
+{
+	// native listeners first. A copy, as a listener may remove itself
+	const TArray<ISpeechRecognitionListener*, TInlineAllocator<8>> listeners(GameThreadListeners);
+	switch (Event.Type) {
+	case ESpeechRecognitionEventType::StartedSpeaking:
+		for (ISpeechRecognitionListener* listener : listeners) {
+			listener->OnStartedSpeaking();
+		}
+		OnStartedSpeaking.Broadcast();
+		break;
+	case ESpeechRecognitionEventType::StoppedSpeaking:
+		for (ISpeechRecognitionListener* listener : listeners) {
+			listener->OnStoppedSpeaking();
+		}
+		OnStoppedSpeaking.Broadcast();
+		break;
+	case ESpeechRecognitionEventType::WordsSpoken:
+		SPEECH_SET_FLOAT_GAUGE(STAT_SpeechRecognition_DispatchDelayMs, (float)((FPlatformTime::Seconds() - Event.QueuedTime) * 1000.0));
+		for (ISpeechRecognitionListener* listener : listeners) {
+			listener->OnWordsSpoken(Event.Phrases);
+		}
+		OnWordsSpoken.Broadcast(Event.Phrases);
+		break;
+	case ESpeechRecognitionEventType::UnknownPhrase:
+		for (ISpeechRecognitionListener* listener : listeners) {
+			listener->OnUnknownPhrase();
+		}
+		OnUnknownPhrase.Broadcast();
+		break;
+	case ESpeechRecognitionEventType::PartialHypothesis:
+		for (ISpeechRecognitionListener* listener : listeners) {
+			listener->OnPartialHypothesis(Event.Text);
+		}
+		OnPartialHypothesis.Broadcast(Event.Text);
+		break;
+	case ESpeechRecognitionEventType::RecognizerReady:
+		for (ISpeechRecognitionListener* listener : listeners) {
+			listener->OnRecognizerReady(Event.Timings);
+		}
+		OnRecognizerReady.Broadcast(Event.Timings);
+		break;
+	}
+}
+
+void USpeechRecognitionSubsystem::Tick(float DeltaTime)
+{
+	SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_Dispatch);
+	while (FSpeechRecognitionEvent* event = Events.Pop()) {
+		AddPendingEvent(event);
+	}
+
+	// in order, until the budget runs out. Whatever is left goes first next frame
+	const double deadline = FPlatformTime::Seconds() + EventTimeBudgetMs / 1000.0;
+	int32 numBroadcast = 0;
+	while (numBroadcast < PendingEvents.Num()) {
+		FSpeechRecognitionEvent& pending = *PendingEvents[numBroadcast++];
+		if (pending.Type == ESpeechRecognitionEventType::WordsSpoken) {
+			pending.Phrases.BroadcastTime = FPlatformTime::Seconds();
+			TRACE_BOOKMARK(TEXT("Utterance %d broadcast"), pending.Phrases.UtteranceId);
+		}
+		BroadcastEvent(pending);
+		if (FPlatformTime::Seconds() > deadline) {
+			break;
+		}
+	}
+
+	// back to the recognition thread, buffers and all
+	for (int32 i = 0; i < numBroadcast; i++) {
+		EventPool.Push(PendingEvents[i]);
+	}
+	PendingEvents.RemoveAt(0, numBroadcast, EAllowShrinking::No);
+}
+
+TStatId USpeechRecognitionSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USpeechRecognitionSubsystem, STATGROUP_Tickables);
 }
 
 bool USpeechRecognitionSubsystem::ShouldCreateSubsystem(UObject* Outer) const
@@ -175,9 +498,25 @@ bool USpeechRecognitionSubsystem::ShouldCreateSubsystem(UObject* Outer) const
 	return false;
 }
 
+void USpeechRecognitionSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	// start loading while the level streams in, rather than when the game first asks. Editor worlds never listen
+	const UWorld* world = GetWorld();
+	if (world != nullptr && world->IsGameWorld()) {
+		SPEECHRECOGNITIONPLUGIN.Preload(SPEECHRECOGNITIONPLUGIN.GetLastLanguage());
+	}
+}
+
 void USpeechRecognitionSubsystem::Deinitialize()
 {
-	Shutdown();
+	// keep the recognizer loaded for the next level. Nothing is reported to this subsystem once ReleaseWorker returns
+	if (listenerThread != NULL) {
+		SPEECHRECOGNITIONPLUGIN.ReleaseWorker(this, false);
+		listenerThread = NULL;
+	}
+	DeleteEvents();
 	
 	Super::Deinitialize();
 }
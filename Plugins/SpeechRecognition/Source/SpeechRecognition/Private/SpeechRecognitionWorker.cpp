@@ -2,108 +2,518 @@
 #include "SpeechRecognitionWorker.h"
 #include "SpeechRecognition.h"
 #include "SpeechRecognitionSubsystem.h"
+#include "SpeechAudioCaptureWorker.h"
+#include "SpeechAudioSource.h"
+#include "SpeechEnergyGate.h"
+#include "SpeechGrammarCache.h"
+#include "SpeechDictionaryIndex.h"
+#include "SpeechTrimmedDictionary.h"
+#include "SpeechPhraseCompiler.h"
+#include "SpeechModelCache.h"
+#include "SpeechMfccFrontEnd.h"
+#include "SpeechRecognitionStats.h"
+#include "SpeechThreadTime.h"
+#include "HAL/Event.h"
+#include <sphinxbase/ckd_alloc.h>
 
 //General Log
 DEFINE_LOG_CATEGORY(SpeechRecognitionPlugin);
 
-FSpeechRecognitionWorker::FSpeechRecognitionWorker() {}
+//Seconds of audio the capture ring buffer can hold before it overruns
+static constexpr int32 AudioBufferSeconds = 2;
 
-vector<string> FSpeechRecognitionWorker::Split(string s) {
-	std::locale loc;
-	regex r("\\s+");
-	auto words_begin = std::sregex_iterator(s.begin(), s.end(), r);
-	auto words_end = std::sregex_iterator();
+//Utterance ids are unique across every recognizer in the process
+static std::atomic<int32> NextUtteranceId(1);
 
-	vector<string> result;
+//Most frames the sphinxbase front end is asked for per call. Longer chunks take more than one call
+static constexpr int32 SphinxFramesPerCall = 128;
 
-	// single word, no split necessary
-	if (words_begin == words_end) {
-		result.push_back(s);
-	}
-	else {
-		stringstream ss(s); // Insert the string into a stream
-		string buf;
-		vector<string> tokens; // Create vector to hold our words
-		while (ss >> buf)
-			result.push_back(buf);
-	}
-	return result;
-}
+TRACE_DECLARE_FLOAT_COUNTER(STAT_SpeechRecognition_RealTimeFactor, TEXT("SpeechRecognition/Real-Time Factor"));
+TRACE_DECLARE_FLOAT_COUNTER(STAT_SpeechRecognition_FramesPerSecond, TEXT("SpeechRecognition/Frames Per Second"));
+TRACE_DECLARE_INT_COUNTER(STAT_SpeechRecognition_ActiveSearch, TEXT("SpeechRecognition/Active Search"));
+TRACE_DECLARE_FLOAT_COUNTER(STAT_SpeechRecognition_ResultDelayMs, TEXT("SpeechRecognition/Speech End To Result (ms)"));
+TRACE_DECLARE_FLOAT_COUNTER(STAT_SpeechRecognition_DecodeCpuPercent, TEXT("SpeechRecognition/Decode Thread CPU (% of a core)"));
 
-string FSpeechRecognitionWorker::GetOriginalString(string s) const
+FSpeechRecognitionWorker::FSpeechRecognitionWorker()
+	: DecodeChunkSize(1024)
+	, TargetLatencyMs(0)
+	, WaitMode(ESpeechRecognitionWaitMode::VE_EVENT)
+	, decodeWakeups(0)
+	, decodeWaitSeconds(0.0)
 {
-	string result;
-	wstring wstr(s.begin(), s.end());
-	wstring wstr_stripped;
-	for (int j = 0; j < s.size(); j++) {
-		const int charInt = s[j];
-		if (charInt != 40 && charInt != 41 
-			&& (charInt < 48 || charInt > 57) 
-			&& (charInt != 60 && charInt != 62)) {
-			wstr_stripped += s[j];
-		}
-	}
-	copy(wstr_stripped.begin(), wstr_stripped.end(), back_inserter(result));
-	return result;
+	Capture = MakeUnique<FSpeechAudioCaptureWorker>(AudioBuffer);
+	EnergyGate = MakeUnique<FSpeechEnergyGate>();
+	GrammarCache = MakeUnique<FSpeechGrammarCache>();
+	PhraseCompiler = MakeUnique<FSpeechPhraseCompiler>();
+	TrimmedDictionary = MakeUnique<FSpeechTrimmedDictionary>();
+	FrontEnd = MakeUnique<FSpeechMfccFrontEnd>();
+	ptmr_init(&decodeTimer);
+	AudioReadyEvent = FPlatformProcess::GetSynchEventFromPool(false);
 }
 
 FSpeechRecognitionWorker::~FSpeechRecognitionWorker() {
 	delete Thread;
 	Thread = NULL;
+	AudioBuffer.SetReaderEvent(nullptr, 0);
+	Capture.Reset();
+	FPlatformProcess::ReturnSynchEventToPool(AudioReadyEvent);
+	AudioReadyEvent = nullptr;
 }
 
 void FSpeechRecognitionWorker::ShutDown() {
 	Stop();
 	Thread->WaitForCompletion();
 	delete Thread;
+	Thread = NULL;
 }
 
 bool FSpeechRecognitionWorker::EnableGrammarMode(FString grammarName)
 {
-	const char* name = TCHAR_TO_ANSI(*grammarName);
-	const std::string grammarFile = contentPath_str + "model/" + langStr + "/grammars/" + name + ".gram";
+	const std::string searchName = "grammar:" + std::string(TCHAR_TO_UTF8(*grammarName));
+	QueueCommand([this, searchName]()
+	{
+		detectionMode = ESpeechRecognitionMode::VE_GRAMMAR;
+		UpdateDictionary(false);
+		ActivateSearch(searchName);
+	});
+	return true;
+}
 
-	// Init config and set default params
-	InitConfig();	
-	cmd_ln_set_str_r(config, "-jsgf", grammarFile.c_str());
+bool FSpeechRecognitionWorker::EnableKeywordMode(const TArray<FRecognitionPhrase>& wordList)
+{
+	QueueCommand([this, wordList]()
+	{
+		detectionMode = ESpeechRecognitionMode::VE_KEYWORD;
+		AddWords(wordList);
+		UpdateDictionary(false);
+
+		// the keyword list may have changed, so always re-register
+		registeredSearches.erase("keyphrase_search");
+		ActivateSearch("keyphrase_search");
+	});
+	return true;
+}
 
-	initRequired = true;
-	detectionMode = ESpeechRecognitionMode::VE_GRAMMAR;
+bool FSpeechRecognitionWorker::AddKeywords(const TArray<FRecognitionPhrase>& InKeywords)
+{
+	QueueCommand([this, InKeywords]()
+	{
+		AddWords(InKeywords, false);
+		UpdateDictionary(false);
+		RefreshKeyphraseSearch();
+	});
 	return true;
 }
 
-bool FSpeechRecognitionWorker::EnableKeywordMode(const TArray<FRecognitionPhrase>& wordList)
+bool FSpeechRecognitionWorker::AddPronunciations(const TArray<FSpeechPronunciation>& InPronunciations)
 {
-	// Init config and set default params
-	InitConfig();
-	AddWords(wordList);
-	initRequired = true;
-	detectionMode = ESpeechRecognitionMode::VE_KEYWORD;
+	QueueCommand([this, InPronunciations]()
+	{
+		int32 numAdded = 0;
+		bool bSearchUpdated = false;
+		for (int32 i = 0; i < InPronunciations.Num(); i++) {
+			std::string word = TCHAR_TO_UTF8(*InPronunciations[i].Word);
+			transform(word.begin(), word.end(), word.begin(), ::tolower);
+			const std::string phones = TCHAR_TO_UTF8(*InPronunciations[i].Phones);
+
+			// only the last word updates the active search, which covers the whole batch
+			const bool bLast = i == InPronunciations.Num() - 1;
+			if (ps_add_word(ps, word.c_str(), phones.c_str(), bLast) < 0) {
+				UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to add the pronunciation '%s' for '%s'"), *InPronunciations[i].Phones, *InPronunciations[i].Word);
+				continue;
+			}
+			customPronunciations[word] = phones;
+			numAdded++;
+			bSearchUpdated = bLast;
+		}
+
+		// the last word failed, so nothing rebuilt the active search. Registering it again builds it against the new words
+		if (numAdded > 0 && !bSearchUpdated && !activeSearch.empty() && activeSearch != "keyphrase_search") {
+			registeredSearches.erase(activeSearch);
+			ActivateSearch(activeSearch);
+		}
+
+		// keyphrases that were skipped for missing words may be valid now
+		RefreshKeyphraseSearch();
+	});
+	return true;
+}
+
+void FSpeechRecognitionWorker::RefreshKeyphraseSearch()
+{
+	// pocketsphinx has no in-place keyphrase update, but registering a keyphrase search only builds its phrase list
+	if (registeredSearches.erase("keyphrase_search") == 0) {
+		return;
+	}
+	if (activeSearch == "keyphrase_search") {
+		ActivateSearch("keyphrase_search");
+	}
+	else {
+		RegisterSearch("keyphrase_search");
+	}
+}
+
+void FSpeechRecognitionWorker::ReapplyPronunciations()
+{
+	int32 remaining = (int32)customPronunciations.size();
+	for (const pair<const string, string>& pronunciation : customPronunciations) {
+		ps_add_word(ps, pronunciation.first.c_str(), pronunciation.second.c_str(), --remaining == 0);
+	}
+}
+
+bool FSpeechRecognitionWorker::IsDecoderWord(const char* word) const
+{
+	char* phones = ps_lookup_word(ps, word);
+	if (phones == NULL) {
+		return false;
+	}
+	ckd_free(phones);
 	return true;
 }
 
 bool FSpeechRecognitionWorker::EnableLanguageModel(FString InLanguageModel)
 {
-	const char* name = TCHAR_TO_ANSI(*InLanguageModel);
-	const std::string langModel = contentPath_str + "model/" + langStr + "/language_models/" + name + ".lm";
+	const std::string searchName = "lm:" + std::string(TCHAR_TO_UTF8(*InLanguageModel));
+	QueueCommand([this, searchName]()
+	{
+		detectionMode = ESpeechRecognitionMode::VE_LANGUAGE_MODEL;
+		UpdateDictionary(true);
+		ActivateSearch(searchName);
+	});
+	return true;
+}
 
-	// Init config and set default params
+void FSpeechRecognitionWorker::QueueCommand(TFunction<void()>&& Command)
+{
+	// a new language needs the decoder rebuilt before the command runs. Param changes are diffed by ApplyConfigChanges
+	{
+		FScopeLock lock(&ConfigLock);
+		if (!decoderRequested || languageChanged) {
+			initRequired = true;
+			decoderRequested = true;
+		}
+	}
+	Commands.Enqueue(MoveTemp(Command));
+	AudioReadyEvent->Trigger();
+}
+
+void FSpeechRecognitionWorker::RunCommands()
+{
+	TFunction<void()> command;
+	while (Commands.Dequeue(command)) {
+		command();
+	}
+}
+
+bool FSpeechRecognitionWorker::RebuildDecoder()
+{
+	const double startTime = FPlatformTime::Seconds();
 	InitConfig();
-	ps_default_search_args(config);
-	cmd_ln_set_str_r(config, "-lm", langModel.c_str());
+	const double configTime = FPlatformTime::Seconds();
+
+	// the dictionary may have changed, and language models need all of it
+	DictionaryIndex.Reset();
+	TrimmedDictionary->Reset();
+	grammarVocabularyCollected = false;
+	trimmedDictionaryLoaded = false;
+	FString trimmedPath;
+	if (trimDictionary && activeSearch.rfind("lm:", 0) != 0) {
+		LoadDictionary();
+		FSpeechModelCache& modelCache = ISpeechRecognition::Get().GetModelCache();
+		logmath_t* lmath = modelCache.AcquireLogMath(cmd_ln_float64_r(config, "-logbase"));
+		CollectVocabulary(lmath);
+		modelCache.ReleaseLogMath(lmath);
+
+		trimmedPath = TrimmedDictionary->Write(*DictionaryIndex, trimmedFootprint);
+		if (!trimmedPath.IsEmpty()) {
+			cmd_ln_set_str_r(config, "-dict", TCHAR_TO_UTF8(*trimmedPath));
+			trimmedDictionaryLoaded = true;
+		}
+	}
+	const double dictionaryTime = FPlatformTime::Seconds();
+
+	// an existing decoder is reloaded in place
+	if (ps != NULL && ps_reinit(ps, config) < 0) {
+		ClientMessage(FString(TEXT("Failed to reinitialise the decoder, creating a new one")));
+		ps_free(ps);
+		ps = NULL;
+	}
+	if (ps == NULL) {
+		ps = ps_init(config);
+	}
+	if (ps == NULL) {
+		return false;
+	}
+	TrimmedDictionary->SetLoaded(trimmedDictionaryLoaded ? trimmedPath : FString());
+
+	// the decoder loads the acoustic model along with the dictionary, so only ps_load_dict times the dictionary alone
+	ReportDictionary(TEXT("Decoder built"), (FPlatformTime::Seconds() - dictionaryTime) * 1000.0);
+
+	const double decoderTime = FPlatformTime::Seconds();
+	RestoreSearches();
+	const double endTime = FPlatformTime::Seconds();
+
+	buildTimings = FSpeechRecognizerLoadTimings();
+	buildTimings.ConfigMs = (float)((configTime - startTime) * 1000.0);
+	buildTimings.DictionaryMs = (float)((dictionaryTime - configTime) * 1000.0);
+	buildTimings.DecoderMs = (float)((decoderTime - dictionaryTime) * 1000.0);
+	buildTimings.SearchesMs = (float)((endTime - decoderTime) * 1000.0);
+
+	ClientMessage(FString::Printf(TEXT("Decoder ready in %.1f ms"), (endTime - startTime) * 1000.0));
+	return true;
+}
+
+void FSpeechRecognitionWorker::RestoreSearches()
+{
+	// reinitialising drops every search, and any words added since the dictionary was loaded.
+	// Searches also read their beams and weights when they are created
+	registeredSearches.clear();
+	ReapplyPronunciations();
+	RegisterGrammarSearches();
+	if (!activeSearch.empty()) {
+		ActivateSearch(activeSearch);
+	}
+}
+
+bool FSpeechRecognitionWorker::CollectVocabulary(logmath_t* lmath)
+{
+	// the vocabulary only grows until the next rebuild, so after the first pass only new keywords are added
+	bool bAdded = false;
+	if (grammarVocabularyCollected) {
+		for (const std::string& keyword : newKeywords) {
+			bAdded |= TrimmedDictionary->AddPhrase(keyword);
+		}
+		newKeywords.clear();
+		return bAdded;
+	}
+
+	for (const pair<const string, char*>& keyword : keywords) {
+		bAdded |= TrimmedDictionary->AddPhrase(keyword.first);
+	}
+	newKeywords.clear();
+
+	// every grammar is registered up front, so all of their words are needed
+	const FString grammarDir = FString(UTF8_TO_TCHAR((contentPath_str + "model/" + langStr + "/grammars/").c_str()));
+	TArray<FString> grammarFiles;
+	IFileManager::Get().FindFiles(grammarFiles, *(grammarDir / TEXT("*.gram")), true, false);
+	for (const FString& grammarFile : grammarFiles) {
+		fsg_model_t* fsg = GrammarCache->Load(grammarDir / grammarFile, UTF8_TO_TCHAR(dictionaryPath.c_str()),
+			lmath, cmd_ln_float32_r(config, "-lw"), cmd_ln_str_r(config, "-toprule"));
+		if (fsg != nullptr) {
+			bAdded |= TrimmedDictionary->AddGrammar(fsg);
+			fsg_model_free(fsg);
+		}
+	}
+	grammarVocabularyCollected = true;
+	return bAdded;
+}
+
+void FSpeechRecognitionWorker::UpdateDictionary(bool bNeedsFullDictionary)
+{
+	// a registered language model search keeps the full dictionary until the next rebuild
+	bool bLanguageModelRegistered = false;
+	for (const std::string& name : registeredSearches) {
+		bLanguageModelRegistered |= name.rfind("lm:", 0) == 0;
+	}
+
+	if (trimDictionary && !bNeedsFullDictionary && !bLanguageModelRegistered) {
+		LoadDictionary();
+		if (!CollectVocabulary(ps_get_logmath(ps)) && trimmedDictionaryLoaded) {
+			return;
+		}
+
+		const FString trimmedPath = TrimmedDictionary->Write(*DictionaryIndex, trimmedFootprint);
+		if (!trimmedPath.IsEmpty() && LoadDecoderDictionary(TCHAR_TO_UTF8(*trimmedPath), true)) {
+			trimmedDictionaryLoaded = true;
+			TrimmedDictionary->SetLoaded(trimmedPath);
+		}
+	}
+	else if (trimmedDictionaryLoaded) {
+		LoadDictionary();
+		if (LoadDecoderDictionary(dictionaryPath, false)) {
+			trimmedDictionaryLoaded = false;
+			TrimmedDictionary->SetLoaded(FString());
+		}
+	}
+}
+
+bool FSpeechRecognitionWorker::LoadDecoderDictionary(const std::string& path, bool bTrimmed)
+{
+	// registered searches are rebuilt against the new dictionary in place
+	const double startTime = FPlatformTime::Seconds();
+	if (ps_load_dict(ps, path.c_str(), NULL, NULL) < 0) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to load dictionary %s"), UTF8_TO_TCHAR(path.c_str()));
+		return false;
+	}
+	// ps_load_dict leaves the config alone, and ps_reinit reloads whatever -dict names
+	cmd_ln_set_str_r(config, "-dict", path.c_str());
+	ReapplyPronunciations();
+
+	const double loadMs = (FPlatformTime::Seconds() - startTime) * 1000.0;
+	(bTrimmed ? trimmedDictionaryLoadMs : fullDictionaryLoadMs) = loadMs;
+	ReportDictionary(bTrimmed ? TEXT("Loaded the trimmed dictionary") : TEXT("Loaded the full dictionary"), loadMs);
+	return true;
+}
+
+FSpeechDictionaryFootprint FSpeechRecognitionWorker::GetFullDictionaryFootprint() const
+{
+	FSpeechDictionaryFootprint footprint;
+	if (DictionaryIndex.IsValid() && DictionaryIndex->IsOpen()) {
+		footprint.NumWords = DictionaryIndex->Num();
+		footprint.NumEntries = DictionaryIndex->NumEntries();
+		footprint.Bytes = DictionaryIndex->GetDictionarySize();
+	}
+	else {
+		footprint.Bytes = IFileManager::Get().FileSize(UTF8_TO_TCHAR(dictionaryPath.c_str()));
+	}
+	return footprint;
+}
+
+void FSpeechRecognitionWorker::ReportDictionary(const TCHAR* action, double loadMs)
+{
+	// sizes of what the decoder parses, which its word table grows with. The process' memory moves for too many other reasons to say
+	const FSpeechDictionaryFootprint full = GetFullDictionaryFootprint();
+	const FSpeechDictionaryFootprint& loaded = trimmedDictionaryLoaded ? trimmedFootprint : full;
+	SET_DWORD_STAT(STAT_SpeechRecognition_DictionaryWords, loaded.NumWords);
+	SET_DWORD_STAT(STAT_SpeechRecognition_DictionaryEntries, loaded.NumEntries);
+	SET_FLOAT_STAT(STAT_SpeechRecognition_DictionaryKB, (float)(loaded.Bytes / 1024.0));
+	SET_DWORD_STAT(STAT_SpeechRecognition_FullDictionaryEntries, full.NumEntries);
+	SET_FLOAT_STAT(STAT_SpeechRecognition_FullDictionaryKB, (float)(full.Bytes / 1024.0));
+	SET_FLOAT_STAT(STAT_SpeechRecognition_DictionaryLoadMs, (float)loadMs);
+
+	if (!trimmedDictionaryLoaded && full.NumEntries == 0) {
+		// the index is only mapped when trimming, so only the file's size is known
+		ClientMessage(FString::Printf(TEXT("%s in %.1f ms with the full dictionary, %.1f KB"), action, loadMs, full.Bytes / 1024.0));
+	}
+	else if (!trimmedDictionaryLoaded) {
+		ClientMessage(FString::Printf(TEXT("%s in %.1f ms with the full dictionary, %d words, %d pronunciations, %.1f KB"),
+			action, loadMs, full.NumWords, full.NumEntries, full.Bytes / 1024.0));
+	}
+	else {
+		ClientMessage(FString::Printf(TEXT("%s in %.1f ms with a trimmed dictionary, %d words, %d pronunciations, %.1f KB. The full one has %d words, %d pronunciations, %.1f KB (%.2f%% of its pronunciations kept)"),
+			action, loadMs, loaded.NumWords, loaded.NumEntries, loaded.Bytes / 1024.0, full.NumWords, full.NumEntries, full.Bytes / 1024.0,
+			full.NumEntries > 0 ? 100.0 * loaded.NumEntries / full.NumEntries : 0.0));
+	}
+	if (trimmedDictionaryLoadMs > 0.0 && fullDictionaryLoadMs > 0.0) {
+		ClientMessage(FString::Printf(TEXT("ps_load_dict took %.1f ms for the trimmed dictionary, %.1f ms for the full one"), trimmedDictionaryLoadMs, fullDictionaryLoadMs));
+	}
+}
+
+void FSpeechRecognitionWorker::LoadDictionary()
+{
+	if (DictionaryIndex.IsValid() && DictionaryIndex->IsOpen()) {
+		return;
+	}
+
+	// maps the prebuilt index, rebuilding it if the .dict has changed, unless another decoder already has
+	DictionaryIndex = ISpeechRecognition::Get().GetModelCache().AcquireDictionaryIndex(UTF8_TO_TCHAR(dictionaryPath.c_str()));
+	if (!DictionaryIndex->IsOpen()) {
+		ClientMessage(FString(TEXT("Failed to load the dictionary index")));
+	}
+}
+
+bool FSpeechRecognitionWorker::RegisterSearch(const std::string& name)
+{
+	if (registeredSearches.find(name) != registeredSearches.end()) {
+		return true;
+	}
+
+	int result = -1;
+	if (name == "keyphrase_search") {
+		return RegisterKeyphraseSearch();
+	}
+	else if (name.rfind("grammar:", 0) == 0) {
+		// compiled once, then loaded from the grammar cache
+		const std::string grammarFile = contentPath_str + "model/" + langStr + "/grammars/" + name.substr(8) + ".gram";
+		fsg_model_t* fsg = GrammarCache->Load(UTF8_TO_TCHAR(grammarFile.c_str()), UTF8_TO_TCHAR(dictionaryPath.c_str()),
+			ps_get_logmath(ps), cmd_ln_float32_r(config, "-lw"), cmd_ln_str_r(config, "-toprule"));
+		if (fsg != nullptr) {
+			result = ps_set_fsg(ps, name.c_str(), fsg);
+			fsg_model_free(fsg);
+		}
+	}
+	else if (name.rfind("lm:", 0) == 0) {
+		const std::string langModel = contentPath_str + "model/" + langStr + "/language_models/" + name.substr(3) + ".lm";
+		result = ps_set_lm_file(ps, name.c_str(), langModel.c_str());
+	}
+
+	if (result < 0) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to register search %s"), UTF8_TO_TCHAR(name.c_str()));
+		return false;
+	}
+	registeredSearches.insert(name);
+	return true;
+}
+
+bool FSpeechRecognitionWorker::RegisterKeyphraseSearch()
+{
+	LoadDictionary();
+
+	// every pronunciation of each word becomes its own keyphrase, with the phrase's threshold
+	vector<pair<string, int32>> phrases;
+	phrases.reserve(keywords.size());
+	for (const pair<const string, char*>& keyword : keywords) {
+		phrases.emplace_back(keyword.first, (int32)logmath_log(ps_get_logmath(ps), atof(keyword.second)) >> SENSCR_SHIFT);
+	}
+
+	TUniquePtr<FSpeechPhraseCompiler> compiler = MakeUnique<FSpeechPhraseCompiler>();
+	const double startTime = FPlatformTime::Seconds();
+	compiler->Compile(phrases, *DictionaryIndex, [this](const char* word) { return IsDecoderWord(word); });
+	UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Compiled %d phrases to %d keyphrases in %.2f ms"), (int32)phrases.size(), compiler->Num(), (FPlatformTime::Seconds() - startTime) * 1000.0);
+
+	if (compiler->Num() == 0) {
+		ClientMessage(FString(TEXT("No keyphrases to register")));
+		return false;
+	}
+
+	// replacing the search frees the old one, so its strings can go too
+	if (ps_set_keyphrase(ps, "keyphrase_search", compiler->GetKeyphrases(), compiler->GetThresholds(), compiler->Num()) < 0) {
+		ClientMessage(FString(TEXT("Failed to register keyphrase_search")));
+		return false;
+	}
+	PhraseCompiler = MoveTemp(compiler);
+	registeredSearches.insert("keyphrase_search");
+	return true;
+}
+
+void FSpeechRecognitionWorker::RegisterGrammarSearches()
+{
+	const FString grammarDir = FString(UTF8_TO_TCHAR((contentPath_str + "model/" + langStr + "/grammars/").c_str()));
+	TArray<FString> grammarFiles;
+	IFileManager::Get().FindFiles(grammarFiles, *(grammarDir / TEXT("*.gram")), true, false);
+	for (const FString& grammarFile : grammarFiles) {
+		RegisterSearch("grammar:" + std::string(TCHAR_TO_UTF8(*FPaths::GetBaseFilename(grammarFile))));
+	}
+}
+
+bool FSpeechRecognitionWorker::ActivateSearch(const std::string& name)
+{
+	if (!RegisterSearch(name)) {
+		return false;
+	}
 
-	initRequired = true;
-	detectionMode = ESpeechRecognitionMode::VE_LANGUAGE_MODEL;
+	// the search is re-selected even when it is already active, as re-registering it frees the old one
+	if (ps_set_search(ps, name.c_str()) < 0) {
+		UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to switch to search %s"), UTF8_TO_TCHAR(name.c_str()));
+		return false;
+	}
+	activeSearch = name;
+	SPEECH_SET_DWORD_GAUGE(STAT_SpeechRecognition_ActiveSearch, name == "keyphrase_search" ? 1 : name.rfind("grammar:", 0) == 0 ? 2 : name.rfind("lm:", 0) == 0 ? 3 : 0);
 	return true;
 }
 
-void FSpeechRecognitionWorker::AddWords(const TArray<FRecognitionPhrase>& InKeywords) {
-	this->keywords.clear();
+void FSpeechRecognitionWorker::AddWords(const TArray<FRecognitionPhrase>& InKeywords, bool bReplace) {
+	if (bReplace) {
+		this->keywords.clear();
+	}
 	for (auto It = InKeywords.CreateConstIterator(); It; ++It)
 	{
 		FRecognitionPhrase word = *It;
-		std::string wordStr = std::string(TCHAR_TO_UTF8(*word.phrase));
-		transform(wordStr.begin(), wordStr.end(), wordStr.begin(), ::tolower);
+		const std::string wordStr = FSpeechPhraseCompiler::Normalize(TCHAR_TO_UTF8(*word.phrase));
+		if (wordStr.empty()) {
+			continue;
+		}
+		newKeywords.push_back(wordStr);
 
 		const EPhraseRecognitionTolerance toleranceEnum = word.tolerance;
 		char* tolerance;
@@ -138,33 +548,535 @@ void FSpeechRecognitionWorker::AddWords(const TArray<FRecognitionPhrase>& InKeyw
 		case EPhraseRecognitionTolerance::VE_10:
 			tolerance = (char*)"1e-3/";
 			break;
-		default:
-			tolerance = (char*)"1e-2/";
+		default:
+			tolerance = (char*)"1e-2/";
+		}
+
+		const pair<map<string, char*>::iterator, bool> ret = this->keywords.insert(pair<string, char*>(wordStr, tolerance));
+		if (ret.second == false) {
+			this->keywords.erase(wordStr);
+			this->keywords.insert(pair<string, char*>(wordStr, tolerance));
+		}
+	}
+}
+
+int16 FSpeechRecognitionWorker::GetCurrentVolume() const
+{
+	return (int16)LevelMeter.GetPeak();
+}
+
+FSpeechRecognitionLevel FSpeechRecognitionWorker::GetCurrentLevel() const
+{
+	FSpeechRecognitionLevel level;
+	LevelMeter.GetLevel(level.Peak, level.RMS, level.Decibels);
+	return level;
+}
+
+void FSpeechRecognitionWorker::GetLevelHistory(TArray<float>& OutLevels) const
+{
+	float levels[FSpeechLevelMeter::HistorySize];
+	const int32 num = LevelMeter.GetHistory(levels, FSpeechLevelMeter::HistorySize);
+	OutLevels.Reset(num);
+	OutLevels.Append(levels, num);
+}
+
+FSpeechRecognitionAudioStats FSpeechRecognitionWorker::GetAudioStats() const
+{
+	FSpeechRecognitionAudioStats stats;
+	stats.OverrunCount = (int32)AudioBuffer.GetOverrunCount();
+	stats.UnderrunCount = (int32)AudioBuffer.GetUnderrunCount();
+	stats.DroppedSamples = (int64)AudioBuffer.GetDroppedSamples();
+	stats.BufferedSamples = AudioBuffer.Num();
+	stats.FillLevel = AudioBuffer.GetFillLevel();
+	stats.DecodeWakeups = (int64)decodeWakeups.load(std::memory_order_relaxed);
+	stats.DecodeWaitSeconds = (float)decodeWaitSeconds.load(std::memory_order_relaxed);
+	{
+		FScopeLock lock(&DecodeCpuLock);
+		const int32 event = (int32)ESpeechRecognitionWaitMode::VE_EVENT;
+		const int32 poll = (int32)ESpeechRecognitionWaitMode::VE_POLL;
+		stats.DecodeCpuSecondsEvent = (float)decodeCpuSeconds[event];
+		stats.DecodeCpuSecondsPoll = (float)decodeCpuSeconds[poll];
+		stats.DecodeCpuLoadEvent = decodeCpuWallSeconds[event] > 0.0 ? (float)(decodeCpuSeconds[event] / decodeCpuWallSeconds[event]) : -1.0f;
+		stats.DecodeCpuLoadPoll = decodeCpuWallSeconds[poll] > 0.0 ? (float)(decodeCpuSeconds[poll] / decodeCpuWallSeconds[poll]) : -1.0f;
+		if (stats.DecodeCpuLoadEvent >= 0.0f && stats.DecodeCpuLoadPoll >= 0.0f) {
+			stats.DecodeCpuLoadSaved = stats.DecodeCpuLoadPoll - stats.DecodeCpuLoadEvent;
+		}
+	}
+	stats.EnergyGateOpen = EnergyGate->IsOpen();
+	stats.GatedSamples = (int64)EnergyGate->GetSkippedSamples();
+	stats.NoiseFloorDecibels = EnergyGate->GetNoiseFloor();
+	return stats;
+}
+
+void FSpeechRecognitionWorker::SetAudioSource(const TSharedPtr<ISpeechAudioSource>& InSource)
+{
+	FScopeLock lock(&AudioSourceLock);
+	PendingAudioSource = InSource;
+	bAudioSourceChanged = true;
+	AudioReadyEvent->Trigger();
+}
+
+bool FSpeechRecognitionWorker::IsAudioSourceFinished() const
+{
+	return Capture->IsSourceFinished() && AudioBuffer.Num() == 0;
+}
+
+bool FSpeechRecognitionWorker::StartCapture()
+{
+	{
+		FScopeLock lock(&AudioSourceLock);
+		if (bAudioSourceChanged) {
+			AudioSource = PendingAudioSource;
+			PendingAudioSource.Reset();
+			bAudioSourceChanged = false;
+		}
+	}
+
+	// fall back to the recording device named in the config
+	if (!AudioSource.IsValid()) {
+		const char* deviceName = cmd_ln_str_r(config, "-adcdev");
+		AudioSource = MakeShared<FSpeechDeviceAudioSource>(deviceName != NULL ? FString(UTF8_TO_TCHAR(deviceName)) : FString());
+	}
+
+	// size the capture buffer once nothing is writing to it, and start capturing
+	const int32 sampleRate = (int32)cmd_ln_float32_r(config, "-samprate");
+	Capture->Shutdown();
+	AudioBuffer.Reset(sampleRate * AudioBufferSeconds);
+	LevelMeter.Reset();
+	EnergyGate->Reset();
+	if (!Capture->Start(AudioSource, sampleRate)) {
+		return false;
+	}
+	captureSampleRate = sampleRate;
+
+	decodeStartTime = FPlatformTime::Seconds();
+	decodedSamples = 0;
+	streamFinishReported = false;
+	ClientMessage(FString::Printf(TEXT("Capturing audio from %s"), *AudioSource->GetDescription()));
+	return true;
+}
+
+void FSpeechRecognitionWorker::SetDecodeChunkSize(int32 InSamples)
+{
+	// picked up by the decode thread, before its next read
+	DecodeChunkSize.store(FMath::Clamp(InSamples, 64, 16384));
+	TargetLatencyMs.store(0);
+}
+
+void FSpeechRecognitionWorker::SetTargetLatency(int32 InMilliseconds)
+{
+	// converted to a chunk size by the decode thread, which knows the sample rate
+	TargetLatencyMs.store(FMath::Clamp(InMilliseconds, 5, 500));
+}
+
+void FSpeechRecognitionWorker::SetEnergyGateSettings(const FSpeechEnergyGateSettings& InSettings)
+{
+	FScopeLock lock(&EnergyGateLock);
+	PendingGateSettings = InSettings;
+	bEnergyGateChanged = true;
+}
+
+void FSpeechRecognitionWorker::SetTrimDictionary(bool bInTrimDictionary)
+{
+	QueueCommand([this, bInTrimDictionary]()
+	{
+		trimDictionary = bInTrimDictionary;
+		UpdateDictionary(false);
+	});
+}
+
+void FSpeechRecognitionWorker::SetNativeFrontEnd(bool bInNativeFrontEnd)
+{
+	bNativeFrontEnd = bInNativeFrontEnd;
+	if (decoderBuilt) {
+		QueueCommand([this]()
+		{
+			UpdateFrontEnd();
+		});
+	}
+}
+
+void FSpeechRecognitionWorker::UpdateFrontEnd()
+{
+	const bool wasActive = nativeFrontEndActive;
+	nativeFrontEndActive = false;
+	if (bNativeFrontEnd && config != NULL) {
+		FSpeechMfccFrontEnd::FSettings settings;
+		if (FSpeechMfccFrontEnd::ReadSettings(config, settings) && FrontEnd->Init(settings)) {
+			nativeFrontEndActive = true;
+			frontEndFrameShift = FrontEnd->GetFrameShift();
+			frontEndFrameSize = FrontEnd->GetFrameSize();
+		}
+		else {
+			ClientMessage(FString(TEXT("The native front end does not support this config, using sphinxbase's")));
+		}
+	}
+	if (nativeFrontEndActive != wasActive) {
+		ClientMessage(FString(nativeFrontEndActive ? TEXT("Using the native front end") : TEXT("Using sphinxbase's front end")));
+	}
+
+	// built afresh from the live config. The noise estimate starts over, as it does when the decoder's is rebuilt
+	if (sphinxFrontEnd != NULL) {
+		fe_free(sphinxFrontEnd);
+		sphinxFrontEnd = NULL;
+	}
+	if (!nativeFrontEndActive && config != NULL) {
+		sphinxFrontEnd = fe_init_auto_r(config);
+		if (sphinxFrontEnd == NULL) {
+			ClientMessage(FString(TEXT("Failed to build the front end")));
+			return;
+		}
+		fe_start_stream(sphinxFrontEnd);
+		fe_start_utt(sphinxFrontEnd);
+		fe_get_input_size(sphinxFrontEnd, &frontEndFrameShift, &frontEndFrameSize);
+
+		// a chunk's worth of frames at a time, with room for the VAD's pre-speech frames on top
+		const int32 numCepstra = fe_get_output_size(sphinxFrontEnd);
+		const int32 maxFrames = SphinxFramesPerCall + cmd_ln_int32_r(config, "-vad_prespeech");
+		sphinxCepstra.SetNumZeroed(maxFrames * numCepstra);
+		sphinxFramePointers.SetNum(maxFrames);
+		for (int32 i = 0; i < maxFrames; i++) {
+			sphinxFramePointers[i] = sphinxCepstra.GetData() + i * numCepstra;
+		}
+	}
+}
+
+bool FSpeechRecognitionWorker::ApplyGainControl()
+{
+	// feat_t picks the AGC type per block of frames, so it can change between utterances
+	feat_t* feat = ps_get_feat(ps);
+	const agc_type_t agc = agc_type_from_str(cmd_ln_str_r(config, "-agc"));
+	if (feat == NULL || (agc != AGC_NONE && feat->agc_struct == NULL)) {
+		return false;
+	}
+	feat->agc = agc;
+	if (feat->agc_struct != NULL) {
+		agc_set_threshold(feat->agc_struct, cmd_ln_float32_r(config, "-agcthresh"));
+	}
+	return true;
+}
+
+bool FSpeechRecognitionWorker::StartUtterance()
+{
+	// as ps_start_utt does for the decoder's own front end: only the partial frame is dropped, the noise estimate carries on
+	if (sphinxFrontEnd != NULL) {
+		fe_start_utt(sphinxFrontEnd);
+	}
+	utteranceFrames = 0;
+	return ps_start_utt(ps) >= 0;
+}
+
+void FSpeechRecognitionWorker::CountUtteranceFrames(int32 numFrames, int64 endSample)
+{
+	// the front end hands frames over as they fill, so the newest ends about where its input did.
+	// Pre-speech frames the VAD held back are older, and may span audio the energy gate skipped
+	if (utteranceFrames == 0) {
+		utteranceStartSample = FMath::Max<int64>(endSample - (int64)(numFrames - 1) * frontEndFrameShift - frontEndFrameSize, 0);
+	}
+	utteranceFrames += numFrames;
+}
+
+bool FSpeechRecognitionWorker::IsFrontEndInSpeech() const
+{
+	if (nativeFrontEndActive) {
+		return FrontEnd->IsInSpeech();
+	}
+	return sphinxFrontEnd != NULL && fe_get_vad_state(sphinxFrontEnd) != 0;
+}
+
+void FSpeechRecognitionWorker::DecodeSamples(const int16* samples, int32 numSamples, int64 captureSample)
+{
+	ptmr_start(&decodeTimer);
+	if (nativeFrontEndActive) {
+		int32 numFrames;
+		{
+			SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_FrontEnd);
+			numFrames = FrontEnd->Process(samples, numSamples);
+		}
+		if (numFrames > 0) {
+			SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_Decode);
+			CountUtteranceFrames(numFrames, captureSample + numSamples);
+			ps_process_cep(ps, FrontEnd->GetFrames(), numFrames, 0, 0);
+		}
+	}
+	else if (sphinxFrontEnd != NULL) {
+		size_t numRemaining = (size_t)numSamples;
+		while (numRemaining > 0) {
+			const size_t numBefore = numRemaining;
+			int32 numFrames = SphinxFramesPerCall;
+			{
+				SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_FrontEnd);
+				if (fe_process_frames(sphinxFrontEnd, &samples, &numRemaining, sphinxFramePointers.GetData(), &numFrames, NULL) < 0) {
+					break;
+				}
+			}
+			if (numFrames > 0) {
+				SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_Decode);
+				CountUtteranceFrames(numFrames, captureSample + (numSamples - (int64)numRemaining));
+				ps_process_cep(ps, sphinxFramePointers.GetData(), numFrames, 0, 0);
+			}
+			else if (numRemaining == numBefore) {
+				break;
+			}
+		}
+	}
+	ptmr_stop(&decodeTimer);
+}
+
+void FSpeechRecognitionWorker::ReportDecodeRate()
+{
+	// the decoder's own utterance timer runs from ps_start_utt, so it includes waiting for audio.
+	// Only its speech length is used, against the time spent in DecodeSamples
+	double speechSeconds, cpuSeconds, wallSeconds;
+	ps_get_utt_time(ps, &speechSeconds, &cpuSeconds, &wallSeconds);
+	const double decodeSeconds = decodeTimer.t_elapsed;
+	if (speechSeconds > 0.0 && decodeSeconds > 0.0) {
+		SPEECH_SET_FLOAT_GAUGE(STAT_SpeechRecognition_RealTimeFactor, (float)(decodeSeconds / speechSeconds));
+		SPEECH_SET_FLOAT_GAUGE(STAT_SpeechRecognition_FramesPerSecond, (float)(ps_get_n_frames(ps) / decodeSeconds));
+	}
+}
+
+void FSpeechRecognitionWorker::SetPartialHypothesisInterval(int32 InFrames)
+{
+	partialHypothesisFrames = FMath::Max(InFrames, 0);
+}
+
+void FSpeechRecognitionWorker::UpdatePartialHypothesis()
+{
+	const int32 interval = partialHypothesisFrames;
+	const int32 frameCount = ps_get_n_frames(ps);
+	if (interval <= 0 || frameCount - lastPartialFrame < interval) {
+		return;
+	}
+	lastPartialFrame = frameCount;
+
+	FString text;
+	{
+		SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_Hypothesis);
+		int32 score;
+		const char* hyp = ps_get_hyp(ps, &score);
+		if (hyp == NULL || *hyp == '\0' || lastPartialHypothesis == hyp) {
+			return;
+		}
+		lastPartialHypothesis = hyp;
+		text = GetReportedHypothesis(hyp);
+	}
+	NotifyManager([&text](USpeechRecognitionSubsystem& manager) { manager.PartialHypothesis_method(text); });
+}
+
+FString FSpeechRecognitionWorker::GetReportedHypothesis(const char* hyp)
+{
+	if (detectionMode != ESpeechRecognitionMode::VE_KEYWORD) {
+		return FString(UTF8_TO_TCHAR(FSpeechPhraseCompiler::StripVariants(hyp).c_str()));
+	}
+
+	// the keyphrase search's hypothesis is its detections, one segment each
+	std::string text;
+	for (ps_seg_t* iter = ps_seg_iter(ps); iter != NULL; iter = ps_seg_next(iter)) {
+		const char* word = ps_seg_word(iter);
+		const std::string* phrase = PhraseCompiler->FindPhrase(word);
+		if (!text.empty()) {
+			text += ' ';
+		}
+		text += phrase != nullptr ? *phrase : FSpeechPhraseCompiler::StripVariants(word);
+	}
+	return FString(UTF8_TO_TCHAR(text.c_str()));
+}
+
+void FSpeechRecognitionWorker::SetNBestSettings(const FSpeechNBestSettings& InSettings)
+{
+	FScopeLock lock(&ConfigLock);
+	NBestSettings = InSettings;
+}
+
+void FSpeechRecognitionWorker::ScoreHypotheses(const FSpeechNBestSettings& settings, FRecognisedPhrases& OutPhrases)
+{
+	logmath_t* lmath = ps_get_logmath(ps);
+
+	// posterior of the best path, from the lattice. The keyword search has none, and reports 1
+	OutPhrases.Confidence = (float)logmath_exp(lmath, ps_get_prob(ps));
+
+	if (settings.MaxHypotheses <= 0) {
+		return;
+	}
+
+	// the A* search has no bound of its own, so stop between hypotheses once the budget is spent
+	const double deadline = FPlatformTime::Seconds() + settings.TimeBudgetMs / 1000.0;
+	int32 total = logmath_get_zero(lmath);
+	for (ps_nbest_t* nbest = ps_nbest(ps); nbest != NULL; nbest = ps_nbest_next(nbest)) {
+		int32 score;
+		const char* hyp = ps_nbest_hyp(nbest, &score);
+		if (hyp != NULL) {
+			// paths that differ only in fillers or pronunciations read the same
+			const FString text = FString(UTF8_TO_TCHAR(FSpeechPhraseCompiler::StripVariants(hyp).c_str()));
+			if (!OutPhrases.Alternatives.ContainsByPredicate([&text](const FSpeechHypothesis& h) { return h.Text == text; })) {
+				FSpeechHypothesis& hypothesis = OutPhrases.Alternatives.AddDefaulted_GetRef();
+				hypothesis.Text = text;
+				hypothesis.Score = score;
+				total = logmath_add(lmath, total, score);
+			}
+		}
+		if (OutPhrases.Alternatives.Num() >= settings.MaxHypotheses || FPlatformTime::Seconds() > deadline) {
+			ps_nbest_free(nbest);
+			break;
 		}
+	}
 
-		const pair<map<string, char*>::iterator, bool> ret = this->keywords.insert(pair<string, char*>(wordStr, tolerance));
-		if (ret.second == false) {
-			this->keywords.erase(wordStr);
-			this->keywords.insert(pair<string, char*>(wordStr, tolerance));
+	for (FSpeechHypothesis& hypothesis : OutPhrases.Alternatives) {
+		hypothesis.Confidence = (float)logmath_exp(lmath, hypothesis.Score - total);
+	}
+}
+
+static void AssignString(FString& Out, const char* Text, int32 Length)
+{
+	// converted straight into the string's own buffer, which is kept when it is big enough
+	const FUTF8ToTCHAR converted(Text, Length);
+	Out.Reset(converted.Length());
+	Out.AppendChars(converted.Get(), converted.Length());
+}
+
+void FSpeechRecognitionWorker::CollectWords(float frameRate, bool bScored, FRecognisedPhrases& OutPhrases)
+{
+	logmath_t* lmath = ps_get_logmath(ps);
+	TArray<FRecognisedWord>& words = OutPhrases.Words;
+	int32 numWords = 0;
+
+	// segment frames are offset by where the utterance sits in the decoder's stream. Restarting the stream zeroes that,
+	// so they count from the utterance's first frame. Only the decoder's own front end, which is unused, starts over
+	ps_start_stream(ps);
+	for (ps_seg_t* iter = ps_seg_iter(ps); iter != NULL; iter = ps_seg_next(iter)) {
+		const char* word = ps_seg_word(iter);
+
+		// silence, sentence markers and noise words are not something that was said
+		if (word[0] == '<' || word[0] == '[' || word[0] == '+') {
+			continue;
 		}
+
+		// keyphrases fold back to their phrase. Other words lose their variant suffix, which becomes the variant number
+		int32 length = (int32)strlen(word);
+		int32 variant = 1;
+		if (length > 3 && word[length - 1] == ')') {
+			int32 open = length - 2;
+			while (open > 0 && word[open] >= '0' && word[open] <= '9') {
+				open--;
+			}
+			if (word[open] == '(' && open < length - 2) {
+				variant = atoi(word + open + 1);
+				length = open;
+			}
+		}
+		const std::string* phrase = detectionMode == ESpeechRecognitionMode::VE_KEYWORD ? PhraseCompiler->FindPhrase(word) : nullptr;
+		if (phrase != nullptr) {
+			word = phrase->c_str();
+			length = (int32)phrase->size();
+		}
+
+		int32 sf, ef, ascr, lscr, lback;
+		ps_seg_frames(iter, &sf, &ef);
+		if (numWords == words.Num()) {
+			words.AddDefaulted();
+		}
+		FRecognisedWord& record = words[numWords++];
+		AssignString(record.Word, word, length);
+		record.Variant = variant;
+		record.StartTime = (float)FMath::Max(sf, 0) / frameRate;
+		record.EndTime = (float)(ef + 1) / frameRate;
+		record.Confidence = bScored ? (float)logmath_exp(lmath, ps_seg_prob(iter, &ascr, &lscr, &lback)) : -1.0f;
+		UE_LOG(SpeechRecognitionPlugin, Verbose, TEXT("Word: %s Start Time: %.3f End Time %.3f"), *record.Word, record.StartTime, record.EndTime);
+	}
+
+	words.SetNum(numWords, EAllowShrinking::No);
+
+	// keyword detections can overlap, so order them by when they started
+	words.StableSort([](const FRecognisedWord& a, const FRecognisedWord& b) { return a.StartTime < b.StartTime; });
+
+	// Keyword detections are reported once per phrase, in detection order.
+	// Grammars and language models report every word
+	TArray<FString>& phraseSet = OutPhrases.phrases;
+	int32 numPhrases = 0;
+	for (const FRecognisedWord& record : words) {
+		const FString& phrase = record.Word;
+		if (detectionMode == ESpeechRecognitionMode::VE_KEYWORD
+			&& MakeArrayView(phraseSet.GetData(), numPhrases).ContainsByPredicate([&phrase](const FString& added) { return added.Equals(phrase, ESearchCase::CaseSensitive); })) {
+			continue;
+		}
+		if (numPhrases == phraseSet.Num()) {
+			phraseSet.AddDefaulted();
+		}
+		phraseSet[numPhrases++] = phrase;
 	}
+	phraseSet.SetNum(numPhrases, EAllowShrinking::No);
 }
 
-int16 FSpeechRecognitionWorker::GetCurrentVolume() const
+void FSpeechRecognitionWorker::SetWaitMode(ESpeechRecognitionWaitMode InWaitMode)
+{
+	WaitMode.store(InWaitMode);
+	AudioReadyEvent->Trigger();
+}
+
+void FSpeechRecognitionWorker::WaitForAudio(double Deadline)
+{
+	decodeWakeups.fetch_add(1, std::memory_order_relaxed);
+	INC_DWORD_STAT(STAT_SpeechRecognition_Wakeups);
+
+	// the loop this replaced: straight back to the buffer, without sleeping. Kept as the baseline the CPU figures compare against
+	if (WaitMode.load() == ESpeechRecognitionWaitMode::VE_POLL) {
+		return;
+	}
+
+	// wall time blocked on the event. What that saves in CPU is measured by AccountDecodeCpu
+	const double waitStart = FPlatformTime::Seconds();
+	const uint32 timeoutMs = (uint32)FMath::Max(FMath::CeilToInt((Deadline - waitStart) * 1000.0), 1);
+	AudioReadyEvent->Wait(timeoutMs);
+	const double waited = FPlatformTime::Seconds() - waitStart;
+	decodeWaitSeconds.store(decodeWaitSeconds.load(std::memory_order_relaxed) + waited, std::memory_order_relaxed);
+	INC_FLOAT_STAT_BY(STAT_SpeechRecognition_DecodeWaitMs, (float)(waited * 1000.0));
+}
+
+void FSpeechRecognitionWorker::AccountDecodeCpu()
 {
-	return currentVolume;
+	// the thread's own CPU clock, decoding included, so only runs over comparable audio compare
+	const double now = FPlatformTime::Seconds();
+	const ESpeechRecognitionWaitMode mode = WaitMode.load();
+	if (now - cpuSampleWallTime < 0.25 && mode == cpuSampleMode) {
+		return;
+	}
+	const double cpuSeconds = FSpeechThreadTime::GetCpuSeconds();
+	if (cpuSeconds >= 0.0 && cpuSampleSeconds >= 0.0) {
+		const double cpuUsed = cpuSeconds - cpuSampleSeconds;
+		const double wallUsed = now - cpuSampleWallTime;
+		{
+			FScopeLock lock(&DecodeCpuLock);
+			decodeCpuSeconds[(int32)cpuSampleMode] += cpuUsed;
+			decodeCpuWallSeconds[(int32)cpuSampleMode] += wallUsed;
+		}
+		SPEECH_SET_FLOAT_GAUGE(STAT_SpeechRecognition_DecodeCpuPercent, (float)(cpuUsed / wallUsed * 100.0));
+	}
+	cpuSampleSeconds = cpuSeconds;
+	cpuSampleWallTime = now;
+	cpuSampleMode = mode;
 }
 
 void FSpeechRecognitionWorker::SetLanguage(ESpeechRecognitionLanguage InLanguage) {
 
+	// applied by the decode thread, when the decoder is next rebuilt. A preloaded decoder is kept if it already speaks it
+	FScopeLock lock(&ConfigLock);
+	if (decoderRequested && !languageChanged && language == InLanguage) {
+		return;
+	}
+	this->language = InLanguage;
+	languageChanged = true;
+}
+
+void FSpeechRecognitionWorker::ApplyLanguage() {
+
 	// set Content Path
 	const FString contentPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir());
 	contentPath_str = std::string(TCHAR_TO_UTF8(*contentPath));
-	std::string languageString;
-	this->language = InLanguage;
+	languageChanged = false;
 
 	// language model and dictionary paths
-	switch (InLanguage) {
+	switch (language) {
 	case ESpeechRecognitionLanguage::VE_English:
 		langStr = (char*)"en";
 		break;
@@ -187,7 +1099,78 @@ void FSpeechRecognitionWorker::SetLanguage(ESpeechRecognitionLanguage InLanguage
 
 }
 
+//Sets one param on a config, by its type
+static void SetConfigValue(cmd_ln_t* cmdln, const std::string& name, const FSpeechRecognitionParam& param)
+{
+	switch (param.type) {
+	case ESpeechRecognitionParamType::VE_FLOAT:
+		cmd_ln_set_float_r(cmdln, name.c_str(), atof(param.value.c_str()));
+		break;
+	case ESpeechRecognitionParamType::VE_BOOLEAN:
+		cmd_ln_set_boolean_r(cmdln, name.c_str(), param.value == "1");
+		break;
+	case ESpeechRecognitionParamType::VE_STRING:
+		cmd_ln_set_str_r(cmdln, name.c_str(), param.value.c_str());
+		break;
+	case ESpeechRecognitionParamType::VE_INTEGER:
+		cmd_ln_set_int_r(cmdln, name.c_str(), atol(param.value.c_str()));
+		break;
+	}
+}
+
+//The type of a switch, from the decoder's argument definitions
+static bool FindParamType(const char* name, ESpeechRecognitionParamType& OutType)
+{
+	for (const arg_t* arg = ps_args(); arg->name != NULL; arg++) {
+		if (strcmp(arg->name, name) != 0) {
+			continue;
+		}
+		if (arg->type & ARG_INTEGER) {
+			OutType = ESpeechRecognitionParamType::VE_INTEGER;
+		}
+		else if (arg->type & ARG_FLOATING) {
+			OutType = ESpeechRecognitionParamType::VE_FLOAT;
+		}
+		else if (arg->type & ARG_BOOLEAN) {
+			OutType = ESpeechRecognitionParamType::VE_BOOLEAN;
+		}
+		else {
+			OutType = ESpeechRecognitionParamType::VE_STRING;
+		}
+		return true;
+	}
+	return false;
+}
+
+//What changing a param costs
+static ESpeechConfigChange GetParamChange(const std::string& name)
+{
+	static const std::set<std::string> reloadParams = { "-hmm", "-dict", "-fdict" };
+	static const std::set<std::string> frontEndParams = {
+		"-vad_threshold", "-vad_prespeech", "-vad_postspeech", "-remove_silence", "-remove_noise",
+		"-dither", "-seed", "-agc", "-agcthresh" };
+	static const std::set<std::string> searchParams = {
+		"-beam", "-wbeam", "-pbeam", "-lpbeam", "-lponlybeam", "-fwdflatbeam", "-fwdflatwbeam",
+		"-pl_beam", "-pl_pbeam", "-pl_pip", "-pl_weight", "-maxwpf", "-maxhmmpf",
+		"-lw", "-fwdflatlw", "-bestpathlw", "-ascale", "-wip", "-pip", "-uw", "-nwpen", "-silprob", "-fillprob",
+		"-fwdtree", "-fwdflat", "-bestpath", "-fwdflatefwid", "-fwdflatsfwin", "-toprule", "-fsgusefiller", "-fsgusealtpron",
+		"-kws_threshold", "-kws_plp", "-kws_delay" };
+
+	if (reloadParams.count(name) > 0) {
+		return ESpeechConfigChange::Reload;
+	}
+	if (frontEndParams.count(name) > 0) {
+		return ESpeechConfigChange::FrontEnd;
+	}
+	return searchParams.count(name) > 0 ? ESpeechConfigChange::Search : ESpeechConfigChange::Reinit;
+}
+
 void FSpeechRecognitionWorker::InitConfig() {
+	FScopeLock lock(&ConfigLock);
+	if (languageChanged || langStr == nullptr) {
+		ApplyLanguage();
+	}
+
 	argFilePath = contentPath_str + +"model/" + langStr + "/" + langStr + ".args";
 	logPath = contentPath_str + "log/";
 	modelPath = contentPath_str + "model/" + langStr + "/" + langStr;
@@ -202,104 +1185,314 @@ void FSpeechRecognitionWorker::InitConfig() {
 		"-dict", dictionaryPath.c_str(),
 		NULL);
 
-	// loop over, and set sphinx params	
-	for (const FSpeechRecognitionParam& param : sphinxParams)
-	{
-		if (param.type == ESpeechRecognitionParamType::VE_FLOAT)
+	// every param asked for, not only those changed since the last build, so a new language keeps them
+	for (const pair<const std::string, FSpeechRecognitionParam>& param : desiredParams) {
+		SetConfigValue(config, param.first, param.second);
+	}
+	appliedParams = desiredParams;
+
+	// the model and dictionary can be overridden too
+	modelPath = cmd_ln_str_r(config, "-hmm");
+	dictionaryPath = cmd_ln_str_r(config, "-dict");
+}
+
+void FSpeechRecognitionWorker::ScheduleConfigApply()
+{
+	if (decoderBuilt) {
+		QueueCommand([this]()
 		{
-			cmd_ln_set_float_r(config, param.name, atof(param.value));
+			ApplyConfigChanges();
+		});
+	}
+}
+
+void FSpeechRecognitionWorker::ApplyConfigChanges()
+{
+	FSpeechRecognitionParams desired;
+	{
+		FScopeLock lock(&ConfigLock);
+		desired = desiredParams;
+	}
+
+	// a param that is no longer set goes back to its default, which only a rebuilt config has
+	ESpeechConfigChange change = ESpeechConfigChange::None;
+	bool bSearchChanged = false;
+	for (const pair<const std::string, FSpeechRecognitionParam>& param : appliedParams) {
+		if (desired.count(param.first) == 0) {
+			change = ESpeechConfigChange::Reload;
 		}
-		if (param.type == ESpeechRecognitionParamType::VE_BOOLEAN)
-		{
-			if (_stricmp(param.value, "0") == 0)
-			{
-				cmd_ln_set_boolean_r(config, param.name, false);
-			}
-			if (_stricmp(param.value, "1") == 0)
-			{
-				cmd_ln_set_boolean_r(config, param.name, true);
+	}
+	for (const pair<const std::string, FSpeechRecognitionParam>& param : desired) {
+		const FSpeechRecognitionParams::const_iterator applied = appliedParams.find(param.first);
+		if (applied == appliedParams.end() || applied->second != param.second) {
+			const ESpeechConfigChange paramChange = GetParamChange(param.first);
+			bSearchChanged |= paramChange == ESpeechConfigChange::Search;
+			change = FMath::Max(change, paramChange);
+		}
+	}
+	if (change == ESpeechConfigChange::None) {
+		return;
+	}
+
+	const double startTime = FPlatformTime::Seconds();
+	if (change == ESpeechConfigChange::Reload) {
+		if (!RebuildDecoder()) {
+			// no decoder is left, so the run loop builds one from scratch, or stops
+			ClientMessage(FString(TEXT("Failed to reload the decoder")));
+			initRequired = true;
+			return;
+		}
+	}
+	else {
+		// the decoder shares this config, so setting a param changes it in place
+		for (const pair<const std::string, FSpeechRecognitionParam>& param : desired) {
+			const FSpeechRecognitionParams::const_iterator applied = appliedParams.find(param.first);
+			if (applied == appliedParams.end() || applied->second != param.second) {
+				SetConfigValue(config, param.first, param.second);
 			}
 		}
-		if (param.type == ESpeechRecognitionParamType::VE_STRING)
-		{
-			cmd_ln_set_str_r(config, param.name, param.value);
+		appliedParams = desired;
+
+		// VAD and noise settings only need the front end rebuilt, below. Gain control is switched in place if it can be
+		if (change == ESpeechConfigChange::FrontEnd && !ApplyGainControl()) {
+			change = ESpeechConfigChange::Reinit;
 		}
-		if (param.type == ESpeechRecognitionParamType::VE_INTEGER)
-		{
-			cmd_ln_set_int_r(config, param.name, atoi(param.value));
+
+		// a failed ps_reinit leaves the decoder half loaded, so it is rebuilt as a reload would
+		if (change == ESpeechConfigChange::Reinit && ps_reinit(ps, NULL) < 0) {
+			ClientMessage(FString(TEXT("Failed to reinitialise the decoder, rebuilding it")));
+			if (!RebuildDecoder()) {
+				ClientMessage(FString(TEXT("Failed to reload the decoder")));
+				initRequired = true;
+				return;
+			}
+		}
+		else if (change == ESpeechConfigChange::Reinit || bSearchChanged) {
+			RestoreSearches();
 		}
 	}
 
-	// reset params
-	sphinxParams.Empty();
+	// the front end may have changed rate, or VAD timing, which the capture and the energy gate follow
+	if (change != ESpeechConfigChange::Search) {
+		if (captureSampleRate != (int32)cmd_ln_float32_r(config, "-samprate")) {
+			StartCapture();
+		}
+		DecodeBuffer.Reset();
+		bEnergyGateChanged = true;
+		UpdateFrontEnd();
+	}
 
+	static const TCHAR* const changeNames[] = { TEXT("none"), TEXT("search"), TEXT("front end"), TEXT("reinit"), TEXT("reload") };
+	ClientMessage(FString::Printf(TEXT("Applied config changes (%s) in %.1f ms"), changeNames[(int32)change], (FPlatformTime::Seconds() - startTime) * 1000.0));
 }
 
 bool FSpeechRecognitionWorker::SetConfigParam(const FString& param, ESpeechRecognitionParamType type, const FString& value)
 {
-	const char* paramName = TCHAR_TO_UTF8(*param);
-	const char* paramValue = TCHAR_TO_UTF8(*value);
+	std::string paramValue = TCHAR_TO_UTF8(*value);
 
 	// Validate the incoming string, against the data type
-	if (type == ESpeechRecognitionParamType::VE_FLOAT)
-	{
-		const double validationFloat = atof(paramValue);
-		if (validationFloat == 0.0F) {
+	switch (type) {
+	case ESpeechRecognitionParamType::VE_FLOAT:
+		if (atof(paramValue.c_str()) == 0.0) {
 			return false;
 		}
-		const FSpeechRecognitionParam sphinxParam(paramName, type, paramValue);
-		sphinxParams.Add(sphinxParam);
-		return true;
-	}
-
-	if (type == ESpeechRecognitionParamType::VE_BOOLEAN)
-	{
+		break;
+	case ESpeechRecognitionParamType::VE_BOOLEAN:
 		if (value.Equals("true", ESearchCase::IgnoreCase)) {
 			paramValue = "1";
-			const FSpeechRecognitionParam sphinxParam(paramName, type, paramValue);
-			sphinxParams.Add(sphinxParam);
-			return true;
 		}
-		if (value.Equals("false", ESearchCase::IgnoreCase)) {
+		else if (value.Equals("false", ESearchCase::IgnoreCase)) {
 			paramValue = "0";
-			const FSpeechRecognitionParam sphinxParam(paramName, type, paramValue);
-			sphinxParams.Add(sphinxParam);
-			return true;
 		}
-		return false;
+		else {
+			return false;
+		}
+		break;
+	case ESpeechRecognitionParamType::VE_INTEGER:
+		if (!value.IsNumeric()) {
+			return false;
+		}
+		break;
+	default:
+		break;
 	}
 
-	if (type == ESpeechRecognitionParamType::VE_STRING)
 	{
-		const FSpeechRecognitionParam sphinxParam(paramName, type, paramValue);
-		sphinxParams.Add(sphinxParam);
-		return true;
+		FScopeLock lock(&ConfigLock);
+		desiredParams[TCHAR_TO_UTF8(*param)] = FSpeechRecognitionParam{ type, paramValue };
 	}
+	ScheduleConfigApply();
+	return true;
+}
 
-	if (type == ESpeechRecognitionParamType::VE_INTEGER)
+void FSpeechRecognitionWorker::SetDefaultConfigParams(bool bEnabled)
+{
+	static const pair<const char*, FSpeechRecognitionParam> defaultParams[] = {
+		{ "-vad_prespeech", FSpeechRecognitionParam{ ESpeechRecognitionParamType::VE_INTEGER, "10" } },
+		{ "-vad_postspeech", FSpeechRecognitionParam{ ESpeechRecognitionParamType::VE_INTEGER, "10" } },
+		{ "-agc", FSpeechRecognitionParam{ ESpeechRecognitionParamType::VE_STRING, "noise" } },
+		{ "-beam", FSpeechRecognitionParam{ ESpeechRecognitionParamType::VE_FLOAT, "1e-40" } },
+	};
+
+	bool bChanged = false;
 	{
-		if (value.IsNumeric()) {
-			const FSpeechRecognitionParam sphinxParam(paramName, type, paramValue);
-			sphinxParams.Add(sphinxParam);
-			return true;
+		FScopeLock lock(&ConfigLock);
+		for (const pair<const char*, FSpeechRecognitionParam>& param : defaultParams) {
+			const FSpeechRecognitionParams::iterator desired = desiredParams.find(param.first);
+			if (bEnabled && (desired == desiredParams.end() || desired->second != param.second)) {
+				desiredParams[param.first] = param.second;
+				bChanged = true;
+			}
+			else if (!bEnabled && desired != desiredParams.end() && desired->second == param.second) {
+				desiredParams.erase(desired);
+				bChanged = true;
+			}
 		}
-		return false;
 	}
-	return false;
+	if (bChanged) {
+		ScheduleConfigApply();
+	}
+}
+
+void FSpeechRecognitionWorker::SetConfig(const FSpeechRecognitionConfig& InConfig)
+{
+	FSpeechRecognitionParams params;
+	char buffer[64];
+	const auto setFloat = [&](const char* name, bool bOverride, double value) {
+		if (bOverride) {
+			snprintf(buffer, sizeof(buffer), "%.17g", value);
+			params[name] = FSpeechRecognitionParam{ ESpeechRecognitionParamType::VE_FLOAT, buffer };
+		}
+	};
+	const auto setInt = [&](const char* name, bool bOverride, int32 value) {
+		if (bOverride) {
+			params[name] = FSpeechRecognitionParam{ ESpeechRecognitionParamType::VE_INTEGER, std::to_string(value) };
+		}
+	};
+	const auto setString = [&](const char* name, const FString& value) {
+		if (!value.IsEmpty()) {
+			params[name] = FSpeechRecognitionParam{ ESpeechRecognitionParamType::VE_STRING, TCHAR_TO_UTF8(*value) };
+		}
+	};
+
+	setString("-hmm", InConfig.AcousticModel);
+	setString("-dict", InConfig.Dictionary);
+	setFloat("-beam", InConfig.bOverride_Beam, InConfig.Beam);
+	setFloat("-wbeam", InConfig.bOverride_WordBeam, InConfig.WordBeam);
+	setFloat("-pbeam", InConfig.bOverride_PhoneBeam, InConfig.PhoneBeam);
+	setFloat("-lw", InConfig.bOverride_LanguageWeight, InConfig.LanguageWeight);
+	setFloat("-wip", InConfig.bOverride_WordInsertionPenalty, InConfig.WordInsertionPenalty);
+	setFloat("-silprob", InConfig.bOverride_SilenceProbability, InConfig.SilenceProbability);
+	setFloat("-fillprob", InConfig.bOverride_FillerProbability, InConfig.FillerProbability);
+	setFloat("-vad_threshold", InConfig.bOverride_VadThreshold, InConfig.VadThreshold);
+	setInt("-vad_prespeech", InConfig.bOverride_VadPreSpeech, InConfig.VadPreSpeech);
+	setInt("-vad_postspeech", InConfig.bOverride_VadPostSpeech, InConfig.VadPostSpeech);
+	setString("-agc", InConfig.Agc);
+	setString("-cmn", InConfig.Cmn);
+
+	for (const TPair<FString, FString>& extra : InConfig.ExtraParams) {
+		std::string name = TCHAR_TO_UTF8(*extra.Key);
+		if (name.empty() || name[0] != '-') {
+			name = "-" + name;
+		}
+		ESpeechRecognitionParamType type;
+		if (!FindParamType(name.c_str(), type)) {
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Ignoring unknown config param %s"), *extra.Key);
+			continue;
+		}
+		std::string value = TCHAR_TO_UTF8(*extra.Value);
+		if (type == ESpeechRecognitionParamType::VE_BOOLEAN) {
+			value = (extra.Value.Equals(TEXT("true"), ESearchCase::IgnoreCase) || extra.Value == TEXT("1")) ? "1" : "0";
+		}
+		params[name] = FSpeechRecognitionParam{ type, value };
+	}
+
+	{
+		FScopeLock lock(&ConfigLock);
+		desiredParams = MoveTemp(params);
+	}
+	ScheduleConfigApply();
 }
 
 void FSpeechRecognitionWorker::Stop() {
 	StopTaskCounter.Increment();
+	AudioReadyEvent->Trigger();
 }
 
-bool FSpeechRecognitionWorker::StartThread(USpeechRecognitionSubsystem* manager) {
-	Manager = manager;
+bool FSpeechRecognitionWorker::StartThread() {
 	const int32 threadIdx = ISpeechRecognition::Get().GetInstanceCounter();
 	const FString threadName = FString("FSpeechRecognitionWorker:") + FString::FromInt(threadIdx);
 	Thread = FRunnableThread::Create(this, *threadName, 0U, TPri_Highest);
 	return true;
 }
 
+void FSpeechRecognitionWorker::AddManager(USpeechRecognitionSubsystem* manager) {
+	{
+		FScopeLock lock(&ManagerLock);
+		if (manager == nullptr || Managers.Contains(manager)) {
+			return;
+		}
+		Managers.Add(manager);
+		// a worker taken over after it finished loading is ready straight away
+		if (recognizerReady) {
+			manager->RecognizerReady_method(loadTimings);
+		}
+	}
+	// wake the decode thread, so capture starts without waiting out a poll
+	AudioReadyEvent->Trigger();
+}
+
+void FSpeechRecognitionWorker::RemoveManager(USpeechRecognitionSubsystem* manager) {
+	{
+		// notifications run under this lock, so none is in flight once it is taken
+		FScopeLock lock(&ManagerLock);
+		Managers.Remove(manager);
+	}
+	AudioReadyEvent->Trigger();
+}
+
+void FSpeechRecognitionWorker::NotifyWordsSpoken(FRecognisedPhrases& phrases) {
+	FScopeLock lock(&ManagerLock);
+	for (int32 i = 0; i < Managers.Num(); i++) {
+		if (i + 1 < Managers.Num()) {
+			FRecognisedPhrases copy = phrases;
+			Managers[i]->WordsSpoken_method(copy);
+		}
+		else {
+			Managers[i]->WordsSpoken_method(phrases);
+		}
+	}
+}
+
+void FSpeechRecognitionWorker::Preload() {
+	bool bRebuild = false;
+	{
+		FScopeLock lock(&ConfigLock);
+		if (!decoderRequested || languageChanged) {
+			initRequired = true;
+			decoderRequested = true;
+			bRebuild = true;
+		}
+	}
+	// the loaded decoder is about to be replaced, so it is not ready until the new one is
+	if (bRebuild) {
+		FScopeLock lock(&ManagerLock);
+		recognizerReady = false;
+	}
+	AudioReadyEvent->Trigger();
+}
+
+void FSpeechRecognitionWorker::ReportRecognizerReady(const FSpeechRecognizerLoadTimings& timings) {
+	ClientMessage(FString::Printf(TEXT("Recognizer ready in %.1f ms (config %.1f, dictionary %.1f, decoder %.1f, searches %.1f, capture %.1f)"),
+		timings.TotalMs, timings.ConfigMs, timings.DictionaryMs, timings.DecoderMs, timings.SearchesMs, timings.CaptureMs));
+	FScopeLock lock(&ManagerLock);
+	loadTimings = timings;
+	recognizerReady = true;
+	for (USpeechRecognitionSubsystem* manager : Managers) {
+		manager->RecognizerReady_method(loadTimings);
+	}
+}
+
 void FSpeechRecognitionWorker::ClientMessage(const FString& text) {
 	UE_LOG(SpeechRecognitionPlugin, Log, TEXT("%s"), *text);
 }
@@ -308,135 +1501,68 @@ void FSpeechRecognitionWorker::ClientMessage(const FString& text) {
 uint32 FSpeechRecognitionWorker::Run() {
 
 	bool initComplete = false;
+	double lastDecodeTime = 0.0;
+	double chunkSeconds = 0.0;
 	while (StopTaskCounter.GetValue() == 0) {
+		AccountDecodeCpu();
 
 		// loop until we have initialised 
 		if (initRequired) {
 
-			ps = ps_init(config);
-
-			if (!Manager | !ps) {
+			// capture keeps running while the decoder is rebuilt, so nothing said in the meantime is lost
+			const double initStart = FPlatformTime::Seconds();
+			initRequired = false;
+			if (!RebuildDecoder()) {
 				ClientMessage(FString(TEXT("Speech Recognition Thread failed to start")));
 				return 1;
 			}
+			decoderBuilt = true;
+			// params set while the decoder was being built
+			ApplyConfigChanges();
+			if (initRequired) {
+				continue;
+			}
+			UpdateFrontEnd();
 
 			ClientMessage(FString(TEXT("Speech Recognition has started")));
 
-			if (detectionMode == ESpeechRecognitionMode::VE_KEYWORD) {
-
-				// include multiple definitions
-				std::ifstream file(dictionaryPath);
-				std::string currentLine;
-				dictionary.clear();
-				while (file.good())
-				{
-					std::getline(file, currentLine);
-					std::string rawWord = currentLine.substr(0, currentLine.find(" "));
-					std::string mappedWord = "";
-					std::size_t beginBracket = rawWord.find("(");
-					std::size_t endBracket = rawWord.find(")");
-					if (beginBracket != std::string::npos && endBracket != std::string::npos)
-					{
-						mappedWord = rawWord.substr(0, beginBracket);
-					}
-					else {
-						mappedWord = rawWord;
-					}
-
-					std::set<std::string> mappings;
-					if (dictionary.find(mappedWord) != dictionary.end()) {
-						mappings = dictionary.at(mappedWord);
-						mappings.insert(rawWord);
-						dictionary[mappedWord] = mappings;
-					}
-					mappings.insert(rawWord);
-					dictionary.insert(make_pair(mappedWord, mappings));
-				}
-
-				// set key-phrases
-				map<string, char*>::iterator it;
-				char** phrases = (char**)malloc(keywords.size() * sizeof(char*));
-				int32* tolerances;
-				tolerances = (int32*)malloc(keywords.size() * sizeof(int32));
-				int i = 0;
-
-				for (it = keywords.begin(); it != keywords.end(); ++it) {
-
-					// check if the word is in the dictionary. If missing, omit the phrase, and log
-					vector<string> splitString = Split(it->first);
-					vector<string>::iterator v_It;
-					std::locale loc;
-
-					bool skip = false;
-					for (v_It = splitString.begin(); v_It != splitString.end(); ++v_It) {
-						string orginalStr = GetOriginalString(splitString[0]);
-						if (dictionary.find(orginalStr) == dictionary.end())
-						{
-							skip = true;
-							continue;
-						}
-						if (dictionary.find(*v_It) == dictionary.end()) {
-							std::set<string> wordSet = dictionary.at(orginalStr);
-							if (wordSet.size() > 1) {
-								std::string Strtxt = "The word '" + orginalStr + "' has multiple definitions, ensure multiple phrases (for each phonetic match) is added.";
-								const char* txt = Strtxt.c_str();
-								FString msg = FString(UTF8_TO_TCHAR(txt));
-								UE_LOG(SpeechRecognitionPlugin, Log, TEXT("WARNING: %s "), *msg);
-							}
-							if (wordSet.find(*v_It) == wordSet.end()) {
-								skip = true;
-							}
-						}
-					}
-
-					if (skip)
-					{
-						std::string Strtxt = "The phrase '" + it->first + "' can not be added, as it contains words that are not in the dictionary.";
-						const char* txt = Strtxt.c_str();
-						FString msg = FString(UTF8_TO_TCHAR(txt));
-						UE_LOG(SpeechRecognitionPlugin, Log, TEXT("SKIPPED PHRASE: %s "), *msg);
-						continue;
-					}
-
-					//add all variations of the keyword, to ensure dictionary variations are detected
-					char* str;
-					str = (char *)malloc(it->first.size() + 1);
-					memcpy(str, it->first.c_str(), it->first.size() + 1);
-					phrases[i] = str;
-
-					//tolerance
-					int32 toleranceInt = (int32)logmath_log(ps_get_logmath(ps), atof(it->second)) >> SENSCR_SHIFT;
-					tolerances[i] = toleranceInt;
-					i++;
-				}
-
-				int phraseCnt = i;
-				const char** const_copy = (const char**)phrases;
-				ps_set_keyphrase(ps, "keyphrase_search", const_copy, tolerances, phraseCnt);
-				ps_set_search(ps, "keyphrase_search");
-			}
-
-			// attempt to open the default recording device
-			if ((ad = ad_open_dev(cmd_ln_str_r(config, "-adcdev"),
-				(int)cmd_ln_float32_r(config,
-					"-samprate"))) == NULL) {
-				ClientMessage(FString(TEXT("Failed to open audio device")));
-				return 2;
+			// switch to the search that was asked for
+			FSpeechRecognizerLoadTimings timings = buildTimings;
+			const double commandsStart = FPlatformTime::Seconds();
+			RunCommands();
+			if (initRequired) {
+				continue;
 			}
-
-			if (ad_start_rec(ad) < 0) {
-				ClientMessage(FString(TEXT("Failed to start recording")));
-				return 3;
+			timings.SearchesMs += (float)((FPlatformTime::Seconds() - commandsStart) * 1000.0);
+
+			// only reopen the audio source if the sample rate changed. A preloaded worker waits for a manager before it listens
+			const double captureStart = FPlatformTime::Seconds();
+			if (HasManager() && (!Capture->IsRunning() || captureSampleRate != (int32)cmd_ln_float32_r(config, "-samprate"))) {
+				if (!StartCapture()) {
+					ClientMessage(FString(TEXT("Failed to start audio capture")));
+					return 2;
+				}
 			}
+			timings.CaptureMs = (float)((FPlatformTime::Seconds() - captureStart) * 1000.0);
 
-			if (ps_start_utt(ps) < 0) {
+			if (!StartUtterance()) {
 				ClientMessage(FString(TEXT("Failed to start utterance")));
 				return 4;
 			}
 
-			initRequired = false;
 			initComplete = true;
 			utt_started = 0;
+			lastDecodeTime = FPlatformTime::Seconds();
+			// the sample rate may have changed, so size the next chunk afresh
+			DecodeBuffer.Reset();
+			bEnergyGateChanged = true;
+
+			timings.TotalMs = (float)((FPlatformTime::Seconds() - initStart) * 1000.0);
+			ReportRecognizerReady(timings);
+
+			// building the decoder is not part of either wait mode's cost
+			cpuSampleSeconds = FSpeechThreadTime::GetCpuSeconds();
+			cpuSampleWallTime = FPlatformTime::Seconds();
 		}
 		else {
 			if (initComplete == false) {
@@ -448,48 +1574,168 @@ uint32 FSpeechRecognitionWorker::Run() {
 			}
 		}
 
-		if ((k = ad_read(ad, adbuf, 1024)) < 0)
-			ClientMessage(FString(TEXT("Failed to read audio")));
-		ps_process_raw(ps, adbuf, k, 0, 0);
-		in_speech = ps_get_in_speech(ps);
+		// switch searches, and run anything else queued for this thread, between utterances
+		if (!utt_started && !Commands.IsEmpty()) {
+			SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_SearchSwitch);
+			const double switchStart = FPlatformTime::Seconds();
+			ps_end_utt(ps);
+			RunCommands();
+			// a config change that failed to reload the decoder left none to start
+			if (initRequired) {
+				continue;
+			}
+			if (!StartUtterance()) {
+				ClientMessage(FString(TEXT("Failed to start utterance")));
+				return 4;
+			}
+			ClientMessage(FString::Printf(TEXT("Switched to %s in %.3f ms"), UTF8_TO_TCHAR(activeSearch.c_str()), (FPlatformTime::Seconds() - switchStart) * 1000.0));
+		}
 
-		// update the peak volume
-		vector<int16> peaks;
-		int currentPeak = 0;
-		for (int i = 0; i < k; i++)
-		{
-			if (adbuf[i] > currentPeak && adbuf[0] > 0)
-			{
-				currentPeak = adbuf[i];
+		// parked between levels. The decoder stays loaded, but nothing is captured until a manager takes it over
+		if (!HasManager()) {
+			if (utt_started) {
+				ps_end_utt(ps);
+				StartUtterance();
+				utt_started = 0;
 			}
-			if (adbuf[i] < 0 && currentPeak != 0)
-			{
-				// add peak to the collection, and reset current peak
-				peaks.push_back(currentPeak);
-				currentPeak = 0;
+			if (Capture->IsRunning()) {
+				Capture->Shutdown();
+				ClientMessage(FString(TEXT("Recognizer parked, audio capture stopped")));
+			}
+			AudioReadyEvent->Wait(100);
+			continue;
+		}
+		if (!Capture->IsRunning() && !bAudioSourceChanged) {
+			// a device that stopped mid stream is retried, rather than ending the thread
+			const bool bRestart = Capture->HasSourceFailed();
+			if (!StartCapture()) {
+				if (!bRestart) {
+					ClientMessage(FString(TEXT("Failed to start audio capture")));
+					return 2;
+				}
+				AudioReadyEvent->Wait(1000);
+				continue;
+			}
+			else {
+				if (bRestart) {
+					ClientMessage(FString(TEXT("Audio capture restarted")));
+				}
+				lastDecodeTime = FPlatformTime::Seconds();
 			}
 		}
 
-		int32 peakSum = 0;
-		for (int16 peak : peaks)
-		{
-			peakSum += peak;
+		// swap to a new audio source, between utterances
+		if (bAudioSourceChanged && !utt_started) {
+			if (!StartCapture()) {
+				ClientMessage(FString(TEXT("Failed to start audio capture")));
+				return 2;
+			}
+			lastDecodeTime = FPlatformTime::Seconds();
 		}
-		if (peakSum > 0)
-		{
-			currentVolume = peakSum / peaks.size();			
+
+		// drain the capture buffer a chunk at a time
+		const float sampleRate = cmd_ln_float32_r(config, "-samprate");
+		const int32 targetLatencyMs = TargetLatencyMs.load();
+		const int32 chunkSize = targetLatencyMs > 0 ? FMath::Clamp((int32)(sampleRate * targetLatencyMs / 1000.0f), 64, 16384) : DecodeChunkSize.load();
+		if (DecodeBuffer.Num() != chunkSize) {
+			DecodeBuffer.SetNumZeroed(chunkSize);
+			chunkSeconds = (double)chunkSize / sampleRate;
+			AudioBuffer.SetReaderEvent(AudioReadyEvent, chunkSize);
+			Capture->SetPollInterval((float)chunkSeconds * 0.25f);
+		}
+
+		// apply new energy gate settings between utterances
+		if (bEnergyGateChanged && !utt_started) {
+			FScopeLock lock(&EnergyGateLock);
+			const float minHangover = (float)cmd_ln_int32_r(config, "-vad_postspeech") / (float)cmd_ln_int32_r(config, "-frate");
+			EnergyGate->Configure(PendingGateSettings, (int32)sampleRate, minHangover + (float)chunkSeconds);
+			bEnergyGateChanged = false;
+		}
+
+		// a finite source has been fully decoded. Close off any trailing utterance, then idle
+		const bool endOfStream = IsAudioSourceFinished();
+		if (endOfStream && !utt_started) {
+			if (!streamFinishReported) {
+				const double audioSeconds = (double)decodedSamples / cmd_ln_float32_r(config, "-samprate");
+				const double wallSeconds = FPlatformTime::Seconds() - decodeStartTime;
+				ClientMessage(FString::Printf(TEXT("Finished decoding %s: %.2f s of audio in %.2f s (real-time factor %.3f)"),
+					*AudioSource->GetDescription(), audioSeconds, wallSeconds, audioSeconds > 0.0 ? wallSeconds / audioSeconds : 0.0));
+				streamFinishReported = true;
+			}
+			// nothing more will arrive until the source changes, which signals the event
+			AudioReadyEvent->Wait(100);
+			continue;
+		}
+
+		const int16* adbuf = DecodeBuffer.GetData();
+		k = 0;
+		if (!endOfStream) {
+			// wait for a full chunk, unless the capture thread has stalled for longer than two chunks
+			const double now = FPlatformTime::Seconds();
+			if (AudioBuffer.Num() < chunkSize && now - lastDecodeTime < chunkSeconds * 2.0) {
+				WaitForAudio(lastDecodeTime + chunkSeconds * 2.0);
+				continue;
+			}
+			lastDecodeTime = now;
+
+			if ((k = AudioBuffer.Read(DecodeBuffer.GetData(), chunkSize)) == 0)
+				continue;
+			decodedSamples += k;
+
+			// update the volume
+			LevelMeter.Process(adbuf, k);
+
+			// only score audio that is likely to be speech. The decoder's own VAD holds the gate open until it ends the utterance
+			const bool decoderInSpeech = utt_started || IsFrontEndInSpeech();
+			if (EnergyGate->Process(adbuf, k, LevelMeter.GetDecibels(), decoderInSpeech)) {
+				int32 preRollNum;
+				const int16* preRoll = EnergyGate->ConsumePreRoll(preRollNum);
+				// the pre-roll is the gated audio just before this chunk
+				const int64 chunkStart = (int64)decodedSamples - k;
+				if (preRollNum > 0) {
+					DecodeSamples(preRoll, preRollNum, chunkStart - preRollNum);
+				}
+				DecodeSamples(adbuf, k, chunkStart);
+			}
+			else {
+				INC_DWORD_STAT_BY(STAT_SpeechRecognition_GatedSamples, k);
+			}
+			SET_DWORD_STAT(STAT_SpeechRecognition_GateOpen, EnergyGate->IsOpen() ? 1 : 0);
+			SET_FLOAT_STAT(STAT_SpeechRecognition_GateNoiseFloor, EnergyGate->GetNoiseFloor());
+			in_speech = IsFrontEndInSpeech();
+		}
+		else {
+			in_speech = 0;
 		}
 
 		// transition from silence to listening
 		if (in_speech && !utt_started) {
+			SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_VadTransition);
 			utt_started = 1;
+			utteranceId = NextUtteranceId++;
+			lastPartialFrame = ps_get_n_frames(ps);
+			lastPartialHypothesis.clear();
 			ClientMessage(FString(TEXT("Listening")));
-			Manager->StartedSpeaking_method();
+			NotifyManager([](USpeechRecognitionSubsystem& manager) { manager.StartedSpeaking_method(); });
+		}
+
+		// report the hypothesis so far, without waiting for the end of speech
+		if (in_speech && utt_started) {
+			UpdatePartialHypothesis();
 		}
 
 		// transition from listening to silence
 		if (!in_speech && utt_started) {
 
+			// Listening period has ended. The final hypothesis, and the lattice, need the utterance closed
+			const double speechEndTime = FPlatformTime::Seconds();
+			TRACE_BOOKMARK(TEXT("Utterance %d speech end"), utteranceId);
+			{
+				SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_VadTransition);
+				ps_end_utt(ps);
+			}
+			ReportDecodeRate();
+
 			// obtain a count of the number of frames, and the hypothesis phrase spoken
 			int frame_rate = cmd_ln_int32_r(config, "-frate");
 			int32 frameCount = ps_get_n_frames(ps);
@@ -497,83 +1743,67 @@ uint32 FSpeechRecognitionWorker::Run() {
 
 			// re-loop, if there is no hypothesis
 			if (ps_get_hyp(ps, &score) != NULL) {
+				// swapped with a pooled event's by the manager, so this holds an earlier utterance's result, buffers and all
+				FRecognisedPhrases& recognisedPhrases = resultPhrases;
+				recognisedPhrases.Confidence = 1.0f;
+				recognisedPhrases.Alternatives.Reset();
+				recognisedPhrases.BroadcastTime = 0.0;
 
-
-				TArray<FString> phraseSet;
-				map<float, std::string> orderedPhrases;
-				map<float, std::string>::iterator it;
-
-				ps_seg_t *iter = ps_seg_iter(ps);
-
-				// Orders the detected phrases into a map.
-				// Key = seconds from the start of speech recognition detection.
-				// Value = the phrase that was detected.
-				while (iter != NULL) {
-					int32 sf, ef;
-					ps_seg_frames(iter, &sf, &ef);
-					std::string word(ps_seg_word(iter));
-					float startTime = ((float)sf / frame_rate);
-					float endTime = ((float)ef / frame_rate);
-					// For debug purposes. Logs the raw detected phrase + time they were detected
-					UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Word: %s Start Time: %.3f End Time %.3f"), UTF8_TO_TCHAR(word.c_str()), startTime, endTime);
-					orderedPhrases.insert(pair<float, std::string>(startTime, word));
-					iter = ps_seg_next(iter);
+				FSpeechNBestSettings nbestSettings;
+				{
+					FScopeLock lock(&ConfigLock);
+					nbestSettings = NBestSettings;
 				}
-
-				// Loops through the ordered phrases (in detection order).
-				// We only pickup and use the first detection, of each unique phrase. 
-				// This is to handle words defined with multiple phonetic definitions
-				for (it = orderedPhrases.begin(); it != orderedPhrases.end(); ++it) {
-					std::string hypStr = it->second;
-					std::string originalHypothesis = GetOriginalString(hypStr);
-					FString phrase = FString(UTF8_TO_TCHAR(originalHypothesis.c_str()));
-					if (detectionMode == ESpeechRecognitionMode::VE_KEYWORD)
-					{
-						if (!phraseSet.Contains(phrase))
-						{
-							phraseSet.Add(phrase);
-							ClientMessage(phrase);
-							UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Phrases: %s "), *phrase);
-						}
-					}
-					if (detectionMode == ESpeechRecognitionMode::VE_GRAMMAR)
-					{
-						if (phrase != "sil")
-						{
-							phraseSet.Add(phrase);
-							ClientMessage(phrase);
-							UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Phrases: %s "), *phrase);
-						}
-					}
-					if (detectionMode == ESpeechRecognitionMode::VE_LANGUAGE_MODEL)
-					{
-						if (phrase != "s" && phrase != "sil")
-						{
-							phraseSet.Add(phrase);
-							ClientMessage(phrase);
-							UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Phrases: %s "), *phrase);
-						}
+				{
+					SPEECH_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognition_Hypothesis);
+					// scored first, so the word segments carry the lattice posteriors
+					const bool bScored = nbestSettings.MaxHypotheses > 0 || nbestSettings.MinConfidence > 0.0f;
+					if (bScored) {
+						ScoreHypotheses(nbestSettings, recognisedPhrases);
 					}
+
+					CollectWords((float)frame_rate, bScored, recognisedPhrases);
+				}
+				recognisedPhrases.UtteranceId = utteranceId;
+				recognisedPhrases.StreamStartTime = (double)utteranceStartSample / cmd_ln_float32_r(config, "-samprate");
+				recognisedPhrases.SpeechEndTime = speechEndTime;
+				recognisedPhrases.HypothesisTime = FPlatformTime::Seconds();
+				TRACE_BOOKMARK(TEXT("Utterance %d hypothesis ready"), utteranceId);
+
+				for (const FString& phrase : recognisedPhrases.phrases) {
+					ClientMessage(phrase);
+					UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Phrases: %s "), *phrase);
 				}
 
-				FRecognisedPhrases recognisedPhrases;
-				recognisedPhrases.phrases = phraseSet;
-				Manager->WordsSpoken_method(recognisedPhrases);
+				// drop doubtful results here, rather than waking up whatever listens for them
+				if (recognisedPhrases.Confidence < nbestSettings.MinConfidence) {
+					UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Discarded a result with confidence %.3f"), recognisedPhrases.Confidence);
+					NotifyManager([](USpeechRecognitionSubsystem& manager) { manager.UnknownPhrase_method(); });
+				}
+				else {
+					// the VAD only ends speech after -vad_postspeech frames without it, which are part of the delay
+					const double hangoverMs = cmd_ln_int32_r(config, "-vad_postspeech") * 1000.0 / frame_rate;
+					SPEECH_SET_FLOAT_GAUGE(STAT_SpeechRecognition_ResultDelayMs, (float)(hangoverMs + (FPlatformTime::Seconds() - speechEndTime) * 1000.0));
+					NotifyWordsSpoken(recognisedPhrases);
+				}
 			}
 			else {
-				Manager->UnknownPhrase_method();
+				NotifyManager([](USpeechRecognitionSubsystem& manager) { manager.UnknownPhrase_method(); });
 			}
 
-			// Listening period has ended
-			ps_end_utt(ps);
-			if (ps_start_utt(ps) < 0)
+			if (!StartUtterance())
 				ClientMessage(FString(TEXT("Failed to start")));
+			ptmr_reset(&decodeTimer);
 			utt_started = 0;
-			Manager->StoppedSpeaking_method();
+			NotifyManager([](USpeechRecognitionSubsystem& manager) { manager.StoppedSpeaking_method(); });
 		}
 	}
 
-	ad_close(ad);
+	Capture->Shutdown();
+	if (sphinxFrontEnd != NULL) {
+		fe_free(sphinxFrontEnd);
+		sphinxFrontEnd = NULL;
+	}
 	ps_free(ps);
 	cmd_ln_free_r(config);
 
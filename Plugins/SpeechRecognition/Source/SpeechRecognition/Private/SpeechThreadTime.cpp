@@ -0,0 +1,29 @@
+#include "SpeechThreadTime.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#elif PLATFORM_UNIX || PLATFORM_MAC
+#include <time.h>
+#endif
+
+double FSpeechThreadTime::GetCpuSeconds()
+{
+#if PLATFORM_WINDOWS
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!::GetThreadTimes(::GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+		return -1.0;
+	}
+	// both in 100 ns units
+	const uint64 kernel = ((uint64)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+	const uint64 user = ((uint64)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+	return (double)(kernel + user) * 1e-7;
+#elif PLATFORM_UNIX || PLATFORM_MAC
+	struct timespec now;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+		return -1.0;
+	}
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#else
+	return -1.0;
+#endif
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * CPU time used by the calling thread, for telling how much of a core the decode thread costs.
+ * FPlatformTime only reports the whole process', which the game's own threads swamp.
+ */
+struct FSpeechThreadTime
+{
+	/** Seconds of CPU, user and kernel, the calling thread has used. Negative where the platform can not tell */
+	static double GetCpuSeconds();
+};
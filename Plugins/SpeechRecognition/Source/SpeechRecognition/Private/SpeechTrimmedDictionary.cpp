@@ -0,0 +1,114 @@
+#include "SpeechTrimmedDictionary.h"
+#include "SpeechDictionaryIndex.h"
+#include "SpeechRecognitionWorker.h"
+#include "HAL/FileManager.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include <atomic>
+
+static std::atomic<int32> NextTrimmedDictionaryId(1);
+
+FSpeechTrimmedDictionary::FSpeechTrimmedDictionary()
+	: FilePrefix(FString::Printf(TEXT("%u_%d"), FPlatformProcess::GetCurrentProcessId(), NextTrimmedDictionaryId++))
+{
+}
+
+FSpeechTrimmedDictionary::~FSpeechTrimmedDictionary()
+{
+	SetLoaded(FString());
+}
+
+void FSpeechTrimmedDictionary::Reset()
+{
+	Words.clear();
+}
+
+bool FSpeechTrimmedDictionary::AddPhrase(const std::string& Phrase)
+{
+	bool bAdded = false;
+	size_t start = 0;
+	while (start < Phrase.size()) {
+		start = Phrase.find_first_not_of(" \t", start);
+		if (start == std::string::npos) {
+			break;
+		}
+		size_t end = Phrase.find_first_of(" \t", start);
+		if (end == std::string::npos) {
+			end = Phrase.size();
+		}
+
+		// every pronunciation of a word is kept, so read(2) brings in read
+		size_t wordEnd = end;
+		if (Phrase[end - 1] == ')') {
+			const size_t bracket = Phrase.find('(', start);
+			if (bracket != std::string::npos && bracket > start && bracket < end) {
+				wordEnd = bracket;
+			}
+		}
+		bAdded |= Words.insert(Phrase.substr(start, wordEnd - start)).second;
+		start = end;
+	}
+	return bAdded;
+}
+
+bool FSpeechTrimmedDictionary::AddGrammar(fsg_model_t* Grammar)
+{
+	bool bAdded = false;
+	for (int32 wid = 0; wid < fsg_model_n_word(Grammar); wid++) {
+		bAdded |= AddPhrase(fsg_model_word_str(Grammar, wid));
+	}
+	return bAdded;
+}
+
+FString FSpeechTrimmedDictionary::Write(const FSpeechDictionaryIndex& Index, FSpeechDictionaryFootprint& OutFootprint)
+{
+	OutFootprint = FSpeechDictionaryFootprint();
+	if (!Index.IsOpen()) {
+		return FString();
+	}
+
+	// words the grammar uses for silence and sentence boundaries are not in the dictionary, and are skipped here
+	std::string text;
+	for (const std::string& word : Words) {
+		const int32 wordIndex = Index.FindWord(word.c_str(), (int32)word.size());
+		if (wordIndex == INDEX_NONE) {
+			continue;
+		}
+		OutFootprint.NumWords++;
+		OutFootprint.NumEntries += Index.GetNumVariants(wordIndex);
+		for (int32 v = 0; v < Index.GetNumVariants(wordIndex); v++) {
+			text += Index.GetVariant(wordIndex, v);
+			text += ' ';
+			text += Index.GetPhones(wordIndex, v);
+			text += '\n';
+		}
+	}
+
+	OutFootprint.Bytes = (int64)text.size();
+
+	// named after this instance and the contents, so an unchanged vocabulary reuses the same file
+	const uint32 crc = FCrc::MemCrc32(text.data(), (int32)text.size());
+	const FString path = FPaths::ProjectSavedDir() / TEXT("SpeechRecognition") / TEXT("TrimmedDictionary")
+		/ FString::Printf(TEXT("%s_%s_%08x.dict"), *FPaths::GetBaseFilename(Index.GetDictionaryPath()), *FilePrefix, crc);
+
+	IFileManager& fileManager = IFileManager::Get();
+	if (!fileManager.FileExists(*path)) {
+		const FString tempPath = path + TEXT(".tmp");
+		TArrayView<const uint8> bytes((const uint8*)text.data(), (int32)text.size());
+		if (!FFileHelper::SaveArrayToFile(bytes, *tempPath) || !fileManager.Move(*path, *tempPath, true, true)) {
+			UE_LOG(SpeechRecognitionPlugin, Log, TEXT("Failed to write the trimmed dictionary %s"), *path);
+			return FString();
+		}
+	}
+
+	return path;
+}
+
+void FSpeechTrimmedDictionary::SetLoaded(const FString& Path)
+{
+	if (!LoadedPath.IsEmpty() && LoadedPath != Path) {
+		IFileManager::Get().Delete(*LoadedPath, false, true, true);
+	}
+	LoadedPath = Path;
+}
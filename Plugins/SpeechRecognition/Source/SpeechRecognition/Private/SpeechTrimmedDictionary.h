@@ -0,0 +1,56 @@
+#pragma once
+
+#include <sphinxbase/fsg_model.h>
+
+#include "CoreMinimal.h"
+#include <set>
+#include <string>
+
+class FSpeechDictionaryIndex;
+struct FSpeechDictionaryFootprint;
+
+/**
+ * The words the active searches can actually produce, and a dictionary file holding only their pronunciations.
+ *
+ * Keyword lists and grammars use a tiny fraction of a full dictionary, so the decoder can be given this subset instead,
+ * through -dict at init or ps_load_dict later. The vocabulary only grows until Reset, so reloading the subset never drops
+ * a word a registered search still uses.
+ *
+ * Each instance writes its own files, as the decoder rereads -dict on ps_reinit, and deletes them once no longer loaded.
+ *
+ * Used from the decode thread only.
+ */
+class FSpeechTrimmedDictionary
+{
+public:
+	FSpeechTrimmedDictionary();
+	/** Deletes the file last loaded */
+	~FSpeechTrimmedDictionary();
+
+	/** Forgets the vocabulary */
+	void Reset();
+
+	/** Adds each whitespace separated word of Phrase, with any (n) variant suffix stripped. Returns true if a word was new */
+	bool AddPhrase(const std::string& Phrase);
+
+	/** Adds every word a compiled grammar can produce. Returns true if a word was new */
+	bool AddGrammar(fsg_model_t* Grammar);
+
+	/** Number of distinct words */
+	int32 Num() const { return (int32)Words.size(); }
+
+	/**
+	 * Writes every pronunciation of the vocabulary, looked up in Index, to a dictionary file under Saved.
+	 * Returns the path, or an empty string on failure. OutFootprint counts the words found in the dictionary, and what was written.
+	 */
+	FString Write(const FSpeechDictionaryIndex& Index, FSpeechDictionaryFootprint& OutFootprint);
+
+	/** The decoder now reads Path, or the full dictionary when empty. The file loaded before it is deleted */
+	void SetLoaded(const FString& Path);
+
+private:
+	std::set<std::string> Words;
+	// unique to this instance, across processes too, so no other decoder's -dict is ever deleted
+	FString FilePrefix;
+	FString LoadedPath;
+};
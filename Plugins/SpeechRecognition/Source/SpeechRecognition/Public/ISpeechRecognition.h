@@ -5,6 +5,11 @@
 #include "SpeechRecognition.h"
 #include "Modules/ModuleManager.h"
 
+class FSpeechRecognitionWorker;
+class FSpeechModelCache;
+class USpeechRecognitionSubsystem;
+enum class ESpeechRecognitionLanguage : uint8;
+
 class ISpeechRecognition : public IModuleInterface
 {
 
@@ -30,5 +35,29 @@ public:
 		return instanceCtr++;
 	}
 
+	/**
+	 * Starts loading the shared recognizer in the background, so the model is ready before a level asks for it.
+	 * Does nothing if it is loaded or loading already
+	 */
+	virtual void Preload(ESpeechRecognitionLanguage Language) = 0;
+
+	/**
+	 * The one recognizer every world shares, e.g. each client of a multi-player PIE session, with Manager added to it.
+	 * Starts loading it if there is none. The module owns it; each call is matched by a ReleaseWorker
+	 */
+	virtual FSpeechRecognitionWorker* AcquireWorker(USpeechRecognitionSubsystem* Manager) = 0;
+
+	/**
+	 * Removes Manager from the shared recognizer. Once no world holds it, it stays loaded for the next level,
+	 * or is unloaded if bUnload is set. Nothing is reported to Manager once this returns
+	 */
+	virtual void ReleaseWorker(USpeechRecognitionSubsystem* Manager, bool bUnload) = 0;
+
+	/** Dictionary indices and log tables shared by every recognizer in the process */
+	virtual FSpeechModelCache& GetModelCache() = 0;
+
+	/** The language the last recognizer was loaded for, which the next level preloads */
+	virtual ESpeechRecognitionLanguage GetLastLanguage() const = 0;
+
 };
 
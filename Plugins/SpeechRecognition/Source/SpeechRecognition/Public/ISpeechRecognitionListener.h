@@ -0,0 +1,35 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpeechRecognition.h"
+
+/** Where a native listener is called from */
+enum class ESpeechListenerThread : uint8
+{
+	/** Straight from the recognition thread, as each event happens. Keep the work short, it delays decoding */
+	Worker,
+	/** From the subsystem's tick, in order with the Blueprint events */
+	GameThread
+};
+
+/**
+ * Receives recognition events in C++, without the reflection and copies the Blueprint delegates need.
+ * Register with USpeechRecognitionSubsystem::AddListener. Payloads are only valid for the duration of the call.
+ * Every method has an empty default, so a listener only overrides what it needs.
+ *
+ * Worker thread listeners are called while the recognition thread holds its manager lock, which keeps the subsystem alive.
+ * From a callback they may add or remove listeners, themselves included, and call the subsystem's setters. They must not
+ * wait on the game thread, which may be waiting for that lock, or call Shutdown, which waits for the recognition thread.
+ */
+class ISpeechRecognitionListener
+{
+public:
+	virtual ~ISpeechRecognitionListener() {}
+
+	virtual void OnStartedSpeaking() {}
+	virtual void OnStoppedSpeaking() {}
+	virtual void OnWordsSpoken(const FRecognisedPhrases& Phrases) {}
+	virtual void OnUnknownPhrase() {}
+	virtual void OnPartialHypothesis(const FString& Text) {}
+	virtual void OnRecognizerReady(const FSpeechRecognizerLoadTimings& Timings) {}
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+class FEvent;
+
+/**
+ * Lock-free single-producer / single-consumer ring of 16-bit PCM samples.
+ *
+ * The capture thread is the only writer and the decode thread is the only reader.
+ * Storage is allocated once in Reset(), so neither side touches the heap while audio flows.
+ * When the reader falls behind and the ring is full, incoming samples are dropped and
+ * counted as an overrun instead of blocking the capture thread.
+ * The reader can block on an event instead of polling; the writer triggers it once enough samples are buffered.
+ */
+class SPEECHRECOGNITION_API FSpeechAudioRingBuffer
+{
+public:
+	FSpeechAudioRingBuffer();
+	explicit FSpeechAudioRingBuffer(int32 InMinCapacity);
+
+	/** (Re)allocates the ring to hold at least InMinCapacity samples, and clears all counters. Not thread safe. */
+	void Reset(int32 InMinCapacity);
+
+	/** Producer side. Copies up to NumSamples into the ring, and returns how many were accepted. */
+	int32 Write(const int16* Samples, int32 NumSamples);
+
+	/**
+	 * Producer side. Reserves up to NumSamples of free space, so the producer can fill it in place without a staging copy.
+	 * The space may wrap, so it is handed out as two regions. Returns the number of samples reserved.
+	 */
+	int32 BeginWrite(int32 NumSamples, int16*& OutFirst, int32& OutFirstNum, int16*& OutSecond, int32& OutSecondNum);
+
+	/** Producer side. Publishes NumSamples of the space handed out by BeginWrite */
+	void EndWrite(int32 NumSamples);
+
+	/** Consumer side. Copies up to NumSamples out of the ring, and returns how many were read. */
+	int32 Read(int16* OutSamples, int32 NumSamples);
+
+	/**
+	 * Consumer side. Triggers InEvent whenever a write leaves at least InThreshold samples buffered.
+	 * Pass nullptr to stop signalling. The event must outlive the writer.
+	 */
+	void SetReaderEvent(FEvent* InEvent, int32 InThreshold);
+
+	/** Triggers the reader event, regardless of how much is buffered. Used to report the end of a stream */
+	void WakeReader();
+
+	/** Consumer side. Discards everything currently buffered. */
+	void Flush();
+
+	/** Number of samples currently buffered */
+	int32 Num() const;
+
+	/** Number of samples that can be written before the ring is full */
+	int32 Slack() const;
+
+	int32 GetCapacity() const { return Capacity; }
+
+	/** Buffered samples as a fraction of the capacity, 0..1 */
+	float GetFillLevel() const;
+
+	/** Number of writes that could not be stored in full */
+	uint32 GetOverrunCount() const { return OverrunCount.load(std::memory_order_relaxed); }
+
+	/** Number of reads that found the ring empty */
+	uint32 GetUnderrunCount() const { return UnderrunCount.load(std::memory_order_relaxed); }
+
+	/** Total samples thrown away by overruns */
+	uint64 GetDroppedSamples() const { return DroppedSamples.load(std::memory_order_relaxed); }
+
+private:
+	/** Producer side. Triggers the reader event if the write at cursor InWrite filled the ring past the threshold */
+	void NotifyReader(uint32 InWrite);
+
+	TArray<int16> Samples;
+	int32 Capacity = 0;
+	uint32 Mask = 0;
+
+	// Read and write cursors are free running, and live on separate cache lines to avoid false sharing
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> WriteCursor;
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> ReadCursor;
+
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> OverrunCount;
+	std::atomic<uint32> UnderrunCount;
+	std::atomic<uint64> DroppedSamples;
+
+	std::atomic<FEvent*> ReaderEvent;
+	std::atomic<int32> ReaderThreshold;
+};
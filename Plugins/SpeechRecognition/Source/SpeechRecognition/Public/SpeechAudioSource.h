@@ -0,0 +1,118 @@
+#pragma once
+
+#include <sphinxbase/ad.h>
+
+#include "CoreMinimal.h"
+
+class FSpeechAudioRingBuffer;
+
+/**
+ * Somewhere the recognizer can pull 16-bit mono PCM from.
+ *
+ * Sources are opened, read and closed on the capture thread only.
+ * Real-time sources (devices) are drained as fast as they produce samples, and may overrun the capture buffer.
+ * Push sources (the engine's audio mixer) are not polled at all; they write into the capture buffer from their own callback.
+ * Other sources (files, memory) are only read as fast as the capture buffer has room, so they never drop audio
+ * and can run faster than real time.
+ */
+class SPEECHRECOGNITION_API ISpeechAudioSource
+{
+public:
+	virtual ~ISpeechAudioSource() {}
+
+	/** Prepares the source to deliver samples at SampleRate */
+	virtual bool Open(int32 SampleRate) = 0;
+
+	/** Releases anything acquired by Open */
+	virtual void Close() = 0;
+
+	/** Copies up to MaxSamples into OutSamples. Returns the number copied, 0 if nothing is ready yet, or <0 on error */
+	virtual int32 Read(int16* OutSamples, int32 MaxSamples) = 0;
+
+	/** True when the source is paced by a real clock, such as a recording device */
+	virtual bool IsRealTime() const = 0;
+
+	/** True once a finite source has delivered all of its samples */
+	virtual bool IsFinished() const { return false; }
+
+	/** Playback speed for non real-time sources, as a multiple of real time. 0 delivers samples as fast as they are consumed */
+	virtual float GetPlaybackSpeed() const { return 0.0f; }
+
+	/** Name used in log messages */
+	virtual FString GetDescription() const = 0;
+
+	/**
+	 * True for sources that are driven by someone else's callback, and write into the capture buffer themselves.
+	 * Push sources are never polled; Read is not called on them.
+	 */
+	virtual bool IsPushSource() const { return false; }
+
+	/** Gives a push source the buffer to write into, or nullptr to detach it. The source must be the buffer's only writer */
+	virtual void BindOutput(FSpeechAudioRingBuffer* InRingBuffer) {}
+};
+
+/** Captures from a recording device, through sphinxbase ad */
+class SPEECHRECOGNITION_API FSpeechDeviceAudioSource : public ISpeechAudioSource
+{
+public:
+	/** DeviceName may be empty, to use the default recording device */
+	explicit FSpeechDeviceAudioSource(const FString& InDeviceName = FString());
+	virtual ~FSpeechDeviceAudioSource() override;
+
+	virtual bool Open(int32 SampleRate) override;
+	virtual void Close() override;
+	virtual int32 Read(int16* OutSamples, int32 MaxSamples) override;
+	virtual bool IsRealTime() const override { return true; }
+	virtual FString GetDescription() const override;
+
+private:
+	FString DeviceName;
+	ad_rec_t* Device = nullptr;
+};
+
+/** Plays back samples that are already in memory */
+class SPEECHRECOGNITION_API FSpeechMemoryAudioSource : public ISpeechAudioSource
+{
+public:
+	FSpeechMemoryAudioSource(TArray<int16>&& InSamples, int32 InSampleRate, float InPlaybackSpeed = 0.0f);
+	FSpeechMemoryAudioSource(const int16* InSamples, int32 NumSamples, int32 InSampleRate, float InPlaybackSpeed = 0.0f);
+
+	virtual bool Open(int32 SampleRate) override;
+	virtual void Close() override {}
+	virtual int32 Read(int16* OutSamples, int32 MaxSamples) override;
+	virtual bool IsRealTime() const override { return false; }
+	virtual bool IsFinished() const override { return Position >= Samples.Num(); }
+	virtual float GetPlaybackSpeed() const override { return PlaybackSpeed; }
+	virtual FString GetDescription() const override;
+
+	/** Seconds of audio held by this source */
+	double GetDuration() const { return SampleRateHz > 0 ? (double)Samples.Num() / SampleRateHz : 0.0; }
+
+protected:
+	FSpeechMemoryAudioSource(int32 InSampleRate, float InPlaybackSpeed);
+
+	TArray<int16> Samples;
+	int32 SampleRateHz = 0;
+	float PlaybackSpeed = 0.0f;
+	int32 Position = 0;
+};
+
+/**
+ * Plays back a 16-bit mono WAV, or headerless PCM (.raw / .pcm) file.
+ * The whole file is loaded on Open, through bio_read_wavfile.
+ */
+class SPEECHRECOGNITION_API FSpeechFileAudioSource : public FSpeechMemoryAudioSource
+{
+public:
+	explicit FSpeechFileAudioSource(const FString& InFilePath, float InPlaybackSpeed = 0.0f);
+
+	virtual bool Open(int32 SampleRate) override;
+	virtual void Close() override;
+	virtual FString GetDescription() const override;
+
+private:
+	/** Checks the RIFF header describes audio the decoder can consume. Returns the size of the header to skip */
+	bool ValidateWavHeader(int32 SampleRate, int32& OutHeaderSize) const;
+
+	FString FilePath;
+};
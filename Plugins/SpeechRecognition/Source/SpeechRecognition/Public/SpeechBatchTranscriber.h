@@ -0,0 +1,139 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpeechRecognition.h"
+#include <atomic>
+
+class ISpeechAudioSource;
+class FSpeechBatchDecodeThread;
+
+/** A stretch of speech in a recording, as the decoder's VAD split it */
+struct FSpeechBatchUtterance
+{
+	FString Text;
+
+	/** Seconds from the start of the recording */
+	float StartTime = 0.0f;
+	float EndTime = 0.0f;
+
+	/** Every word with its timing, here in seconds from the start of the recording */
+	TArray<FRecognisedWord> Words;
+};
+
+/** Everything recognised in one recording */
+struct FSpeechBatchResult
+{
+	/** What AddFile, AddSamples or AddSource returned for it */
+	int32 Index = INDEX_NONE;
+	FString Source;
+	bool bSuccess = false;
+
+	TArray<FSpeechBatchUtterance> Utterances;
+
+	double AudioSeconds = 0.0;
+	double DecodeSeconds = 0.0;
+	/** Which decoder of the pool ran it */
+	int32 Decoder = 0;
+};
+
+struct FSpeechBatchSettings
+{
+	ESpeechRecognitionLanguage Language = ESpeechRecognitionLanguage::VE_English;
+
+	/** lm:<name> for model/<lang>/language_models/<name>.lm, or grammar:<name> for model/<lang>/grammars/<name>.gram */
+	FString Search;
+
+	/** Extra decoder switches, e.g. -beam 1e-60. -hmm and -dict override the language's */
+	TMap<FString, FString> Params;
+
+	/**
+	 * Decoders in the pool, each with its own copy of the model. 0 runs one per physical core, capped to as many as
+	 * the model's estimated size fits in three quarters of the free physical memory
+	 */
+	int32 NumDecoders = 0;
+};
+
+/**
+ * Transcribes recordings offline, as fast as the machine allows, instead of playing them through the recognizer in real time.
+ *
+ * Each decoder of the pool runs on its own thread, with its own ps_decoder_t. Nothing is shared between them: each loads
+ * the acoustic model and parses the dictionary itself, so memory grows with NumDecoders, and the default pool is capped
+ * by free memory rather than only by cores. Recordings are dealt out largest first, and a decoder that runs out takes
+ * the next recording of the one with the most audio left, so the pool stays busy until the end.
+ * A recording is decoded by one decoder from start to end: the longest one bounds the batch's wall time.
+ *
+ * Files are loaded whole when their decoder gets to them, and released when it is done.
+ */
+class SPEECHRECOGNITION_API FSpeechBatchTranscriber
+{
+public:
+	explicit FSpeechBatchTranscriber(const FSpeechBatchSettings& InSettings);
+	/** Cancels what is left, and waits for the decoders */
+	~FSpeechBatchTranscriber();
+
+	/** Queues a 16-bit mono WAV or raw file at the model's sample rate. Returns the index its result will have */
+	int32 AddFile(const FString& FilePath);
+	/** Queues samples at SampleRate, which has to be the model's */
+	int32 AddSamples(TArray<int16>&& Samples, int32 SampleRate);
+	/** Queues any finite source. NumSamples is an estimate of its length, used to balance the pool */
+	int32 AddSource(const TSharedRef<ISpeechAudioSource>& Source, int64 NumSamples);
+
+	/**
+	 * Starts decoding everything queued. Nothing can be added afterwards.
+	 * OnResult is called as each recording finishes, in no particular order, and OnFinished once all of them have.
+	 * Both are called from the decode threads, one call at a time
+	 */
+	bool Start(TFunction<void(const FSpeechBatchResult&)> InOnResult, TFunction<void()> InOnFinished = nullptr);
+
+	/** Stops after the recordings being decoded. Their results, and those not started, are reported as failed */
+	void Cancel();
+
+	/** Blocks until every decoder is done */
+	void Wait();
+
+	bool IsFinished() const { return bStarted && NumRunning.load() == 0; }
+	int32 Num() const { return Items.Num(); }
+	int32 GetNumCompleted() const { return NumCompleted.load(); }
+	int32 GetNumDecoders() const { return Threads.Num(); }
+
+private:
+	friend class FSpeechBatchDecodeThread;
+
+	struct FItem
+	{
+		TSharedRef<ISpeechAudioSource> Source;
+		int64 NumSamples;
+	};
+
+	/** Recordings waiting for a decoder, next first. Its owner and thieves both take from the front */
+	struct FWorkQueue
+	{
+		FCriticalSection Lock;
+		TArray<int32> Items;
+		int64 NumSamples = 0;
+	};
+
+	/** The next recording for a decoder: its own, else one stolen from the busiest queue. INDEX_NONE when all are taken */
+	int32 TakeItem(int32 Decoder);
+	int32 PopFront(FWorkQueue& Queue);
+
+	/** Serializes OnResult, and calls OnFinished after the last one */
+	void ReportResult(const FSpeechBatchResult& Result);
+	void DecoderFinished();
+
+	FSpeechBatchSettings Settings;
+	TArray<FItem> Items;
+	TArray<TUniquePtr<FWorkQueue>> Queues;
+	TArray<TUniquePtr<FSpeechBatchDecodeThread>> Threads;
+
+	TFunction<void(const FSpeechBatchResult&)> OnResult;
+	TFunction<void()> OnFinished;
+	FCriticalSection ResultLock;
+
+	bool bStarted = false;
+	std::atomic<bool> bCancelled = false;
+	std::atomic<int32> NumRunning = 0;
+	std::atomic<int32> NumCompleted = 0;
+	double StartTime = 0.0;
+	double TotalAudioSeconds = 0.0;
+};
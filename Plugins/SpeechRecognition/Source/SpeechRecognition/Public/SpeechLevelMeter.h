@@ -0,0 +1,52 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * Measures peak, RMS and dBFS of each decoded chunk, and keeps a short history of RMS levels.
+ *
+ * Written by the decode thread only, and read from any thread without locks. Readers get a consistent snapshot
+ * through a sequence counter, retrying on the rare frame that overlaps a write. Nothing here touches the heap.
+ */
+class SPEECHRECOGNITION_API FSpeechLevelMeter
+{
+public:
+	/** Number of chunks kept in the history window */
+	static constexpr int32 HistorySize = 64;
+
+	/** Level of silence, in dBFS */
+	static constexpr float MinDecibels = -96.0f;
+
+	FSpeechLevelMeter();
+
+	/** Writer side. Measures a chunk, and publishes the result */
+	void Process(const int16* Samples, int32 NumSamples);
+
+	/** Writer side. Clears the current level and the history */
+	void Reset();
+
+	/** Absolute peak of the last chunk, 0..32767 */
+	int32 GetPeak() const { return Peak.load(std::memory_order_relaxed); }
+
+	/** RMS of the last chunk, 0..1 of full scale */
+	float GetRMS() const { return RMS.load(std::memory_order_relaxed); }
+
+	/** RMS of the last chunk, in dBFS */
+	float GetDecibels() const { return Decibels.load(std::memory_order_relaxed); }
+
+	/** Peak, RMS and dBFS of the last chunk, all from the same chunk */
+	void GetLevel(int32& OutPeak, float& OutRMS, float& OutDecibels) const;
+
+	/** Copies the RMS history, oldest first, into OutLevels. Returns the number of entries written, at most HistorySize */
+	int32 GetHistory(float* OutLevels, int32 MaxLevels) const;
+
+private:
+	std::atomic<uint32> Sequence;
+	std::atomic<int32> Peak;
+	std::atomic<float> RMS;
+	std::atomic<float> Decibels;
+
+	std::atomic<float> History[HistorySize];
+	std::atomic<uint32> HistoryCount;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AudioCaptureCore.h"
+#include "SpeechAudioSource.h"
+#include <atomic>
+
+class FSpeechResampler;
+class FSpeechSubmixTap;
+class USoundSubmix;
+class UWorld;
+
+/**
+ * Base for sources fed by the engine's audio pipeline.
+ *
+ * Incoming float audio is downmixed to mono, resampled to the decoder's -samprate, and converted to int16
+ * straight into the capture buffer, so there is no staging copy between the engine callback and the decoder.
+ */
+class SPEECHRECOGNITION_API FSpeechMixerAudioSource : public ISpeechAudioSource
+{
+public:
+	FSpeechMixerAudioSource();
+	virtual ~FSpeechMixerAudioSource() override;
+
+	virtual bool Open(int32 SampleRate) override;
+	virtual int32 Read(int16* OutSamples, int32 MaxSamples) override { return 0; }
+	virtual bool IsRealTime() const override { return true; }
+	virtual bool IsPushSource() const override { return true; }
+	virtual void BindOutput(FSpeechAudioRingBuffer* InRingBuffer) override;
+
+protected:
+	/** Called from the engine's audio thread with interleaved float audio */
+	void PushAudio(const float* InterleavedAudio, int32 NumFrames, int32 NumChannels, int32 InSampleRate);
+
+private:
+	std::atomic<FSpeechAudioRingBuffer*> Output;
+	int32 TargetSampleRate = 0;
+
+	TUniquePtr<FSpeechResampler> Resampler;
+	TArray<float> MonoScratch;
+	TArray<float> ResampledScratch;
+};
+
+/** Opens the platform's default input device through the engine's AudioCapture, rather than sphinxbase ad */
+class SPEECHRECOGNITION_API FSpeechAudioCaptureSource : public FSpeechMixerAudioSource
+{
+public:
+	virtual ~FSpeechAudioCaptureSource() override;
+
+	virtual bool Open(int32 SampleRate) override;
+	virtual void Close() override;
+	virtual FString GetDescription() const override;
+
+private:
+	Audio::FAudioCapture AudioCapture;
+	FString DeviceName;
+};
+
+/**
+ * Taps the output of a submix, so a microphone that is already routed through the mixer
+ * (an AudioCapture component, for example) can feed recognition without opening the device a second time.
+ */
+class SPEECHRECOGNITION_API FSpeechSubmixAudioSource : public FSpeechMixerAudioSource
+{
+public:
+	/** A null Submix taps the main submix of the world's audio device, which mixes in everything the game plays as well */
+	FSpeechSubmixAudioSource(UWorld* InWorld, USoundSubmix* InSubmix);
+	virtual ~FSpeechSubmixAudioSource() override;
+
+	virtual bool Open(int32 SampleRate) override;
+	virtual void Close() override;
+	virtual FString GetDescription() const override;
+
+private:
+	friend class FSpeechSubmixTap;
+
+	TWeakObjectPtr<UWorld> World;
+	TWeakObjectPtr<USoundSubmix> Submix;
+	FString SubmixName;
+	TSharedPtr<FSpeechSubmixTap, ESPMode::ThreadSafe> Tap;
+};
@@ -2,10 +2,53 @@
 
 #include "Engine.h"
 #include "Kismet/GameplayStatics.h"
+#include "Async/Future.h"
 #include "ISpeechRecognition.h"
 #include "SpeechRecognition.generated.h"
 
 //Common structures and enumerations
+USTRUCT(BlueprintType)
+struct FSpeechHypothesis
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	FString Text;
+
+	/** Path score, in the decoder's log base */
+	UPROPERTY(BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	int32 Score = 0;
+
+	/** Share of the probability across the returned hypotheses, 0..1 */
+	UPROPERTY(BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float Confidence = 0.0f;
+};
+
+USTRUCT(BlueprintType)
+struct FRecognisedWord
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** The word as the dictionary spells it, without a pronunciation suffix. Keyword searches report the whole phrase */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	FString Word;
+
+	/** Which of the dictionary's pronunciations was heard, 1 for the first. For keyphrases, that of the last word */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int32 Variant = 1;
+
+	/** Seconds from the utterance's first decoded frame. Add the phrases' StreamStartTime for the time in the captured audio */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float StartTime = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float EndTime = 0.0f;
+
+	/** Posterior probability of the word, 0..1. Only scored when SetNBest enables scoring, -1 otherwise */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float Confidence = -1.0f;
+};
+
 USTRUCT(BlueprintType)
 struct FRecognisedPhrases
 {
@@ -14,11 +57,327 @@ struct FRecognisedPhrases
 	UPROPERTY(BlueprintReadWrite, Category = "Audio|SpeechRecognition")
 	TArray<FString> phrases;
 
+	/** Posterior probability of the best hypothesis, 0..1. Left at 1 unless SetNBest enables scoring, and for keyword searches */
+	UPROPERTY(BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float Confidence = 1.0f;
+
+	/** The best hypotheses, best first, when N-best is enabled. Grammar and language model searches only */
+	UPROPERTY(BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	TArray<FSpeechHypothesis> Alternatives;
+
+	/** Every word of the best hypothesis with its timing, in the order they were spoken */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	TArray<FRecognisedWord> Words;
+
+	/** Identifies the utterance to whatever reacts to it, e.g. as the correlation id of an LLM prompt. Unique in the process, never 0 */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int32 UtteranceId = 0;
+
+	/**
+	 * Seconds of captured audio before the utterance's first decoded frame, to within a frame. Counts the audio the energy gate
+	 * skipped, so it places the words in the capture stream, which starts over whenever capture (re)starts
+	 */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	double StreamStartTime = 0.0;
+
+	/** FPlatformTime::Seconds() when the VAD ended the utterance */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	double SpeechEndTime = 0.0;
+
+	/** FPlatformTime::Seconds() when the hypothesis and its words were ready */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	double HypothesisTime = 0.0;
+
+	/** FPlatformTime::Seconds() when the subsystem broadcast the result on the game thread. 0 for worker thread listeners */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	double BroadcastTime = 0.0;
+
 	// default constructor
 	FRecognisedPhrases() {
 	}
 };
 
+USTRUCT(BlueprintType)
+struct FSpeechRecognitionAudioStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** Number of times the capture thread found the audio buffer full, and had to drop samples */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int32 OverrunCount = 0;
+
+	/** Number of times the decoder asked for a chunk, and the capture thread could not supply it in time */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int32 UnderrunCount = 0;
+
+	/** Total samples lost to overruns */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int64 DroppedSamples = 0;
+
+	/** Samples waiting to be decoded */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int32 BufferedSamples = 0;
+
+	/** Buffered samples as a fraction of the buffer capacity, 0..1 */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float FillLevel = 0.0f;
+
+	/** Number of times the decode thread woke up to look for audio */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int64 DecodeWakeups = 0;
+
+	/** Wall time, in seconds, the decode thread spent blocked on the audio event. Poll mode never blocks */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DecodeWaitSeconds = 0.0f;
+
+	/** CPU time, in seconds, the decode thread used while it waited for audio on the event, decoding included */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DecodeCpuSecondsEvent = 0.0f;
+
+	/** CPU time, in seconds, the decode thread used while it polled for audio, decoding included */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DecodeCpuSecondsPoll = 0.0f;
+
+	/** Share of a core the decode thread used in event mode, CPU over wall time. -1 until it has run, or where the platform can not tell */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DecodeCpuLoadEvent = -1.0f;
+
+	/** Share of a core the decode thread used in poll mode. -1 until it has run, or where the platform can not tell */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DecodeCpuLoadPoll = -1.0f;
+
+	/**
+	 * DecodeCpuLoadPoll minus DecodeCpuLoadEvent: the share of a core waiting on the event saves. 0 until both modes have run,
+	 * and only meaningful when they ran over similar audio, e.g. each through the same stretch of silence
+	 */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DecodeCpuLoadSaved = 0.0f;
+
+	/** True while the energy gate is forwarding audio to the decoder */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	bool EnergyGateOpen = true;
+
+	/** Samples the energy gate kept away from the decoder */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int64 GatedSamples = 0;
+
+	/** The energy gate's current estimate of the background level, in dBFS */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float NoiseFloorDecibels = -96.0f;
+};
+
+USTRUCT(BlueprintType)
+struct FSpeechPronunciation
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** The word as it will be recognised */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	FString Word;
+
+	/** Space separated phones from the acoustic model's phone set, e.g. "HH AH L OW" */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	FString Phones;
+};
+
+USTRUCT(BlueprintType)
+struct FSpeechEnergyGateSettings
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** Skips acoustic scoring while the input is quiet */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	bool bEnabled = true;
+
+	/** How far above the noise floor a chunk has to be to open the gate, in dB */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float OpenMarginDb = 9.0f;
+
+	/** How far above the noise floor counts as quiet again, in dB. Lower than OpenMarginDb, for hysteresis */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float CloseMarginDb = 4.0f;
+
+	/** Chunks quieter than this never open the gate, however low the noise floor, in dBFS */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float MinOpenDecibels = -60.0f;
+
+	/** Audio from before the gate opened that is decoded too, so word onsets are not clipped */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float PreRollSeconds = 0.3f;
+
+	/** How long the input has to stay quiet before the gate closes. Never shorter than the decoder's -vad_postspeech */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float HangoverSeconds = 0.3f;
+};
+
+/**
+ * Decoder parameters, applied by diffing against the live config.
+ * Search parameters only re-register the searches. VAD, noise removal and gain control only rebuild the plugin's
+ * front end, without touching the model. Any other front end or acoustic param runs ps_reinit, which reloads
+ * the acoustic model and dictionary as a new model does, so it takes as long as the first load.
+ * A numeric field only applies when its override is ticked, so it can be set to zero. An empty string keeps the model's default.
+ */
+USTRUCT(BlueprintType)
+struct FSpeechRecognitionConfig
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** -hmm, an acoustic model directory. Empty uses the language's model */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Model")
+	FString AcousticModel;
+
+	/** -dict, a pronunciation dictionary. Empty uses the language's dictionary */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Model")
+	FString Dictionary;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_Beam = false;
+
+	/** -beam, pruning of HMMs within a frame */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (EditCondition = "bOverride_Beam"))
+	double Beam = 0.0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_WordBeam = false;
+
+	/** -wbeam, pruning of word exits */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (EditCondition = "bOverride_WordBeam"))
+	double WordBeam = 0.0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_PhoneBeam = false;
+
+	/** -pbeam, pruning of phone transitions */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (EditCondition = "bOverride_PhoneBeam"))
+	double PhoneBeam = 0.0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_LanguageWeight = false;
+
+	/** -lw, language model and grammar weight */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (EditCondition = "bOverride_LanguageWeight"))
+	float LanguageWeight = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_WordInsertionPenalty = false;
+
+	/** -wip, word insertion penalty */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (EditCondition = "bOverride_WordInsertionPenalty"))
+	double WordInsertionPenalty = 0.0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_SilenceProbability = false;
+
+	/** -silprob, silence word probability */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (EditCondition = "bOverride_SilenceProbability"))
+	double SilenceProbability = 0.0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_FillerProbability = false;
+
+	/** -fillprob, filler word probability */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|Search", meta = (EditCondition = "bOverride_FillerProbability"))
+	double FillerProbability = 0.0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_VadThreshold = false;
+
+	/** -vad_threshold, the log ratio between signal and noise level the front end's VAD needs */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd", meta = (EditCondition = "bOverride_VadThreshold"))
+	float VadThreshold = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_VadPreSpeech = false;
+
+	/** -vad_prespeech, frames kept from before speech was detected */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd", meta = (EditCondition = "bOverride_VadPreSpeech"))
+	int32 VadPreSpeech = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd", meta = (PinHiddenByDefault, InlineEditConditionToggle))
+	bool bOverride_VadPostSpeech = false;
+
+	/** -vad_postspeech, frames of silence that end speech */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd", meta = (EditCondition = "bOverride_VadPostSpeech"))
+	int32 VadPostSpeech = 0;
+
+	/** -agc, automatic gain control: none, max, emax or noise */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd")
+	FString Agc;
+
+	/** -cmn, cepstral mean normalisation: none, batch or live */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition|FrontEnd")
+	FString Cmn;
+
+	/** Any other switch, by name (e.g. -maxhmmpf). Typed from the decoder's own argument definitions */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	TMap<FString, FString> ExtraParams;
+};
+
+USTRUCT(BlueprintType)
+struct FSpeechNBestSettings
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** How many hypotheses to return in Alternatives. 0 leaves them out */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	int32 MaxHypotheses = 0;
+
+	/** Results with a lower confidence are reported as unknown phrases instead. 0 keeps everything */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float MinConfidence = 0.0f;
+
+	/** Longest the N-best search may run after an utterance, in ms. Checked between hypotheses */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Audio|SpeechRecognition")
+	float TimeBudgetMs = 10.0f;
+};
+
+USTRUCT(BlueprintType)
+struct FSpeechRecognizerLoadTimings
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** Building the decoder config, in ms */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float ConfigMs = 0.0f;
+
+	/** Mapping the dictionary index, and writing a trimmed dictionary, in ms */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DictionaryMs = 0.0f;
+
+	/** ps_init or ps_reinit, which loads the acoustic model and dictionary, in ms */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float DecoderMs = 0.0f;
+
+	/** Registering the grammars, keyphrases and language models, in ms */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float SearchesMs = 0.0f;
+
+	/** Opening the audio source, in ms */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float CaptureMs = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float TotalMs = 0.0f;
+};
+
+USTRUCT(BlueprintType)
+struct FSpeechRecognitionLevel
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** Largest absolute sample in the last decoded chunk, 0..32767 */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	int32 Peak = 0;
+
+	/** RMS of the last decoded chunk, 0..1 of full scale */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float RMS = 0.0f;
+
+	/** RMS of the last decoded chunk, in dBFS */
+	UPROPERTY(BlueprintReadOnly, Category = "Audio|SpeechRecognition")
+	float Decibels = -96.0f;
+};
+
 UENUM(BlueprintType)
 enum class ESpeechRecognitionMode : uint8
 {
@@ -27,6 +386,13 @@ enum class ESpeechRecognitionMode : uint8
 	VE_LANGUAGE_MODEL UMETA(DisplayName = "Language Model")
 };
 
+UENUM(BlueprintType)
+enum class ESpeechRecognitionWaitMode : uint8
+{
+	VE_EVENT 	UMETA(DisplayName = "Event"),
+	VE_POLL  UMETA(DisplayName = "Poll")
+};
+
 UENUM(BlueprintType)
 enum class ESpeechRecognitionParamType : uint8
 {
@@ -103,4 +469,31 @@ public:
 	/** Search for a dll to be loaded dynamically */
 	bool SearchForDllPath(const FString& _searchBase, FString _dllName);
 
+	/** ISpeechRecognition implementation */
+	virtual void Preload(ESpeechRecognitionLanguage Language) override;
+	virtual FSpeechRecognitionWorker* AcquireWorker(USpeechRecognitionSubsystem* Manager) override;
+	virtual void ReleaseWorker(USpeechRecognitionSubsystem* Manager, bool bUnload) override;
+	virtual ESpeechRecognitionLanguage GetLastLanguage() const override { return LastLanguage; }
+	virtual FSpeechModelCache& GetModelCache() override { return *ModelCache; }
+
+private:
+	/** Stops and deletes a recognizer on a pool thread, as it may be in the middle of loading its model */
+	void ShutDownWorker(FSpeechRecognitionWorker* Worker);
+
+	/** Starts the shared recognizer's thread, and its build for Language. Called with WorkerLock held */
+	void CreateWorker(ESpeechRecognitionLanguage Language);
+
+	// the recognizer every world shares, and how many subsystems hold it. Kept loaded while none does,
+	// between levels or ahead of the first one
+	FSpeechRecognitionWorker* SharedWorker = nullptr;
+	int32 NumWorkerRefs = 0;
+	ESpeechRecognitionLanguage LastLanguage = ESpeechRecognitionLanguage::VE_English;
+	FCriticalSection WorkerLock;
+
+	// recognizers still shutting down, which the module waits for before it unloads
+	TArray<TFuture<void>> PendingShutdowns;
+	FCriticalSection ShutdownLock;
+
+	// dictionary indices and log tables shared between every world's recognizer, created on startup
+	FSpeechModelCache* ModelCache = nullptr;
 };
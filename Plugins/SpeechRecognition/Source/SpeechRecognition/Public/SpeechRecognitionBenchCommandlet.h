@@ -0,0 +1,38 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SpeechRecognitionBenchCommandlet.generated.h"
+
+/**
+ * Replays a directory of recordings through the recognizer, the way the game runs it, and reports accuracy and speed as JSON.
+ * Needs no audio device, so config changes (-beam, -vad_*) can be checked for regressions on a build machine.
+ *
+ *   UnrealEditor-Cmd PTuber.uproject -run=SpeechRecognitionBench -Dir=<recordings> [-Out=<report.json>]
+ *     [-Modes=keyword,grammar,lm] [-Keywords=<file>] [-Grammar=<name>] [-LM=<name>] [-Language=English]
+ *     [-Config=(bOverride_Beam=True,Beam=1e-60,bOverride_VadPostSpeech=True,VadPostSpeech=30)] [-ConfigAsset=/Game/...] [-Speed=0] [-SampleRate=16000]
+ *     [-MaxWER=0.3] [-MinRecall=0.8] [-MaxRTF=0.5] [-WaitMode=Event|Poll] [-IdleSeconds=60] [-IdleLevel=-50]
+ *
+ * Every .wav under -Dir (16-bit mono, at the model's sample rate) is played in name order, and compared with the .txt next to it.
+ * Keyword mode reads one phrase per line from -Keywords, optionally followed by |<tolerance 1-10>, and reports recall and
+ * false alarms; grammar and language model modes report the word error rate. Each mode starts a new recognizer, so its
+ * init time is measured, and -Config or -ConfigAsset replace Init's default params as ApplyConfig does in the game.
+ *
+ * -Speed=0 decodes as fast as the machine allows, which the real-time factor is measured at; 1 plays in real time.
+ * Each mode reports the decode thread's CPU time and load. Run it at -Speed=1 with -WaitMode=Event and -WaitMode=Poll to see
+ * what the event wait saves: at full speed the thread never waits, so the two modes cost the same.
+ * -IdleSeconds plays that much white noise at -IdleLevel dBFS in real time, on the first mode's search, once with the energy gate
+ * on and once off, and reports the decode thread's CPU for each under "Idle": what the recognizer costs while nobody talks.
+ * Finalization latency is from the VAD ending an utterance to its hypothesis, without the -vad_postspeech hangover before it.
+ * Returns 1 when a -Max / -Min threshold is crossed, or a mode could not run.
+ */
+UCLASS()
+class USpeechRecognitionBenchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USpeechRecognitionBenchCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "SpeechRecognition.h"
+#include "SpeechRecognitionConfigAsset.generated.h"
+
+/**
+ * A recognizer config saved as an asset, so tuned settings can be shared and swapped at runtime.
+ * Apply it with USpeechRecognitionSubsystem::ApplyConfigAsset.
+ */
+UCLASS(BlueprintType)
+class SPEECHRECOGNITION_API USpeechRecognitionConfigAsset : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Audio|SpeechRecognition", meta = (ShowOnlyInnerProperties))
+	FSpeechRecognitionConfig Config;
+};
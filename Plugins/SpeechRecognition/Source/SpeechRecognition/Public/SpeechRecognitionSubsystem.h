@@ -3,28 +3,86 @@
 
 #include "CoreMinimal.h"
 #include "Subsystems/WorldSubsystem.h"
+#include "Containers/LockFreeList.h"
 #include "SpeechRecognitionWorker.h"
 #include "SpeechRecognition.h"
+#include "ISpeechRecognitionListener.h"
 #include "SpeechRecognitionSubsystem.generated.h"
 
+class USoundSubmix;
+class USpeechRecognitionConfigAsset;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FStartedSpeakingSignature);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FStoppedSpeakingSignature);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FWordsSpokenSignature, FRecognisedPhrases, Text);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FUnknownPhraseSignature);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FPartialHypothesisSignature, const FString&, Text);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FRecognizerReadySignature, FSpeechRecognizerLoadTimings, Timings);
+
+enum class ESpeechRecognitionEventType : uint8
+{
+	StartedSpeaking,
+	StoppedSpeaking,
+	WordsSpoken,
+	UnknownPhrase,
+	PartialHypothesis,
+	RecognizerReady
+};
+
+/** A callback raised on the recognition thread, waiting to be broadcast on the game thread. Pooled, so its buffers are reused */
+struct FSpeechRecognitionEvent
+{
+	ESpeechRecognitionEventType Type = ESpeechRecognitionEventType::UnknownPhrase;
+	FRecognisedPhrases Phrases;
+	FString Text;
+	FSpeechRecognizerLoadTimings Timings;
+	//When the recognition thread queued it, for results
+	double QueuedTime = 0.0;
+};
 
 UCLASS(BlueprintType)
-class SPEECHRECOGNITION_API USpeechRecognitionSubsystem : public UWorldSubsystem
+class SPEECHRECOGNITION_API USpeechRecognitionSubsystem : public UTickableWorldSubsystem
 {
 	GENERATED_BODY()
 
 	int32 instanceCtr;
 	
-	FSpeechRecognitionWorker* listenerThread;
+	FSpeechRecognitionWorker* listenerThread = nullptr;
+
+	//Events from the recognition thread, in order, drained once per frame
+	TLockFreePointerListFIFO<FSpeechRecognitionEvent, PLATFORM_CACHE_LINE_SIZE> Events;
+
+	//Broadcast events, with their strings and arrays, waiting to be reused by the recognition thread
+	TLockFreePointerListUnordered<FSpeechRecognitionEvent, PLATFORM_CACHE_LINE_SIZE> EventPool;
+
+	//Drained events not broadcast yet, because the frame's budget ran out. Reused between frames
+	TArray<FSpeechRecognitionEvent*> PendingEvents;
+
+	//Longest the events may take to broadcast each frame, in ms. At least one is always broadcast
+	float EventTimeBudgetMs = 2.0f;
+
+	//Takes an event from the pool, or makes one
+	FSpeechRecognitionEvent* AllocateEvent(ESpeechRecognitionEventType Type);
+	//Appends to PendingEvents, replacing a partial hypothesis that has not been broadcast yet
+	void AddPendingEvent(FSpeechRecognitionEvent* Event);
+	void BroadcastEvent(const FSpeechRecognitionEvent& Event);
+	//Frees the queued, pending and pooled events, once the recognition thread no longer reports to this subsystem
+	void DeleteEvents();
 
-	static void WordsSpoken_trigger(FWordsSpokenSignature delegate_method, FRecognisedPhrases text);
-	static void UnknownPhrase_trigger(FUnknownPhraseSignature delegate_method);
-	static void StartedSpeaking_trigger(FStartedSpeakingSignature delegate_method);
-	static void StoppedSpeaking_trigger(FStoppedSpeakingSignature delegate_method);
+	//Native listeners called on the recognition thread. The lock is not held while they are called
+	TArray<ISpeechRecognitionListener*> WorkerListeners;
+	FCriticalSection WorkerListenersLock;
+
+	//The worker thread listener being called, and the thread calling it. Guarded by WorkerListenersLock
+	ISpeechRecognitionListener* NotifyingListener = nullptr;
+	uint32 NotifyingThreadId = 0;
+
+	//Native listeners called from Tick
+	TArray<ISpeechRecognitionListener*> GameThreadListeners;
+
+	//Calls Function on each worker thread listener, from the recognition thread, on a snapshot of the listeners
+	template <typename FunctionType>
+	void NotifyWorkerListeners(FunctionType&& Function);
 
 public:
 	//Methods to switch recognition modes
@@ -37,48 +95,194 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Enable Language Model Mode", Keywords = "Speech Recognition Mode"))
 	bool EnableLanguageModel(FString languageModel);
 
+	//Methods to extend the vocabulary without restarting the recogniser
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Add Keywords", Keywords = "Speech Recognition Keyword Vocabulary"))
+	bool AddKeywords(const TArray<FRecognitionPhrase>& wordList);
+
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Add Pronunciations", Keywords = "Speech Recognition Dictionary Word Vocabulary"))
+	bool AddPronunciations(const TArray<FSpeechPronunciation>& Pronunciations);
+
 	// Basic functions 
 	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "GetCurrentVolume", Keywords = "Speech Recognition Volume"))
 	int32 GetCurrentVolume() const;
 
+	/** Peak, RMS and dBFS of the last decoded chunk. Cheap enough to poll every frame */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "GetCurrentLevel", Keywords = "Speech Recognition Volume Level RMS"))
+	FSpeechRecognitionLevel GetCurrentLevel() const;
+
+	/** RMS levels of the most recent decoded chunks, oldest first */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "GetLevelHistory", Keywords = "Speech Recognition Volume Level History"))
+	TArray<float> GetLevelHistory() const;
+
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "GetAudioStats", Keywords = "Speech Recognition Audio Buffer Overrun Underrun"))
+	FSpeechRecognitionAudioStats GetAudioStats() const;
+
+	/** Decodes a 16-bit mono WAV (or raw PCM) file instead of the microphone. A PlaybackSpeed of 0 decodes as fast as possible */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Set Audio Source File", Keywords = "Speech Recognition Audio Source WAV"))
+	void SetAudioSourceFile(FString FilePath, float PlaybackSpeed = 1.0f);
+
+	/** Captures the default input device through the engine's AudioCapture, instead of opening it with sphinxbase */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Set Audio Source Audio Capture", Keywords = "Speech Recognition Audio Source Microphone Mixer"))
+	void SetAudioSourceAudioCapture();
+
+	/**
+	 * Listens to the output of a submix, such as one an AudioCapture component is routed to.
+	 * The submix should carry only the microphone. A null submix is refused, since the main submix also carries game audio
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Set Audio Source Submix", Keywords = "Speech Recognition Audio Source Submix Mixer"))
+	void SetAudioSourceSubmix(USoundSubmix* Submix);
+
+	/** Captures from a recording device. An empty name uses the default device */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Set Audio Source Device", Keywords = "Speech Recognition Audio Source Microphone"))
+	void SetAudioSourceDevice(FString DeviceName);
+
+	/** True once a file source has been completely decoded */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Is Audio Source Finished", Keywords = "Speech Recognition Audio Source"))
+	bool IsAudioSourceFinished() const;
+
+	/** Replaces where the recognizer reads audio from. Takes effect between utterances */
+	void SetAudioSource(const TSharedPtr<ISpeechAudioSource>& Source);
+
+	/** Sets how many samples the decoder consumes from the capture buffer at a time */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetDecodeChunkSize", Keywords = "Speech Recognition Chunk"))
+	void SetDecodeChunkSize(int32 Samples);
+
+	/** Sizes decode chunks to a target latency instead, e.g. 10, 20 or 40 ms. Overrides SetDecodeChunkSize until it is called again */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetTargetLatency", Keywords = "Speech Recognition Chunk Latency"))
+	void SetTargetLatency(int32 Milliseconds);
+
+	/**
+	 * Event blocks the decode thread until a chunk is buffered. Poll is the old loop, which checks the buffer again straight away
+	 * and keeps a core busy, kept as a baseline. GetAudioStats reports the decode thread's CPU load in each
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetAudioWaitMode", Keywords = "Speech Recognition Wait Poll CPU"))
+	void SetAudioWaitMode(ESpeechRecognitionWaitMode WaitMode);
+
+	/** Configures the energy gate that keeps silence away from the decoder. Takes effect between utterances */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetEnergyGate", Keywords = "Speech Recognition Energy Gate VAD Silence"))
+	void SetEnergyGate(const FSpeechEnergyGateSettings& Settings);
+
+	/**
+	 * Loads only the pronunciations the keyword list and grammars use, instead of the whole dictionary.
+	 * Language model searches need every word, so trimming is suspended while one is registered.
+	 * Each load logs the trimmed and full dictionaries' words, pronunciations and sizes, and how long it took
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetTrimDictionary", Keywords = "Speech Recognition Dictionary Vocabulary Trim"))
+	void SetTrimDictionary(bool bTrimDictionary);
+
+	/**
+	 * Computes the MFCCs in the plugin with vectorized kernels, and hands them to the decoder, instead of running sphinxbase's front end.
+	 * Falls back to sphinxbase's front end when the config asks for something the native one does not do (see the log).
+	 * -remove_noise is done natively, in single precision, so the features differ from sphinxbase's by a small tolerance
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetNativeFrontEnd", Keywords = "Speech Recognition MFCC Front End Features SIMD"))
+	void SetNativeFrontEnd(bool bEnabled);
+
+	/** Frames of speech between partial hypothesis updates, 10 by default (100 ms at -frate 100). 0 turns them off */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetPartialHypothesisInterval", Keywords = "Speech Recognition Partial Hypothesis Streaming"))
+	void SetPartialHypothesisInterval(int32 Frames);
+
+	/** Returns the best few hypotheses with each result, and filters out results below a confidence */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetNBest", Keywords = "Speech Recognition NBest Confidence Hypotheses"))
+	void SetNBest(const FSpeechNBestSettings& Settings);
+
+	/** Longest the recognition events may take to broadcast each frame. The rest carry over to the next frame, in order */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetEventTimeBudget", Keywords = "Speech Recognition Event Budget"))
+	void SetEventTimeBudget(float Milliseconds);
+
+	/**
+	 * Starts loading the recognizer in the background, e.g. from a loading screen, so Init finds it ready.
+	 * Game worlds preload the last language used on their own. OnRecognizerReady fires once it has loaded
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Preload Recognizer", Keywords = "Speech Recognition Init Preload Load"))
+	void PreloadRecognizer(ESpeechRecognitionLanguage Language);
+
+	/**
+	 * Joins the recognizer the module shares between worlds, preloaded or already in use by another world, or starts
+	 * loading it. Preloaded recognizers are built with the default config params, so turning those off costs a rebuild.
+	 * Worlds share one decoder, acoustic model and audio source: a decoder has one active search, so the search, config,
+	 * language and audio source are whatever the world that set them last chose, and every world gets every result
+	 */
 	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Init", Keywords = "Speech Recognition Init"))
 	bool Init(ESpeechRecognitionLanguage Language, bool bInitDefaultConfigParams = true);	
 
 	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "SetConfigParam", Keywords = "Speech Recognition Set Config Param"))
 	bool SetConfigParam(FString param, ESpeechRecognitionParamType type, FString value);
 
+	/**
+	 * Replaces the decoder params with a typed config, including any set with SetConfigParam.
+	 * Only what changed is applied, between utterances: search params re-register the searches, VAD, noise and gain
+	 * params rebuild only the front end, and other feature or acoustic params reinitialise the decoder, which reloads
+	 * the acoustic model as a new model or dictionary does
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "ApplyConfig", Keywords = "Speech Recognition Config Params Beam VAD"))
+	void ApplyConfig(const FSpeechRecognitionConfig& Config);
+
+	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "ApplyConfigAsset", Keywords = "Speech Recognition Config Params Asset"))
+	void ApplyConfigAsset(USpeechRecognitionConfigAsset* ConfigAsset);
+
+	/**
+	 * Leaves the shared recognizer, and unloads it unless another world still uses it.
+	 * Leaving the level without calling this keeps it loaded for the next one
+	 */
 	UFUNCTION(BlueprintCallable, Category = "Audio|SpeechRecognition", meta = (DisplayName = "Shutdown", Keywords = "Speech Recognition Shutdown"))
 	bool Shutdown();
 
-	// Callback events
-	UFUNCTION()
-	void WordsSpoken_method(FRecognisedPhrases phrases) const;
+	/**
+	 * Registers a native listener. Call from the game thread, or from a listener's callback.
+	 * A listener must be removed before it is destroyed. See ISpeechRecognitionListener for what a callback may do
+	 */
+	void AddListener(ISpeechRecognitionListener* Listener, ESpeechListenerThread Thread = ESpeechListenerThread::GameThread);
+
+	/**
+	 * Once this returns, the listener is not being called, and will not be again. Called from a listener's own callback,
+	 * it returns straight away, and only that call is still in progress
+	 */
+	void RemoveListener(ISpeechRecognitionListener* Listener);
+
+	// Callback events, queued from the recognition thread. The phrases are swapped with a pooled event's, whose buffers come back
+	void WordsSpoken_method(FRecognisedPhrases& phrases);
 
 	UPROPERTY(BlueprintAssignable, Category = "Audio|SpeechRecognition")
 	FWordsSpokenSignature OnWordsSpoken;
 
-	UFUNCTION()
-	void UnknownPhrase_method() const;
+	void UnknownPhrase_method();
 
 	UPROPERTY(BlueprintAssignable, Category = "Audio|SpeechRecognition")
 	FUnknownPhraseSignature OnUnknownPhrase;
 
-	UFUNCTION()
-	void StartedSpeaking_method() const;
+	void StartedSpeaking_method();
 
 	UPROPERTY(BlueprintAssignable, Category = "Audio|SpeechRecognition")
 	FStartedSpeakingSignature OnStartedSpeaking;
 
-	UFUNCTION()
-	void StoppedSpeaking_method() const;
+	void StoppedSpeaking_method();
 
 	UPROPERTY(BlueprintAssignable, Category = "Audio|SpeechRecognition")
 	FStoppedSpeakingSignature OnStoppedSpeaking;
 
+	void PartialHypothesis_method(const FString& text);
+
+	/** The hypothesis so far, while speech is still going on. Only fires when it changes */
+	UPROPERTY(BlueprintAssignable, Category = "Audio|SpeechRecognition")
+	FPartialHypothesisSignature OnPartialHypothesis;
+
+	void RecognizerReady_method(const FSpeechRecognizerLoadTimings& timings);
+
+	/** The decoder is loaded and its searches registered, with how long each stage took. Also fires when Init takes over a preloaded recognizer */
+	UPROPERTY(BlueprintAssignable, Category = "Audio|SpeechRecognition")
+	FRecognizerReadySignature OnRecognizerReady;
+
 	//~ Begin UWorldSubsystem Subsystem
 	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
 	virtual void Deinitialize() override;
 	//~ End UWorldSubsystem Subsystem
 
+	//~ Begin FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	//~ End FTickableGameObject
+
 	USpeechRecognitionSubsystem();
 };
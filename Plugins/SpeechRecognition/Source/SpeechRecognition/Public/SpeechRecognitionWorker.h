@@ -2,10 +2,10 @@
 
 #include <sphinxbase/err.h>
 #include <sphinxbase/ad.h>
+#include <sphinxbase/profile.h>
 #include <pocketsphinx.h>
 #include <stdio.h>
 #include <time.h>
-#include <regex>
 #include <string>
 #include <set>
 #include <map>
@@ -16,8 +16,12 @@
 #include <cstdio>
 #include <vector>
 #include <utility>
+#include <atomic>
 
+#include "Containers/Queue.h"
 #include "SpeechRecognition.h"
+#include "SpeechAudioRingBuffer.h"
+#include "SpeechLevelMeter.h"
 #include "Chaos/AABB.h"
 
 //General Log
@@ -26,27 +30,52 @@ DECLARE_LOG_CATEGORY_EXTERN(SpeechRecognitionPlugin, Log, All);
 #define SENSCR_SHIFT 10
 
 class USpeechRecognitionSubsystem;
+class FSpeechAudioCaptureWorker;
+class FSpeechEnergyGate;
+class FSpeechGrammarCache;
+class FSpeechDictionaryIndex;
+class FSpeechTrimmedDictionary;
+class FSpeechPhraseCompiler;
+class FSpeechMfccFrontEnd;
+class ISpeechAudioSource;
 
 using namespace std;
 
 //Common structures and enumerations
 struct FSpeechRecognitionParam
 {
-	char* name;
 	ESpeechRecognitionParamType type;
-	char* value;
-
-	// constructor
-	FSpeechRecognitionParam(const char* name, ESpeechRecognitionParamType type, const char* value) {
-		const size_t nameLenght = strlen(name) + 1;
-		const size_t valueLenght = strlen(value) + 1;
-		
-		this->name = new char[nameLenght];
-		strcpy_s(this->name, nameLenght, name);
-		this->type = type;
-		this->value = new char[valueLenght];
-		strcpy_s(this->value, valueLenght, value);
-	}
+	std::string value;
+
+	bool operator==(const FSpeechRecognitionParam& Other) const { return type == Other.type && value == Other.value; }
+	bool operator!=(const FSpeechRecognitionParam& Other) const { return !(*this == Other); }
+};
+
+//Sphinx params, by switch name
+typedef std::map<std::string, FSpeechRecognitionParam> FSpeechRecognitionParams;
+
+//Size of a dictionary the decoder reads: base words, pronunciations and bytes of .dict text
+struct FSpeechDictionaryFootprint
+{
+	int32 NumWords = 0;
+	int32 NumEntries = 0;
+	int64 Bytes = 0;
+};
+
+//How much of the decoder a config change rebuilds, least first
+enum class ESpeechConfigChange : uint8
+{
+	None,
+	//Read when a search is created, so re-registering the searches picks them up. Cheap
+	Search,
+	//VAD, noise removal and gain control. Audio goes through a front end the worker owns, so only that is rebuilt,
+	//and the gain control type is switched on the decoder's feature computation in place. Cheap
+	FrontEnd,
+	//Feature extraction and acoustic scoring, applied with ps_reinit on the live config. ps_reinit reloads the acoustic model
+	//and dictionary as well, so this costs about as much as Reload, and only skips rebuilding the config and trimmed dictionary
+	Reinit,
+	//A new acoustic model or dictionary, or a param going back to its default. The config is rebuilt and the dictionary trimmed again
+	Reload
 };
 
 class FSpeechRecognitionWorker : public FRunnable
@@ -56,18 +85,132 @@ private:
 	// Sphinx
 	ps_decoder_t *ps = nullptr;
 	cmd_ln_t *config = nullptr;
-	ad_rec_t *ad;
-	int16 adbuf[1024];
 	uint8 utt_started, in_speech;
 	int32 k;
-	bool initRequired = false;
+	std::atomic<bool> initRequired = false;
+	std::atomic<bool> languageChanged = false;
+	std::atomic<bool> decoderBuilt = false;
+	//Set once a decoder build has been asked for, so later commands do not ask again while it is loading. Guarded by ConfigLock
+	bool decoderRequested = false;
 	bool wordsAdded = false;
 
-	//Stores the current, peak volume
-	int16 currentVolume = 0;
+	//Measures the level of each decoded chunk
+	FSpeechLevelMeter LevelMeter;
+
+	//Keeps silence away from acoustic scoring. Settings from another thread wait in PendingGateSettings until the next utterance boundary
+	TUniquePtr<FSpeechEnergyGate> EnergyGate;
+	FSpeechEnergyGateSettings PendingGateSettings;
+	FCriticalSection EnergyGateLock;
+	std::atomic<bool> bEnergyGateChanged = true;
+
+	//Captured audio, waiting to be decoded. Filled by the capture thread, drained by this one
+	FSpeechAudioRingBuffer AudioBuffer;
+	TUniquePtr<FSpeechAudioCaptureWorker> Capture;
+
+	//Where captured audio comes from. A source set from another thread waits in PendingAudioSource until the next utterance boundary
+	TSharedPtr<ISpeechAudioSource> AudioSource;
+	TSharedPtr<ISpeechAudioSource> PendingAudioSource;
+	FCriticalSection AudioSourceLock;
+	std::atomic<bool> bAudioSourceChanged = false;
+
+	//Decode throughput, since capture last started
+	double decodeStartTime = 0.0;
+	uint64 decodedSamples = 0;
+	bool streamFinishReported = false;
+
+	//Number of samples handed to the decoder at a time, or the latency to size chunks from when TargetLatencyMs is set
+	std::atomic<int32> DecodeChunkSize;
+	std::atomic<int32> TargetLatencyMs;
+	TArray<int16> DecodeBuffer;
+
+	//How the decode thread waits for a chunk. Signalled by the capture side once a chunk is buffered
+	std::atomic<ESpeechRecognitionWaitMode> WaitMode;
+	FEvent* AudioReadyEvent = nullptr;
+	std::atomic<uint64> decodeWakeups;
+	std::atomic<double> decodeWaitSeconds;
+
+	//The decode thread's CPU and wall time, by the wait mode it ran in, so the modes compare on the same machine. Guarded by DecodeCpuLock
+	double decodeCpuSeconds[2] = {};
+	double decodeCpuWallSeconds[2] = {};
+	mutable FCriticalSection DecodeCpuLock;
+	//The last sample AccountDecodeCpu took. Decode thread only
+	double cpuSampleSeconds = -1.0;
+	double cpuSampleWallTime = 0.0;
+	ESpeechRecognitionWaitMode cpuSampleMode = ESpeechRecognitionWaitMode::VE_EVENT;
+
+	//Sphinx params asked for. Filled from the game thread, guarded by ConfigLock
+	FSpeechRecognitionParams desiredParams;
+	FCriticalSection ConfigLock;
+
+	//Sphinx params the live config was built with. Decode thread only
+	FSpeechRecognitionParams appliedParams;
+
+	//Work queued from other threads, such as search switches. Run on this thread between utterances
+	TQueue<TFunction<void()>, EQueueMode::Mpsc> Commands;
+
+	//Searches registered with the decoder, by name. Cleared when the decoder is rebuilt
+	std::set<std::string> registeredSearches;
+	std::string activeSearch;
+
+	//Frames of speech between partial hypothesis polls, 0 to disable them
+	std::atomic<int32> partialHypothesisFrames = 10;
+	int32 lastPartialFrame = 0;
+	std::string lastPartialHypothesis;
+
+	//Id of the utterance in progress, reported with its result
+	int32 utteranceId = 0;
 
-	//A set of params to apply to Sphinx initialisation
-	TArray<FSpeechRecognitionParam> sphinxParams;
+	//Result of the last utterance, built in place. The manager swaps it with a pooled event's, so the strings and arrays are reused
+	FRecognisedPhrases resultPhrases;
+
+	//Capture sample the utterance's first decoded frame started at, and how many frames it has decoded. Word times count from that frame
+	int64 utteranceStartSample = 0;
+	int32 utteranceFrames = 0;
+	int32 frontEndFrameShift = 0;
+	int32 frontEndFrameSize = 0;
+
+	//N-best and confidence filtering. Filled from the game thread, guarded by ConfigLock
+	FSpeechNBestSettings NBestSettings;
+
+	//When set, the decoder only loads pronunciations for words the keyword list and grammars use
+	std::atomic<bool> trimDictionary = false;
+	bool trimmedDictionaryLoaded = false;
+	TUniquePtr<FSpeechTrimmedDictionary> TrimmedDictionary;
+	//What the last trimmed dictionary held, and how long ps_load_dict last took for each. 0 until one is loaded that way
+	FSpeechDictionaryFootprint trimmedFootprint;
+	double trimmedDictionaryLoadMs = 0.0;
+	double fullDictionaryLoadMs = 0.0;
+	//Keywords added since the vocabulary last took them in, and whether it has every grammar's words. Both reset with it
+	std::vector<std::string> newKeywords;
+	bool grammarVocabularyCollected = false;
+
+	//Compiled JSGF grammars, kept on disk between runs
+	TUniquePtr<FSpeechGrammarCache> GrammarCache;
+
+	//Words added with ps_add_word, which are re-added whenever the decoder's dictionary is reloaded
+	std::map<string, string> customPronunciations;
+
+	//The keyword list as registered with keyphrase_search. Owns the strings handed to ps_set_keyphrase,
+	//and folds detected pronunciation variants back to their phrase
+	TUniquePtr<FSpeechPhraseCompiler> PhraseCompiler;
+
+	//Sample rate the capture thread was started with
+	int32 captureSampleRate = 0;
+
+	//sphinxbase front end built from the live config, whose cepstra are decoded with ps_process_cep.
+	//The decoder's own is never fed, so VAD and noise settings only rebuild this one instead of reinitialising the decoder
+	fe_t* sphinxFrontEnd = nullptr;
+	TArray<mfcc_t> sphinxCepstra;
+	TArray<mfcc_t*> sphinxFramePointers;
+
+	//MFCCs computed by the plugin, used in place of sphinxFrontEnd.
+	//Asked for from the game thread; active once the decoder's front end settings are supported
+	TUniquePtr<FSpeechMfccFrontEnd> FrontEnd;
+	std::atomic<bool> bNativeFrontEnd = false;
+	bool nativeFrontEndActive = false;
+
+	//Wall time spent decoding this utterance, which the real-time factor compares with its length
+	ptmr_t decodeTimer;
 
 	//Speech detection mode
 	ESpeechRecognitionMode detectionMode;
@@ -76,10 +219,17 @@ private:
 	ESpeechRecognitionLanguage language;
 
 	//Thread
-	FRunnableThread* Thread;
+	FRunnableThread* Thread = nullptr;
+
+	//The subsystems of every world sharing this worker, in the order they took it. Empty while it is parked in the module,
+	//between levels. Guarded by ManagerLock
+	TArray<USpeechRecognitionSubsystem*> Managers;
+	FCriticalSection ManagerLock;
 
-	//Pointer to our manager
-	USpeechRecognitionSubsystem* Manager;
+	//How long the last decoder build took, by stage. Reported to each manager that takes the worker over
+	FSpeechRecognizerLoadTimings buildTimings;
+	FSpeechRecognizerLoadTimings loadTimings;
+	bool recognizerReady = false;
 
 	//Thread safe counter 
 	FThreadSafeCounter StopTaskCounter;
@@ -98,13 +248,101 @@ private:
 	//Stores the recognition keywords, along with their tolerances
 	std::map <string , char*> keywords;
 
-	//Dictionary
-	std::map <string, set<string>> dictionary;
+	//Dictionary, mapped from its prebuilt index for keyphrase checks and trimming. Shared with every other recognizer using the same dictionary
+	TSharedPtr<const FSpeechDictionaryIndex, ESPMode::ThreadSafe> DictionaryIndex;
+
+	//Opens the current audio source, and starts the capture thread
+	bool StartCapture();
+
+	//Blocks until a chunk is buffered, or until Deadline (FPlatformTime::Seconds) passes
+	void WaitForAudio(double Deadline);
+
+	//Queues work for this thread. Rebuilds the decoder first if params or the language have changed
+	void QueueCommand(TFunction<void()>&& Command);
+	//Runs queued work. Only called between utterances
+	void RunCommands();
+
+	//Resolves the content paths for the current language
+	void ApplyLanguage();
+	//Creates the decoder from the current config, or reloads it in place with ps_reinit
+	bool RebuildDecoder();
+	//Re-registers every search, and reselects the active one, after the decoder dropped them
+	void RestoreSearches();
+	//Applies the difference between the desired and the applied params, as cheaply as it allows
+	void ApplyConfigChanges();
+	//Queues ApplyConfigChanges once the decoder exists. Before that, the params are used when it is built
+	void ScheduleConfigApply();
+	//Rebuilds the front end from the decoder's config: the native one when asked for and supported, otherwise sphinxbase's
+	void UpdateFrontEnd();
+	//Switches the decoder's gain control to the config's, in place. False if it needs a ps_reinit
+	bool ApplyGainControl();
+	//Starts an utterance in the decoder and the front end. Each utterance is its own decoder stream, so segment frames count from its start
+	bool StartUtterance();
+	//True while the front end's VAD hears speech
+	bool IsFrontEndInSpeech() const;
+	//Hands audio to the decoder, through whichever front end is active. captureSample is where the audio starts in the capture stream
+	void DecodeSamples(const int16* samples, int32 numSamples, int64 captureSample);
+	//Notes where the utterance's first frames came from, as they are decoded
+	void CountUtteranceFrames(int32 numFrames, int64 endSample);
+	//Publishes the real-time factor and frame rate of the utterance that just ended
+	void ReportDecodeRate();
+	//Adds the decode thread's CPU time since the last sample to the wait mode it ran in. Samples a few times a second, or when the mode changes
+	void AccountDecodeCpu();
+	//Maps the dictionary index, or shares it from the model cache, so keyphrases can be checked against it. Does nothing once it is open
+	void LoadDictionary();
+	//Registers a search by name: keyphrase_search, grammar:<name> or lm:<name>. Already registered searches are kept
+	bool RegisterSearch(const std::string& name);
+	//(Re)registers keyphrase_search from the current keywords
+	bool RegisterKeyphraseSearch();
+	//Registers every grammar shipped for the current language, so switching to one later is instant
+	void RegisterGrammarSearches();
+	//Makes a search the active one, registering it first if needed. Only valid between utterances
+	bool ActivateSearch(const std::string& name);
+
+	//Adds the keywords, and the words of every grammar, to the trimmed vocabulary. Returns true if a word was new
+	bool CollectVocabulary(logmath_t* lmath);
+	//Swaps the decoder between the full and trimmed dictionary, as the vocabulary and searches need. Only valid between utterances
+	void UpdateDictionary(bool bNeedsFullDictionary);
+	//Loads a dictionary file into the running decoder, and reports the cost
+	bool LoadDecoderDictionary(const std::string& path, bool bTrimmed);
+	//The full dictionary's size, from its index when it is mapped. Only the byte count is known otherwise
+	FSpeechDictionaryFootprint GetFullDictionaryFootprint() const;
+	//Publishes the loaded dictionary's size against the full one's, and logs it with how long loading took
+	void ReportDictionary(const TCHAR* action, double loadMs);
+	//Adds the custom pronunciations to the decoder's dictionary again, after it was reloaded
+	void ReapplyPronunciations();
+	//True when the decoder's current dictionary has the word, or variant
+	bool IsDecoderWord(const char* word) const;
+	//Re-registers keyphrase_search from the current keywords, and keeps it selected if it was
+	void RefreshKeyphraseSearch();
+
+	//Polls the hypothesis mid-utterance, and reports it when it has changed since the last poll
+	void UpdatePartialHypothesis();
+	//The text of a hypothesis as it is reported, with keyphrases folded back to their phrase
+	FString GetReportedHypothesis(const char* hyp);
+	//Fills OutPhrases' words and phrases from the segments of the utterance that just ended, reusing their strings.
+	//Word posteriors only exist once ScoreHypotheses has run
+	void CollectWords(float frameRate, bool bScored, FRecognisedPhrases& OutPhrases);
+	//Fills in the confidence, and the N-best alternatives, of the utterance that just ended
+	void ScoreHypotheses(const FSpeechNBestSettings& settings, FRecognisedPhrases& OutPhrases);
+
+	//Calls f with each manager. A manager can not be released while f runs
+	template<typename FunctionType>
+	void NotifyManager(FunctionType&& f) {
+		FScopeLock lock(&ManagerLock);
+		for (USpeechRecognitionSubsystem* manager : Managers) {
+			f(*manager);
+		}
+	}
+	bool HasManager() {
+		FScopeLock lock(&ManagerLock);
+		return Managers.Num() > 0;
+	}
+	//Hands the result to each manager. The last one swaps it, as it does when there is only one; the others get copies
+	void NotifyWordsSpoken(FRecognisedPhrases& phrases);
+	//Records the load timings, and tells the manager the recognizer is ready
+	void ReportRecognizerReady(const FSpeechRecognizerLoadTimings& timings);
 
-	//Splits a string by whitespace
-	vector<string> Split(string s);
-	//Removes brackets, and 1-9 characters, from a string
-	string GetOriginalString(string s) const;
 
 public:
 	FSpeechRecognitionWorker();
@@ -120,12 +358,42 @@ public:
 	bool EnableLanguageModel(FString InLanguageModel);
 
 	//Action methods
-	void AddWords(const TArray<FRecognitionPhrase>& InKeywords);
+	void AddWords(const TArray<FRecognitionPhrase>& InKeywords, bool bReplace = true);
+	bool AddKeywords(const TArray<FRecognitionPhrase>& InKeywords);
+	bool AddPronunciations(const TArray<FSpeechPronunciation>& InPronunciations);
 	int16 GetCurrentVolume() const;
+	FSpeechRecognitionLevel GetCurrentLevel() const;
+	void GetLevelHistory(TArray<float>& OutLevels) const;
+	const FSpeechLevelMeter& GetLevelMeter() const { return LevelMeter; }
+	FSpeechRecognitionAudioStats GetAudioStats() const;
+	void SetDecodeChunkSize(int32 InSamples);
+	void SetTargetLatency(int32 InMilliseconds);
+	void SetWaitMode(ESpeechRecognitionWaitMode InWaitMode);
+	void SetEnergyGateSettings(const FSpeechEnergyGateSettings& InSettings);
+	void SetTrimDictionary(bool bInTrimDictionary);
+	void SetPartialHypothesisInterval(int32 InFrames);
+	void SetNBestSettings(const FSpeechNBestSettings& InSettings);
+	void SetNativeFrontEnd(bool bInNativeFrontEnd);
+
+	//Replaces the audio source, taking effect between utterances. A null source falls back to the recording device
+	void SetAudioSource(const TSharedPtr<ISpeechAudioSource>& InSource);
+	//True once a finite audio source has been completely decoded
+	bool IsAudioSourceFinished() const;
 	void InitConfig();
 	bool SetConfigParam(const FString& param, ESpeechRecognitionParamType type, const FString& value);
+	//Sets the VAD, AGC and beam params Init defaults to, or clears them. Preloads set them before the build, so Init finds nothing to change
+	void SetDefaultConfigParams(bool bEnabled);
+	//Replaces every param set so far, including ones from SetConfigParam
+	void SetConfig(const FSpeechRecognitionConfig& InConfig);
 	void SetLanguage(ESpeechRecognitionLanguage InLanguage);
-	bool StartThread(USpeechRecognitionSubsystem* manager);
+	ESpeechRecognitionLanguage GetLanguage() const { return language; }
+	bool StartThread();
+	//Adds or removes a world sharing the worker. Audio capture only runs while there is at least one.
+	//Nothing is reported to a manager once RemoveManager returns
+	void AddManager(USpeechRecognitionSubsystem* manager);
+	void RemoveManager(USpeechRecognitionSubsystem* manager);
+	//Builds the decoder in the background, if it is not built for the current language already
+	void Preload();
 	void ShutDown();
 
 	// Print Debug Text
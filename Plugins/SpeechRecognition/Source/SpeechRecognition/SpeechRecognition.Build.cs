@@ -34,7 +34,8 @@ namespace UnrealBuildTool.Rules
 				    "CoreUObject", 
 				    "Engine", 
 				    "InputCore",
-				    "RHI"
+				    "RHI",
+				    "AudioCaptureCore"
 					// ... add other public dependencies that you statically link with here ...
 				}
 				);
@@ -42,7 +43,7 @@ namespace UnrealBuildTool.Rules
 			PrivateDependencyModuleNames.AddRange(
 				new string[]
 				{
-
+					"Json"
 				}
 				);
 
@@ -90,6 +91,19 @@ PublicAdditionalLibraries.Add(Path.Combine(LibraryPath, "libsphinxad.a"));
 PublicAdditionalLibraries.Add(Path.Combine(LibraryPath, "libsphinxbase.a"));
             }
 
+            if (Target.Platform == UnrealTargetPlatform.Linux)
+            {
+                isLibrarySupported = true;
+
+                // static builds of sphinxbase 5prealpha, configured --with-pic, with sphinxad on PulseAudio
+                string LibraryPath = Path.Combine(ThirdPartyPath, "SphinxBase", "Libraries", "linux");
+
+                PublicAdditionalLibraries.Add(Path.Combine(LibraryPath, "libsphinxad.a"));
+                PublicAdditionalLibraries.Add(Path.Combine(LibraryPath, "libsphinxbase.a"));
+                PublicSystemLibraries.Add("pulse-simple");
+                PublicSystemLibraries.Add("pulse");
+            }
+
             if (isLibrarySupported)
             {
                 // Include path
@@ -132,6 +146,15 @@ PublicAdditionalLibraries.Add(Path.Combine(LibraryPath, "libsphinxbase.a"));
                 PublicAdditionalLibraries.Add(Path.Combine(LibraryPath, "libpocketsphinx.a"));
             }
 
+            if (Target.Platform == UnrealTargetPlatform.Linux)
+            {
+                isLibrarySupported = true;
+
+                string LibraryPath = Path.Combine(ThirdPartyPath, "PocketSphinx", "Libraries", "linux");
+
+                PublicAdditionalLibraries.Add(Path.Combine(LibraryPath, "libpocketsphinx.a"));
+            }
+
             if (isLibrarySupported)
             {
                 // Include path
@@ -2,6 +2,7 @@
 
 // ReSharper disable CppPrintfBadFormat
 #include "UELlama/LlamaComponent.h"
+#include "ProfilingDebugging/MiscTrace.h"
 
 #define GGML_CUDA_DMMV_X 64
 #define GGML_CUDA_F16
@@ -54,12 +55,12 @@ string llama_detokenize_bpe(llama_context * ctx, const vector<llama_token> & tok
 namespace Internal
 {
 
-  void Llama::insertPrompt(FString v)
+  void Llama::insertPrompt(FString v, FLlamaPromptTimings timings)
   {
-    qMainToThread.enqueue([this, v = move(v)]() mutable { unsafeInsertPrompt(move(v)); });
+    qMainToThread.enqueue([this, v = move(v), timings]() mutable { unsafeInsertPrompt(move(v), timings); });
   }
 
-  void Llama::unsafeInsertPrompt(FString v)
+  void Llama::unsafeInsertPrompt(FString v, FLlamaPromptTimings timings)
   {
     if (!ctx) {
       UE_LOG(LogTemp, Error, TEXT("Llama not activated"));
@@ -68,6 +69,13 @@ namespace Internal
     string stdV = string(" ") + TCHAR_TO_UTF8(*v);
     vector<llama_token> line_inp = my_llama_tokenize(ctx, stdV, res, false /* add bos */);
     embd_inp.insert(embd_inp.end(), line_inp.begin(), line_inp.end());
+
+    if (timings.CorrelationId != 0)
+    {
+      timings.TokenizedTime = FPlatformTime::Seconds();
+      TRACE_BOOKMARK(TEXT("Prompt %d tokenized"), timings.CorrelationId);
+      pendingTimings.push_back(timings);
+    }
   }
 
   Llama::Llama() : thread([this]() { threadRun(); }) {}
@@ -260,6 +268,19 @@ namespace Internal
 
         // add it to the context
         embd.push_back(id);
+
+        // the first token of the reply to every prompt waiting for one
+        if (!pendingTimings.empty())
+        {
+          const double sampledTime = FPlatformTime::Seconds();
+          for (FLlamaPromptTimings& timings : pendingTimings)
+          {
+            timings.FirstTokenSampledTime = sampledTime;
+            TRACE_BOOKMARK(TEXT("Prompt %d first token sampled"), timings.CorrelationId);
+          }
+          firstTokenTimings = move(pendingTimings);
+          pendingTimings.clear();
+        }
       }
       else
       {
@@ -294,11 +315,19 @@ namespace Internal
       // }
       
       FString token = UTF8_TO_TCHAR(llama_detokenize_bpe(ctx, embd).c_str());
-      qThreadToMain.enqueue([token = move(token), this] {
-        if (!tokenCb)
-          return;
-        tokenCb(move(token));
+      qThreadToMain.enqueue([token = move(token), timings = move(firstTokenTimings), this]() mutable {
+        const double deliveredTime = FPlatformTime::Seconds();
+        if (tokenCb)
+          tokenCb(move(token));
+        for (FLlamaPromptTimings& t : timings)
+        {
+          t.FirstTokenDeliveredTime = deliveredTime;
+          TRACE_BOOKMARK(TEXT("Prompt %d first token delivered"), t.CorrelationId);
+          if (timingsCb)
+            timingsCb(t);
+        }
       });
+      firstTokenTimings.clear();
       ////////////////////////////////////////////////////////////////////////
 
       bool const hasStopSeq = [&]
@@ -444,6 +473,7 @@ ULlamaComponent::ULlamaComponent(const FObjectInitializer &ObjectInitializer)
   PrimaryComponentTick.bCanEverTick = true;
   PrimaryComponentTick.bStartWithTickEnabled = true;
   llama->tokenCb = [this](FString NewToken) { OnNewTokenGenerated.Broadcast(move(NewToken)); };
+  llama->timingsCb = [this](const FLlamaPromptTimings& Timings) { OnPromptTimings.Broadcast(Timings); };
 }
 
 ULlamaComponent::~ULlamaComponent() = default;
@@ -476,3 +506,11 @@ auto ULlamaComponent::InsertPrompt(const FString& v) -> void
 {
   llama->insertPrompt(v);
 }
+
+auto ULlamaComponent::InsertPromptWithCorrelation(const FString& v, int32 CorrelationId) -> void
+{
+  FLlamaPromptTimings timings;
+  timings.CorrelationId = CorrelationId;
+  timings.InsertedTime = FPlatformTime::Seconds();
+  llama->insertPrompt(v, timings);
+}
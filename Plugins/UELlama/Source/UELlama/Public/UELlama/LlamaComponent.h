@@ -75,6 +75,30 @@ namespace
 } // namespace
 
 
+// When each stage of answering a prompt happened, in FPlatformTime::Seconds()
+USTRUCT(BlueprintType)
+struct FLlamaPromptTimings
+{
+  GENERATED_BODY()
+
+  // Passed to InsertPromptWithCorrelation, e.g. the id of the utterance the prompt came from
+  UPROPERTY(BlueprintReadOnly)
+  int32 CorrelationId = 0;
+
+  UPROPERTY(BlueprintReadOnly)
+  double InsertedTime = 0.0;
+
+  UPROPERTY(BlueprintReadOnly)
+  double TokenizedTime = 0.0;
+
+  UPROPERTY(BlueprintReadOnly)
+  double FirstTokenSampledTime = 0.0;
+
+  // When the first token of the reply reached OnNewTokenGenerated, on the game thread
+  UPROPERTY(BlueprintReadOnly)
+  double FirstTokenDeliveredTime = 0.0;
+};
+
 
 namespace Internal
 {
@@ -86,10 +110,11 @@ namespace Internal
 
 		void activate(bool bReset, Params);
 		void deactivate();
-		void insertPrompt(FString v);
+		void insertPrompt(FString v, FLlamaPromptTimings timings = {});
 		void process();
 
 		function<void(FString)> tokenCb;
+		function<void(const FLlamaPromptTimings&)> timingsCb;
 
 	private:
 		llama_model* model = nullptr;
@@ -106,16 +131,20 @@ namespace Internal
 		vector<llama_token> last_n_tokens;
 		int n_consumed = 0;
 		bool eos = false;
+		// prompts with a correlation id that have no reply yet, and those whose first token is being delivered
+		vector<FLlamaPromptTimings> pendingTimings;
+		vector<FLlamaPromptTimings> firstTokenTimings;
 
 		void threadRun();
 		void unsafeActivate(bool bReset, Params);
 		void unsafeDeactivate();
-		void unsafeInsertPrompt(FString);
+		void unsafeInsertPrompt(FString, FLlamaPromptTimings);
 	};
 }
 
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnNewTokenGenerated, FString, NewToken);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnPromptTimings, const FLlamaPromptTimings&, Timings);
 
 UCLASS(Category = "LLM", BlueprintType, meta = (BlueprintSpawnableComponent))
 class UELLAMA_API ULlamaComponent : public UActorComponent
@@ -134,6 +163,10 @@ public:
   UPROPERTY(BlueprintAssignable)
   FOnNewTokenGenerated OnNewTokenGenerated;
 
+  // Fired with the first token of the reply to each prompt inserted with a correlation id
+  UPROPERTY(BlueprintAssignable)
+  FOnPromptTimings OnPromptTimings;
+
   UPROPERTY(EditAnywhere, BlueprintReadWrite)
   FString prompt = "Hello";
 
@@ -146,6 +179,10 @@ public:
   UFUNCTION(BlueprintCallable)
   void InsertPrompt(const FString &v);
 
+  // Like InsertPrompt, and reports when each stage of the reply happened through OnPromptTimings. CorrelationId must not be 0
+  UFUNCTION(BlueprintCallable)
+  void InsertPromptWithCorrelation(const FString &v, int32 CorrelationId);
+
 private:
   std::unique_ptr<Internal::Llama> llama;
 };
@@ -8,7 +8,7 @@ public class PTuber : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 	
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "UELlama"});
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "UELlama", "SpeechRecognition"});
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
 
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "VoiceLatencyComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "SpeechRecognitionSubsystem.h"
+
+UVoiceLatencyComponent::UVoiceLatencyComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+void UVoiceLatencyComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (Llama == nullptr && GetOwner() != nullptr) {
+		Llama = GetOwner()->FindComponentByClass<ULlamaComponent>();
+	}
+	if (Llama != nullptr) {
+		Llama->OnPromptTimings.AddDynamic(this, &UVoiceLatencyComponent::HandlePromptTimings);
+	}
+	else {
+		UE_LOG(LogTemp, Warning, TEXT("VoiceLatency: no Llama component, only the speech side is measured"));
+	}
+
+	if (USpeechRecognitionSubsystem* speech = GetWorld()->GetSubsystem<USpeechRecognitionSubsystem>()) {
+		speech->OnWordsSpoken.AddDynamic(this, &UVoiceLatencyComponent::HandleWordsSpoken);
+	}
+}
+
+void UVoiceLatencyComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (Llama != nullptr) {
+		Llama->OnPromptTimings.RemoveDynamic(this, &UVoiceLatencyComponent::HandlePromptTimings);
+	}
+	if (UWorld* world = GetWorld()) {
+		if (USpeechRecognitionSubsystem* speech = world->GetSubsystem<USpeechRecognitionSubsystem>()) {
+			speech->OnWordsSpoken.RemoveDynamic(this, &UVoiceLatencyComponent::HandleWordsSpoken);
+		}
+	}
+
+	if (Tracker.GetNumCompleted() > 0) {
+		UE_LOG(LogTemp, Log, TEXT("VoiceLatency: %s"), *Tracker.GetSummaryString());
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UVoiceLatencyComponent::HandleWordsSpoken(FRecognisedPhrases Phrases)
+{
+	Tracker.RecordSpeech(Phrases.UtteranceId, Phrases.SpeechEndTime, Phrases.HypothesisTime, Phrases.BroadcastTime);
+
+	if (!bForwardUtterances || Llama == nullptr || Phrases.UtteranceId == 0) {
+		return;
+	}
+	FString text = FString::Join(Phrases.phrases, TEXT(" "));
+	if (!text.IsEmpty()) {
+		Llama->InsertPromptWithCorrelation(text, Phrases.UtteranceId);
+	}
+}
+
+void UVoiceLatencyComponent::HandlePromptTimings(const FLlamaPromptTimings& Timings)
+{
+	bool completed = Tracker.RecordPrompt(Timings.CorrelationId, Timings.TokenizedTime, Timings.FirstTokenSampledTime, Timings.FirstTokenDeliveredTime);
+	if (completed && LogInterval > 0 && Tracker.GetNumCompleted() % LogInterval == 0) {
+		UE_LOG(LogTemp, Log, TEXT("VoiceLatency: %s"), *Tracker.GetSummaryString());
+	}
+}
+
+FVoiceLatencySummary UVoiceLatencyComponent::GetLatencySummary() const
+{
+	return Tracker.GetSummary();
+}
+
+void UVoiceLatencyComponent::ResetLatency()
+{
+	Tracker.Reset();
+}
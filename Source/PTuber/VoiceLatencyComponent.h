@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "SpeechRecognition.h"
+#include "UELlama/LlamaComponent.h"
+#include "VoiceLatencyTracker.h"
+#include "VoiceLatencyComponent.generated.h"
+
+/**
+ * Measures the time from the viewer finishing a sentence to the avatar starting its reply.
+ *
+ * Listens to the speech recognition subsystem's OnWordsSpoken and a Llama component's OnPromptTimings,
+ * and joins the two by the utterance's id, which the prompt carries as its correlation id.
+ */
+UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
+class PTUBER_API UVoiceLatencyComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UVoiceLatencyComponent();
+
+	/** Where the replies come from. The owner's Llama component when not set */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Voice Latency")
+	TObjectPtr<ULlamaComponent> Llama;
+
+	/** Sends each recognised utterance to Llama as a prompt. Off when Blueprints make the prompts, with InsertPromptWithCorrelation and the utterance's id */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Voice Latency")
+	bool bForwardUtterances = true;
+
+	/** Logs the summary every this many answered utterances. 0 never does */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Voice Latency")
+	int32 LogInterval = 20;
+
+	/** Percentiles of each stage over the last answered utterances */
+	UFUNCTION(BlueprintCallable, Category = "Voice Latency")
+	FVoiceLatencySummary GetLatencySummary() const;
+
+	UFUNCTION(BlueprintCallable, Category = "Voice Latency")
+	void ResetLatency();
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	UFUNCTION()
+	void HandleWordsSpoken(FRecognisedPhrases Phrases);
+
+	UFUNCTION()
+	void HandlePromptTimings(const FLlamaPromptTimings& Timings);
+
+	FVoiceLatencyTracker Tracker;
+};
@@ -0,0 +1,159 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "VoiceLatencyTracker.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+TRACE_DECLARE_FLOAT_COUNTER(VoiceLatencyTotal, TEXT("PTuber/Voice Latency/Total (ms)"));
+TRACE_DECLARE_FLOAT_COUNTER(VoiceLatencyRecognition, TEXT("PTuber/Voice Latency/Recognition (ms)"));
+TRACE_DECLARE_FLOAT_COUNTER(VoiceLatencyFirstToken, TEXT("PTuber/Voice Latency/First Token (ms)"));
+
+namespace
+{
+	// records waiting for their other half longer than this are dropped
+	const double StaleSeconds = 60.0;
+
+	float ToMs(double From, double To)
+	{
+		return (float)((To - From) * 1000.0);
+	}
+
+	FVoiceLatencyPercentiles Percentiles(TArray<float>& Samples)
+	{
+		FVoiceLatencyPercentiles result;
+		if (Samples.Num() == 0) {
+			return result;
+		}
+		Samples.Sort();
+
+		// nearest rank
+		auto rank = [&Samples](double P) {
+			int32 index = FMath::CeilToInt32(P * Samples.Num()) - 1;
+			return Samples[FMath::Clamp(index, 0, Samples.Num() - 1)];
+		};
+		result.P50Ms = rank(0.50);
+		result.P95Ms = rank(0.95);
+		result.P99Ms = rank(0.99);
+		return result;
+	}
+
+	FString ToString(const TCHAR* Name, const FVoiceLatencyPercentiles& P)
+	{
+		return FString::Printf(TEXT("%s %.0f/%.0f/%.0f"), Name, P.P50Ms, P.P95Ms, P.P99Ms);
+	}
+}
+
+FVoiceLatencyTracker::FVoiceLatencyTracker(int32 InWindowSize)
+	: WindowSize(FMath::Max(InWindowSize, 1))
+{
+	Window.Reserve(WindowSize);
+}
+
+void FVoiceLatencyTracker::RecordSpeech(int32 UtteranceId, double SpeechEnd, double HypothesisReady, double Broadcast)
+{
+	if (UtteranceId == 0) {
+		return;
+	}
+	PruneStale(FPlatformTime::Seconds());
+
+	FRecord& record = InFlight.FindOrAdd(UtteranceId);
+	record.SpeechEnd = SpeechEnd;
+	record.HypothesisReady = HypothesisReady;
+	record.Broadcast = Broadcast;
+	TryComplete(UtteranceId);
+}
+
+bool FVoiceLatencyTracker::RecordPrompt(int32 UtteranceId, double Tokenized, double FirstTokenSampled, double FirstTokenDelivered)
+{
+	if (UtteranceId == 0) {
+		return false;
+	}
+
+	FRecord& record = InFlight.FindOrAdd(UtteranceId);
+	record.Tokenized = Tokenized;
+	record.FirstTokenSampled = FirstTokenSampled;
+	record.FirstTokenDelivered = FirstTokenDelivered;
+	return TryComplete(UtteranceId);
+}
+
+bool FVoiceLatencyTracker::TryComplete(int32 UtteranceId)
+{
+	const FRecord* record = InFlight.Find(UtteranceId);
+	if (record == nullptr || !record->HasSpeech() || !record->HasPrompt()) {
+		return false;
+	}
+
+	if (Window.Num() < WindowSize) {
+		Window.Add(*record);
+	}
+	else {
+		Window[WindowNext] = *record;
+	}
+	WindowNext = (WindowNext + 1) % WindowSize;
+	NumCompleted++;
+
+	float total = ToMs(record->SpeechEnd, record->FirstTokenDelivered);
+	TRACE_COUNTER_SET(VoiceLatencyTotal, total);
+	TRACE_COUNTER_SET(VoiceLatencyRecognition, ToMs(record->SpeechEnd, record->HypothesisReady));
+	TRACE_COUNTER_SET(VoiceLatencyFirstToken, ToMs(record->Tokenized, record->FirstTokenSampled));
+	TRACE_BOOKMARK(TEXT("Utterance %d answered after %.0f ms"), UtteranceId, total);
+
+	InFlight.Remove(UtteranceId);
+	return true;
+}
+
+void FVoiceLatencyTracker::PruneStale(double Now)
+{
+	for (auto it = InFlight.CreateIterator(); it; ++it) {
+		const FRecord& record = it.Value();
+		double seen = record.HasSpeech() ? record.Broadcast : record.FirstTokenDelivered;
+		if (Now - seen > StaleSeconds) {
+			it.RemoveCurrent();
+		}
+	}
+}
+
+FVoiceLatencySummary FVoiceLatencyTracker::GetSummary() const
+{
+	FVoiceLatencySummary summary;
+	summary.NumSamples = Window.Num();
+
+	TArray<float> samples;
+	samples.Reserve(Window.Num());
+	auto stage = [this, &samples](double FRecord::* From, double FRecord::* To) {
+		samples.Reset();
+		for (const FRecord& record : Window) {
+			samples.Add(ToMs(record.*From, record.*To));
+		}
+		return Percentiles(samples);
+	};
+
+	summary.Recognition = stage(&FRecord::SpeechEnd, &FRecord::HypothesisReady);
+	summary.Dispatch = stage(&FRecord::HypothesisReady, &FRecord::Broadcast);
+	summary.Tokenize = stage(&FRecord::Broadcast, &FRecord::Tokenized);
+	summary.FirstToken = stage(&FRecord::Tokenized, &FRecord::FirstTokenSampled);
+	summary.Delivery = stage(&FRecord::FirstTokenSampled, &FRecord::FirstTokenDelivered);
+	summary.Total = stage(&FRecord::SpeechEnd, &FRecord::FirstTokenDelivered);
+	return summary;
+}
+
+FString FVoiceLatencyTracker::GetSummaryString() const
+{
+	FVoiceLatencySummary summary = GetSummary();
+	return FString::Printf(TEXT("last %d, p50/p95/p99 ms: %s, %s, %s, %s, %s, %s"), summary.NumSamples,
+		*ToString(TEXT("total"), summary.Total),
+		*ToString(TEXT("recognition"), summary.Recognition),
+		*ToString(TEXT("dispatch"), summary.Dispatch),
+		*ToString(TEXT("tokenize"), summary.Tokenize),
+		*ToString(TEXT("first token"), summary.FirstToken),
+		*ToString(TEXT("delivery"), summary.Delivery));
+}
+
+void FVoiceLatencyTracker::Reset()
+{
+	InFlight.Reset();
+	Window.Reset();
+	WindowNext = 0;
+	NumCompleted = 0;
+}
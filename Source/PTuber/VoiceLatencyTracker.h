@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoiceLatencyTracker.generated.h"
+
+USTRUCT(BlueprintType)
+struct FVoiceLatencyPercentiles
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	float P50Ms = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	float P95Ms = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	float P99Ms = 0.0f;
+};
+
+/** Latency of the last answered utterances, stage by stage */
+USTRUCT(BlueprintType)
+struct FVoiceLatencySummary
+{
+	GENERATED_BODY()
+
+	/** Utterances the percentiles are over */
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	int32 NumSamples = 0;
+
+	/** VAD end to hypothesis ready */
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	FVoiceLatencyPercentiles Recognition;
+
+	/** Hypothesis ready to the game thread delegate */
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	FVoiceLatencyPercentiles Dispatch;
+
+	/** Delegate to prompt tokenized */
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	FVoiceLatencyPercentiles Tokenize;
+
+	/** Prompt tokenized to first reply token sampled */
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	FVoiceLatencyPercentiles FirstToken;
+
+	/** First token sampled to delivered on the game thread */
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	FVoiceLatencyPercentiles Delivery;
+
+	/** VAD end to first token delivered: the viewer stopping to the avatar starting its reply */
+	UPROPERTY(BlueprintReadOnly, Category = "Voice Latency")
+	FVoiceLatencyPercentiles Total;
+};
+
+/**
+ * Joins the timestamps the speech recognizer and the LLM report for an utterance, by its id,
+ * and keeps the last WindowSize complete ones for the percentiles.
+ *
+ * Game thread only.
+ */
+class PTUBER_API FVoiceLatencyTracker
+{
+public:
+	explicit FVoiceLatencyTracker(int32 InWindowSize = 256);
+
+	/** The recognizer's side of an utterance, from FRecognisedPhrases */
+	void RecordSpeech(int32 UtteranceId, double SpeechEnd, double HypothesisReady, double Broadcast);
+
+	/** The LLM's side, from FLlamaPromptTimings. Returns true when the utterance is complete, and counted */
+	bool RecordPrompt(int32 UtteranceId, double Tokenized, double FirstTokenSampled, double FirstTokenDelivered);
+
+	FVoiceLatencySummary GetSummary() const;
+	FString GetSummaryString() const;
+
+	/** Utterances answered since the start */
+	int32 GetNumCompleted() const { return NumCompleted; }
+
+	void Reset();
+
+private:
+	struct FRecord
+	{
+		double SpeechEnd = 0.0;
+		double HypothesisReady = 0.0;
+		double Broadcast = 0.0;
+		double Tokenized = 0.0;
+		double FirstTokenSampled = 0.0;
+		double FirstTokenDelivered = 0.0;
+
+		bool HasSpeech() const { return SpeechEnd > 0.0; }
+		bool HasPrompt() const { return FirstTokenDelivered > 0.0; }
+	};
+
+	bool TryComplete(int32 UtteranceId);
+
+	/** Drops utterances that never got both halves, e.g. ones no prompt was made of */
+	void PruneStale(double Now);
+
+	int32 WindowSize;
+	TMap<int32, FRecord> InFlight;
+
+	// ring of the complete records
+	TArray<FRecord> Window;
+	int32 WindowNext = 0;
+	int32 NumCompleted = 0;
+};